@@ -71,6 +71,38 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+#elif defined(__x86_64__)
+/*******************************************************
+ * x86-64 versions of start_counter() and get_counter()
+ *******************************************************/
+
+/* Initialize the cycle counter */
+static unsigned long long cyc_start = 0;
+
+/* 
+ * Read the time stamp counter with rdtscp, which waits for the 
+ * instructions before it to complete, so that they are counted.
+ */
+static unsigned long long access_counter(void)
+{
+    unsigned hi, lo;
+
+    asm volatile("rdtscp" : "=d" (hi), "=a" (lo) : : "%ecx");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    cyc_start = access_counter();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    return (double)(access_counter() - cyc_start);
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -82,21 +82,62 @@
   */
 #define UTIL_WEIGHT .60
 
+/*
+ * Threaded replay (mdriver -T): each run makes at least THREAD_MIN_OPS
+ * requests, and the fastest of THREAD_RUNS runs counts.
+ */
+#define THREAD_MIN_OPS   200000
+#define THREAD_RUNS      3
+
+/*
+ * Thresholds of mdriver -b: a trace regresses if its utilization drops
+ * by more than BASELINE_UTIL_TOL, or its throughput (fastest sample) by
+ * more than BASELINE_THRU_TOL plus the spread of the K fastest samples
+ * of both runs, and still does when timed again BASELINE_RETRIES times.
+ */
+#define BASELINE_UTIL_TOL   0.005  /* half a percentage point */
+#define BASELINE_THRU_TOL   0.10   /* 10% */
+#define BASELINE_RETRIES    2
+
+/*
+ * Fragmentation timeline (mdriver -F): a sample every TIMELINE_EVERY
+ * requests, unless -N says otherwise.
+ */
+#define TIMELINE_EVERY   1000
+
+/*
+ * Scaling benchmark (mdriver -X): a trace whose time per request grows
+ * with its length faster than length^SCALE_SLOPE_TOL is flagged.
+ */
+#define SCALE_SLOPE_TOL  0.15
+
 /* 
  * Alignment requirement in bytes (either 4 or 8) 
  */
 #define ALIGNMENT 8  
 
 /* 
- * Maximum heap size in bytes 
+ * Maximum heap size in bytes. Wide builds (-DMM_WIDE, see mdriver-wide
+ * in the Makefile) have 64-bit block sizes and a heap far beyond 4 GB,
+ * which mem_init only reserves.
  */
+#ifdef MM_WIDE
+#define MAX_HEAP ((size_t)64 << 30)  /* 64 GB */
+#else
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_CLOCK  1   /* invariant TSC or CLOCK_MONOTONIC_RAW w/K-best (Linux) */
+
+/* Parameters of the K-best scheme of USE_CLOCK */
+#define CLOCK_K           3     /* the K fastest samples ... */
+#define CLOCK_EPSILON     0.01  /* ... within 1% of each other */
+#define CLOCK_MAXSAMPLES  20    /* or give up after this many */
 
 #endif /* __CONFIG_H */
@@ -36,6 +36,13 @@ void init_fsecs(void)
 #elif USE_GETTOD
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
+#elif USE_CLOCK
+    Mhz = ftimer_clock_init();
+    if (verbose && Mhz > 0)
+	printf("Measuring performance with the invariant TSC (%.0f MHz).\n",
+	       Mhz);
+    else if (verbose)
+	printf("Measuring performance with clock_gettime(CLOCK_MONOTONIC_RAW).\n");
 #endif
 }
 
@@ -44,6 +51,18 @@ void init_fsecs(void)
  */
 double fsecs(fsecs_test_funct f, void *argp) 
 {
+    return fsecs_stats(f, argp, NULL);
+}
+
+/*
+ * fsecs_stats - fsecs, also returning the median and confidence interval
+ *     of the samples in stats if the timing method takes several (else
+ *     stats->samples is 0)
+ */
+double fsecs_stats(fsecs_test_funct f, void *argp, ftimer_stats_t *stats)
+{
+    if (stats != NULL)
+	stats->samples = 0;
 #if USE_FCYC
     double cycles = fcyc(f, argp);
     return cycles/(Mhz*1e6);
@@ -51,6 +70,9 @@ double fsecs(fsecs_test_funct f, void *argp)
     return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
     return ftimer_gettod(f, argp, 10);
+#elif USE_CLOCK
+    return ftimer_clock(f, argp, CLOCK_K, CLOCK_MAXSAMPLES, CLOCK_EPSILON, 
+			stats);
 #endif 
 }
 
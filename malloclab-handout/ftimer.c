@@ -7,14 +7,38 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_clock:  version that uses the invariant TSC (x86) or
+ *                   clock_gettime(CLOCK_MONOTONIC_RAW), with the K-best
+ *                   scheme, and that reports the spread of its samples
  */
+#define _GNU_SOURCE /* for sched_getcpu */
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
 #include <sys/time.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
 #include "ftimer.h"
 
+#define CLOCK_CALIBRATE 0.05    /* secs spent measuring the TSC rate */
+#define CLOCK_MINSAMPLE 1e-3    /* shortest sample, in secs */
+#define CLOCK_MAXREPS   100000  /* most runs of f in one sample */
+
 /* function prototypes */
 static void init_etime(void);
 static double get_etime(void);
+static double clock_now(void);
+static double raw_now(void);
+static double sample(ftimer_test_funct f, void *argp, int reps);
+static double t_975(int df);
+
+/* Time source of ftimer_clock */
+static int use_tsc = 0;         /* read the TSC (else CLOCK_MONOTONIC_RAW) */
+static double tsc_secs = 0;     /* seconds per TSC tick */
 
 /* 
  * ftimer_itimer - Use the interval timer to estimate the running time
@@ -52,6 +76,158 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
     return (1E-3*diff);
 }
 
+/*
+ * ftimer_clock_init - choose the time source of ftimer_clock: the TSC if
+ *     it is invariant (runs at a constant rate in every P- and C-state,
+ *     and in step on all cores), calibrated against CLOCK_MONOTONIC_RAW.
+ *     Returns the TSC rate in MHz, or 0 if the clock is used instead.
+ */
+double ftimer_clock_init(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx, aux;
+    unsigned long long t0, t1;
+    double s0, s1;
+
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1 << 8))) {
+	s0 = raw_now();
+	t0 = __rdtscp(&aux);
+	do {
+	    s1 = raw_now();
+	    t1 = __rdtscp(&aux);
+	} while (s1 - s0 < CLOCK_CALIBRATE);
+	tsc_secs = (s1 - s0) / (double)(t1 - t0);
+	use_tsc = 1;
+	return 1e-6 / tsc_secs;
+    }
+#endif
+    use_tsc = 0;
+    return 0;
+}
+
+/*
+ * ftimer_clock - Estimate the running time of f(argp) with the K-best
+ * scheme: take samples until the k fastest are within a factor of
+ * 1+epsilon of each other (or maxsamples have been taken), and return
+ * the fastest. A sample averages enough runs of f to last at least
+ * CLOCK_MINSAMPLE. The process stays on one cpu while it is sampled.
+ * If stats is not NULL, the median of the samples, the 95% confidence
+ * interval of their mean and the spread of the k fastest are stored in it.
+ */
+double ftimer_clock(ftimer_test_funct f, void *argp, int k, int maxsamples,
+		    double epsilon, ftimer_stats_t *stats)
+{
+    double *samples;
+    double t, mean, var, spread = 0;
+    int i, n, reps;
+    cpu_set_t saved, one;
+    int pinned = 0;
+
+    if ((samples = (double *)malloc(maxsamples * sizeof(double))) == NULL) {
+	fprintf(stderr, "ftimer_clock: out of memory\n");
+	exit(1);
+    }
+    if (sched_getaffinity(0, sizeof(saved), &saved) == 0 && 
+	sched_getcpu() >= 0) {
+	CPU_ZERO(&one);
+	CPU_SET(sched_getcpu(), &one);
+	pinned = sched_setaffinity(0, sizeof(one), &one) == 0;
+    }
+
+    /* The first run warms up the caches and sizes the samples */
+    t = sample(f, argp, 1);
+    reps = 1;
+    if (t < CLOCK_MINSAMPLE)
+	reps = t > CLOCK_MINSAMPLE / CLOCK_MAXREPS ? 
+	    (int)ceil(CLOCK_MINSAMPLE / t) : CLOCK_MAXREPS;
+
+    /* Keep samples sorted, so that the k fastest come first */
+    for (n = 0; n < maxsamples; n++) {
+	t = sample(f, argp, reps);
+	for (i = n; i > 0 && samples[i-1] > t; i--)
+	    samples[i] = samples[i-1];
+	samples[i] = t;
+	spread = samples[(n + 1 < k ? n + 1 : k) - 1] / samples[0] - 1;
+	if (n + 1 >= k && (1 + epsilon) * samples[0] >= samples[k-1])
+	    break;
+    }
+    if (n < maxsamples)
+	n++;
+
+    if (stats != NULL) {
+	mean = var = 0;
+	for (i = 0; i < n; i++)
+	    mean += samples[i];
+	mean /= n;
+	for (i = 0; i < n; i++)
+	    var += (samples[i] - mean) * (samples[i] - mean);
+	stats->samples = n;
+	stats->median = n % 2 ? samples[n/2] : 
+	    (samples[n/2 - 1] + samples[n/2]) / 2;
+	stats->ci = n > 1 ? t_975(n - 1) * sqrt(var / (n - 1) / n) : 0;
+	stats->spread = spread;
+    }
+    t = samples[0];
+    free(samples);
+    if (pinned)
+	sched_setaffinity(0, sizeof(saved), &saved);
+    return t;
+}
+
+/*
+ * sample - the average time of reps runs of f(argp)
+ */
+static double sample(ftimer_test_funct f, void *argp, int reps)
+{
+    double start;
+    int i;
+
+    start = clock_now();
+    for (i = 0; i < reps; i++)
+	f(argp);
+    return (clock_now() - start) / reps;
+}
+
+/*
+ * clock_now - the time source of ftimer_clock, in seconds
+ */
+static double clock_now(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned int aux;
+
+    if (use_tsc)
+	return __rdtscp(&aux) * tsc_secs;
+#endif
+    return raw_now();
+}
+
+/*
+ * raw_now - CLOCK_MONOTONIC_RAW in seconds (not slewed by NTP)
+ */
+static double raw_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/*
+ * t_975 - the 97.5% quantile of Student's t distribution with df degrees
+ *     of freedom, for two-sided 95% confidence intervals
+ */
+static double t_975(int df)
+{
+    static const double t[] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+
+    return df <= 30 ? t[df - 1] : 1.96;
+}
+
 
 /*
  * Routines for manipulating the Unix interval timer
@@ -1,6 +1,9 @@
 /* 
  * Function timers 
  */
+#ifndef __FTIMER_H_
+#define __FTIMER_H_
+
 typedef void (*ftimer_test_funct)(void *); 
 
 /* Estimate the running time of f(argp) using the Unix interval timer.
@@ -12,3 +15,23 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/* The spread of the samples taken by ftimer_clock */
+typedef struct {
+    int samples;     /* number of samples */
+    double median;   /* median sample (secs) */
+    double ci;       /* half-width of the 95% confidence interval of the
+			mean sample (secs) */
+    double spread;   /* the k-th fastest sample over the fastest, less 1
+			(at most epsilon if the K-best scheme converged) */
+} ftimer_stats_t;
+
+/* Choose the time source of ftimer_clock. Returns the TSC rate in MHz,
+   or 0 if clock_gettime(CLOCK_MONOTONIC_RAW) is used */
+double ftimer_clock_init(void);
+
+/* Estimate the running time of f(argp) using the invariant TSC or
+   CLOCK_MONOTONIC_RAW with the K-best scheme. Return the fastest sample */
+double ftimer_clock(ftimer_test_funct f, void *argp, int k, int maxsamples,
+		    double epsilon, ftimer_stats_t *stats);
+
+#endif /* __FTIMER_H_ */
@@ -0,0 +1,104 @@
+/*
+ * latency.c - Percentiles of latency histograms, and the conversion of
+ *             ticks to nanoseconds
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "latency.h"
+
+#define LAT_CALIBRATE_NS 20000000     /* measure the tick rate for 20 ms */
+
+static double ns_per_tick = 1.0;
+
+static uint64_t now_ns(void);
+static uint64_t bucket_top(int bucket);
+
+/*
+ * lat_init - find out how long a tick is, by counting the ticks of a
+ *     busy wait timed with the monotonic clock
+ */
+void lat_init(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    uint64_t ns0, ns1, t0, t1;
+
+    ns0 = now_ns();
+    t0 = lat_now();
+    do {
+	ns1 = now_ns();
+	t1 = lat_now();
+    } while (ns1 - ns0 < LAT_CALIBRATE_NS);
+    ns_per_tick = (double)(ns1 - ns0) / (double)(t1 - t0);
+#endif
+}
+
+/*
+ * lat_clear - empty a histogram
+ */
+void lat_clear(lat_hist_t *hist)
+{
+    memset(hist, 0, sizeof(lat_hist_t));
+}
+
+/*
+ * lat_percentile - the latency (in ticks) that pct percent of the
+ *     requests did not exceed. This is the top of the bucket holding
+ *     that request, so it is at most 1/LAT_SUB too high, except that it
+ *     never exceeds the largest latency.
+ */
+uint64_t lat_percentile(lat_hist_t *hist, double pct)
+{
+    uint64_t rank, seen = 0;
+    uint64_t top;
+    int i;
+
+    if (hist->count == 0)
+	return 0;
+    rank = (uint64_t)(pct / 100.0 * hist->count + 0.5);
+    if (rank < 1)
+	rank = 1;
+    for (i = 0; i < LAT_BUCKETS; i++) {
+	seen += hist->counts[i];
+	if (seen >= rank)
+	    break;
+    }
+    top = bucket_top(i);
+    return top < hist->max ? top : hist->max;
+}
+
+/*
+ * lat_summarize - the percentiles of a histogram, in nanoseconds
+ */
+void lat_summarize(lat_hist_t *hist, lat_summary_t *summary)
+{
+    summary->count = hist->count;
+    summary->p50 = lat_percentile(hist, 50.0) * ns_per_tick;
+    summary->p99 = lat_percentile(hist, 99.0) * ns_per_tick;
+    summary->p999 = lat_percentile(hist, 99.9) * ns_per_tick;
+    summary->max = hist->max * ns_per_tick;
+}
+
+/*
+ * bucket_top - the largest latency that falls in a bucket
+ */
+static uint64_t bucket_top(int bucket)
+{
+    int shift = (bucket >> LAT_SUBBITS) - 1;
+
+    if (shift < 0)
+	return bucket;
+    return (((uint64_t)(bucket & (LAT_SUB - 1)) + LAT_SUB + 1) << shift) - 1;
+}
+
+/*
+ * now_ns - the monotonic clock, in nanoseconds
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,83 @@
+/*
+ * latency.h - Histograms of the latencies of single allocator requests
+ *
+ * Latencies are measured in ticks of the cheapest clock there is (the
+ * time stamp counter on x86, nanoseconds elsewhere) and counted in a
+ * log-linear histogram, as in HdrHistogram: every power of two is split
+ * into LAT_SUB equal buckets, so a value is known to within 1/LAT_SUB of
+ * itself whatever its magnitude, in a fixed amount of memory.
+ */
+#ifndef __LATENCY_H_
+#define __LATENCY_H_
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#define LAT_SUBBITS 6                 /* 64 buckets per power of two */
+#define LAT_SUB (1 << LAT_SUBBITS)
+#define LAT_BUCKETS ((64 - LAT_SUBBITS + 1) * LAT_SUB)
+
+/* Latencies of one type of request */
+typedef struct {
+    uint64_t counts[LAT_BUCKETS];
+    uint64_t count;                   /* number of requests */
+    uint64_t max;                     /* largest latency, exactly */
+} lat_hist_t;
+
+/* Percentiles of a histogram, in nanoseconds */
+typedef struct {
+    double count;
+    double p50, p99, p999;
+    double max;
+} lat_summary_t;
+
+void lat_init(void);
+void lat_clear(lat_hist_t *hist);
+uint64_t lat_percentile(lat_hist_t *hist, double pct);
+void lat_summarize(lat_hist_t *hist, lat_summary_t *summary);
+
+/*
+ * lat_now - the current time in ticks
+ */
+static inline uint64_t lat_now(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/*
+ * lat_bucket - the bucket of a latency of ticks: values below LAT_SUB
+ *     have a bucket each, larger ones share it with the values that have
+ *     the same LAT_SUBBITS+1 leading bits
+ */
+static inline int lat_bucket(uint64_t ticks)
+{
+    int shift;
+
+    if (ticks < LAT_SUB)
+	return (int)ticks;
+    shift = 63 - __builtin_clzll(ticks) - LAT_SUBBITS;
+    return ((shift + 1) << LAT_SUBBITS) + (int)(ticks >> shift) - LAT_SUB;
+}
+
+/*
+ * lat_record - count one request that took ticks
+ */
+static inline void lat_record(lat_hist_t *hist, uint64_t ticks)
+{
+    hist->counts[lat_bucket(ticks)]++;
+    hist->count++;
+    if (ticks > hist->max)
+	hist->max = ticks;
+}
+
+#endif /* __LATENCY_H_ */
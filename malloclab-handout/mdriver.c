@@ -7,19 +7,31 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE /* for sched_setaffinity */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <math.h>
 #include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <sys/wait.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
 #include "config.h"
+#include "trace.h"
+#include "stream.h"
+#include "latency.h"
+#include "perfctr.h"
 
 /**********************
  * Constants and macros
@@ -31,37 +43,25 @@
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* 
+ * Records the extent of each block's payload. The ranges of a trace
+ * form an AVL tree ordered by address; since live payloads never
+ * overlap, ordering them by lo also orders them by hi.
+ */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* ranges below lo */
+    struct range_t *right; /* ranges above hi */
+    int height;            /* height of the subtree rooted here */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
-typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
-
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -70,21 +70,143 @@ typedef struct {
 typedef struct {
     trace_t *trace;  
     range_t *ranges;
+
+    /* used instead of trace when streaming (-s) */
+    trace_stream_t *stream;  /* the tracefile, read chunk by chunk */
+    livemap_t *live;         /* the blocks currently allocated */
+    mm_arena_t **arenas;     /* arenas, by arena id */
+    int *arena_heads;        /* last block allocated from each arena */
+
+    lat_hist_t *lat;         /* latencies by request type, or NULL (-L) */
+    struct perf_sum *perf;   /* counts by request type, or NULL (-P) */
 } speed_t;
 
+/* Counts of hardware events summed over the requests of one type (-P) */
+typedef struct perf_sum {
+    perf_raw_t sum;          /* the counts, as read from the kernel */
+    double requests;         /* the number of requests */
+} perf_sum_t;
+
+/* 
+ * Where the bytes of the heap went when it last grew (-W). They add up
+ * to heap: payload, align and slack for the blocks from mm_malloc and
+ * mm_realloc, arena for the arena chunks (past their objects' payload)
+ * and descriptors, and tags, state and the free blocks for the rest.
+ */
+typedef struct {
+    double heap;        /* heap size (0 if not measured) */
+    double payload;     /* bytes asked for by the live blocks */
+    double align;       /* rounding up to mm_round_size */
+    double slack;       /* allocated past that: unsplit remainders */
+    double arena;       /* arena chunks and descriptors */
+    double tags;        /* headers and footers */
+    double state;       /* allocator state, prologue, end of heap */
+    double free;        /* free blocks ... */
+    double small_free;  /* ... smaller than the average live block */
+} frag_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    ftimer_stats_t timing; /* spread of the timing samples, if several */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    lat_summary_t lat[ARENA_DESTROY + 1]; /* latencies by request type (-L) */
+    perf_counts_t perf_all;  /* hardware events per request (-P) ... */
+    perf_counts_t perf[ARENA_DESTROY + 1]; /* ... and by request type */
+    frag_t frag;     /* where the heap went when it last grew (-W) */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* 
+ * One thread's share of a trace in a threaded replay (-T): the requests
+ * of some of the blocks and arenas, with tables of its own so that the
+ * threads touch no common memory but the heap.
+ */
+typedef struct {
+    traceop_t *ops;          /* the requests of the shard */
+    int num_ops;
+    int reps;                /* times the shard is replayed in one run */
+    int use_libc;            /* replay with libc malloc instead of mm */
+    char **blocks;           /* blocks, by block id (NULL if not live) */
+    mm_arena_t **arenas;     /* arenas, by arena id (NULL if none) */
+    int *arena_heads;        /* libc: last block allocated in each arena */
+    int *arena_links;        /* libc: previous block in the same arena */
+    pthread_barrier_t *start;/* where all the threads of a run wait */
+    double begin, end;       /* when the thread started and finished */
+} shard_t;
+
+/*
+ * A thread of a concurrent replay (-C): the requests the trace gives
+ * it, in order, each with the point it must wait for in another thread
+ */
+typedef struct {
+    int *ops;                /* indexes of its requests in the trace */
+    int *wait_thread;        /* request k waits until this thread ... */
+    int *wait_count;         /* ... has done this many (0: no wait) */
+    int num_ops;
+    int waits;               /* requests that had to wait */
+    double begin, end;       /* when the thread started and finished */
+    struct replay *replay;
+} cthread_t;
+
+/* Requests done by a thread so far, in a cache line of its own */
+typedef struct {
+    int done;
+} __attribute__((aligned(64))) progress_t;
+
+/* A concurrent replay of one trace */
+typedef struct replay {
+    trace_t *trace;
+    int use_libc;            /* replay with libc malloc instead of mm */
+    int num_threads;
+    cthread_t *threads;
+    progress_t *progress;    /* by thread */
+    pthread_barrier_t start; /* where all the threads wait to start */
+} replay_t;
+
+/* 
+ * An allocator loaded from a shared object (-A), with the memlib it was
+ * linked with, so that its heap is apart from mm's and the others'
+ */
+typedef struct {
+    char *path;
+    void *handle;                      /* from dlopen */
+    int (*init)(void);                 /* mm_init ... */
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void (*mem_init)(void);            /* ... and its memlib */
+    void (*mem_reset_brk)(void);
+    size_t (*mem_heapsize)(void);
+    void *(*mem_heap_lo)(void);
+    void *(*mem_heap_hi)(void);
+    stats_t *stats;                    /* by trace */
+} alloc_t;
+
+/* What fsecs passes to eval_alloc_speed */
+typedef struct {
+    alloc_t *alloc;
+    trace_t *trace;
+} alloc_speed_t;
+
+/* The rows of the fragmentation timeline of one trace (-F) */
+typedef struct {
+    char *text;
+    size_t len, cap;
+} timeline_t;
+
+/* What the process evaluating one trace for -j sends back to main */
+typedef struct {
+    stats_t stats;   /* the mm stats for the trace */
+    int errors;      /* number of errors found while evaluating it */
+} result_t;
+
 /********************
  * Global variables
  *******************/
@@ -100,20 +222,63 @@ static char *default_tracefiles[] = {
     DEFAULT_TRACEFILES, NULL
 };
 
+/* If set, traces are streamed rather than read into memory (-s) */
+static int streaming = 0;
+
+/* If set, the latency of every request is measured (-L) */
+static int latency = 0;
+
+/* If set, hardware events are counted (-P) */
+static int perfctrs = 0;
+
+/* Largest number of threads the traces are replayed on (-T), or 0 */
+static int maxthreads = 0;
+
+/* Largest number of copies the traces are scaled to (-X), or 0 */
+static int maxscale = 0;
+
+/* If set, threaded traces are replayed with one thread per thread (-C) */
+static int concurrent = 0;
+
+/* Allocators loaded from shared objects, to compare with mm (-A) */
+static alloc_t *allocs = NULL;
+static int num_allocs = 0;
+
+/* If set, the heap is broken down by use when it last grows (-W) */
+static int breakdown = 0;
+
+/* Fragmentation timeline (-F): its file, and requests between samples (-N) */
+static int timeline_fd = -1;
+static int timeline_every = TIMELINE_EVERY;
+
+/* Files to write the results to (-o) and to compare them with (-b) */
+static char *outfile = NULL;
+static char *baseline = NULL;
+
+/* Names of the request types, for the latency and counter tables */
+static char *request_names[] = {
+    "malloc", "free", "realloc",
+    "arena_create", "arena_alloc", "arena_reset", "arena_destroy"
+};
+
 
 /********************* 
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
+/* these functions manipulate range trees */
+static int add_range(range_t **ranges, char *lo, size_t size, 
 		     int tracenum, int opnum);
+static int add_heap_range(range_t **ranges, char *lo, size_t size, 
+			  char *heap_lo, char *heap_hi, char *msg);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
-
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
+static range_t *find_range(range_t *ranges, char *lo, char *hi);
+static range_t *insert_range(range_t *ranges, range_t *p);
+static range_t *delete_range(range_t *ranges, char *lo);
+static range_t *balance_range(range_t *p);
+static range_t *rotate_range(range_t *p, int left);
+static int range_height(range_t *p);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -122,11 +287,65 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   int stop, int *grown);
+static void eval_mm_frag(trace_t *trace, int tracenum, range_t **ranges, 
+			 int grown, frag_t *frag);
 static void eval_mm_speed(void *ptr);
+static void timeline_sample(timeline_t *timeline, int tracenum, int opnum, 
+			    size_t live);
+static void timeline_write(timeline_t *timeline);
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats,
+			  range_t **ranges);
+static void eval_mm_parallel(char **tracefiles, int num_tracefiles, 
+			     int jobs, stats_t *stats);
+
+/* The same, for traces streamed from their file (-s) */
+static int eval_mm_stream_valid(speed_t *params, int tracenum, 
+				range_t **ranges, double *util);
+static void eval_mm_stream_speed(void *ptr);
+static void eval_mm_stream_trace(char *tracefile, int tracenum, 
+				 stats_t *stats, range_t **ranges);
+static void pin_cpu(int slot);
+static void eval_threads(char **tracefiles, int num_tracefiles);
+static void run_shards(shard_t *shards, int n, double *secs, double *fair);
+static void *replay_shard(void *ptr);
+static void cleanup_shard(shard_t *shard);
+static void eval_concurrent(char **tracefiles, int num_tracefiles, 
+			    stats_t *stats);
+static int split_threads(trace_t *trace, int tracenum, replay_t *replay);
+static double run_replay(replay_t *replay, int *waits);
+static void *replay_thread(void *ptr);
+static void eval_scaling(char **tracefiles, int num_tracefiles, 
+			 stats_t *stats);
+
+/* Routines for comparing allocators loaded from shared objects (-A) */
+static void load_alloc(char *path);
+static void eval_allocs(char **tracefiles, int num_tracefiles);
+static double eval_alloc_util(alloc_t *alloc, trace_t *trace, int tracenum);
+static void eval_alloc_speed(void *ptr);
+static void printallocs(int n, stats_t *mm_stats);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static lat_hist_t *new_latency(void);
+static void summarize_latency(lat_hist_t *lat, stats_t *stats);
+static void printperf(int n, stats_t *stats);
+static void printfrag(int n, stats_t *stats);
+static void eval_mm_perf(fsecs_test_funct f, speed_t *params, stats_t *stats);
+static void perf_add(perf_sum_t *perf, perf_raw_t *before);
+static void write_results(char *path, char **tracefiles, int n, 
+			  stats_t *stats, double perfindex);
+static void write_json(FILE *fp, char **tracefiles, int n, stats_t *stats,
+		       double perfindex);
+static void write_csv(FILE *fp, char **tracefiles, int n, stats_t *stats);
+static void json_number(FILE *fp, char *name, double value, int last);
+static int compare_baseline(char *path, char **tracefiles, int n, 
+			    stats_t *stats);
+static double retime_trace(char *tracefile, double *spread);
+static int csv_split(char *line, char **fields, int max);
+static int json_split(char *line, char **fields);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -146,10 +365,12 @@ int main(int argc, char **argv)
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
+    timeline_t timeline;       /* the header of the timeline file (-F) */
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int jobs = 1;        /* Number of traces evaluated at once (set by -j) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +379,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:j:T:o:b:F:N:A:X:sCLPWhvVgal")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,6 +405,63 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+	case 'j': /* Evaluate up to this many traces in parallel */
+	    if ((jobs = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'T': /* Replay each trace on up to this many threads */
+	    if ((maxthreads = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'X': /* Scale the traces up to this many copies */
+	    if ((maxscale = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'C': /* Replay threaded traces with their threads */
+	    concurrent = 1;
+	    break;
+	case 's': /* Stream the traces instead of reading them in */
+	    streaming = 1;
+	    break;
+	case 'L': /* Measure the latency of each request */
+	    latency = 1;
+	    break;
+	case 'P': /* Count hardware events */
+	    perfctrs = 1;
+	    break;
+	case 'A': /* Compare mm with an allocator in a shared object */
+	    load_alloc(optarg);
+	    break;
+	case 'W': /* Break the heap down by use */
+	    breakdown = 1;
+	    break;
+	case 'o': /* Write the results to a JSON or CSV file */
+	    outfile = optarg;
+	    break;
+	case 'b': /* Compare the results with a file saved with -o */
+	    baseline = optarg;
+	    break;
+	case 'F': /* Write the fragmentation timeline to a CSV file */
+	    if ((timeline_fd = open(optarg, O_WRONLY | O_CREAT | O_TRUNC | 
+				    O_APPEND, 0644)) < 0)
+		unix_error("ERROR: cannot create the timeline file");
+	    timeline.text = "trace,ops,live_bytes,heap_bytes,free_blocks,"
+		"largest_free\n";
+	    if (write(timeline_fd, timeline.text, strlen(timeline.text)) < 0)
+		unix_error("ERROR: cannot write the timeline file");
+	    break;
+	case 'N': /* Requests between two samples of the timeline */
+	    if ((timeline_every = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -237,6 +515,18 @@ int main(int argc, char **argv)
 
     /* Initialize the timing package */
     init_fsecs();
+    if (latency)
+	lat_init();
+    if (perfctrs) {
+	if (perf_open() == 0) {
+	    printf("Warning: no performance counters (%s), -P ignored\n",
+		   perf_error());
+	    perfctrs = 0;
+	}
+	else if (perf_error()[0] != '\0')
+	    printf("Warning: some performance counters are missing (%s)\n",
+		   perf_error());
+    }
 
     /*
      * Optionally run and evaluate the libc malloc package 
@@ -261,7 +551,8 @@ int main(int argc, char **argv)
 		speed_params.trace = trace;
 		if (verbose > 1)
 		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+		libc_stats[i].secs = fsecs_stats(eval_libc_speed, &speed_params,
+						 &libc_stats[i].timing);
 	    }
 	    free_trace(trace);
 	}
@@ -284,27 +575,14 @@ int main(int argc, char **argv)
     if (mm_stats == NULL)
 	unix_error("mm_stats calloc in main failed");
     
-    /* Initialize the simulated memory system in memlib.c */
-    mem_init(); 
-
     /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
+    if (jobs > 1) 
+	eval_mm_parallel(tracefiles, num_tracefiles, jobs, mm_stats);
+    else {
+	/* Initialize the simulated memory system in memlib.c */
+	mem_init(); 
+	for (i=0; i < num_tracefiles; i++)
+	    eval_mm_trace(tracefiles[i], i, &mm_stats[i], &ranges);
     }
 
     /* Display the mm results in a compact table */
@@ -313,6 +591,42 @@ int main(int argc, char **argv)
 	printresults(num_tracefiles, mm_stats);
 	printf("\n");
     }
+    if (latency && errors == 0) {
+	printf("Latency of mm requests (ns, last timed run):\n");
+	printlatency(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (perfctrs && errors == 0) {
+	printf("Hardware events per mm request:\n");
+	printperf(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (breakdown && errors == 0) {
+	printf("Where the heap goes when it last grows (%% of the heap):\n");
+	printfrag(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (num_allocs > 0 && errors == 0) {
+	eval_allocs(tracefiles, num_tracefiles);
+	printf("Allocators (util %% and Kops of each trace):\n");
+	printallocs(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (jobs > 1 && (maxthreads > 0 || concurrent || maxscale > 0 ||
+		     baseline != NULL) && errors == 0)
+	mem_init();  /* only the -j children had a heap */
+    if (maxthreads > 0 && errors == 0) {
+	eval_threads(tracefiles, num_tracefiles);
+	printf("\n");
+    }
+    if (concurrent && errors == 0) {
+	eval_concurrent(tracefiles, num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (maxscale > 0 && errors == 0) {
+	eval_scaling(tracefiles, num_tracefiles, mm_stats);
+	printf("\n");
+    }
 
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
@@ -362,28 +676,52 @@ int main(int argc, char **argv)
 	printf("perfidx:%.0f\n", perfindex);
     }
 
-    exit(0);
+    /* Compare with the baseline before -o may overwrite it */
+    i = baseline != NULL && errors == 0 &&
+	compare_baseline(baseline, tracefiles, num_tracefiles, mm_stats) > 0;
+    if (outfile != NULL)
+	write_results(outfile, tracefiles, num_tracefiles, mm_stats, perfindex);
+    exit(i ? 2 : 0);
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range tree, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks. It is an
+ * AVL tree, so checking, adding and removing a block is O(log n) in
+ * the number of live blocks.
  ****************************************************************/
 
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range tree. 
  */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(range_t **ranges, char *lo, size_t size, 
 		     int tracenum, int opnum)
+{
+    char msg[MAXLINE];
+
+    if (add_heap_range(ranges, lo, size, (char *)mem_heap_lo(), 
+		       (char *)mem_heap_hi(), msg) == 0) {
+	malloc_error(tracenum, opnum, msg);
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * add_heap_range - the checks of add_range, for a block of the heap
+ *     heap_lo..heap_hi (mm's, or that of an allocator loaded with -A).
+ *     Returns 0, with the reason in msg, if the block is not correct.
+ */
+static int add_heap_range(range_t **ranges, char *lo, size_t size, 
+			  char *heap_lo, char *heap_hi, char *msg)
 {
     char *hi = lo + size - 1;
     range_t *p;
-    char msg[MAXLINE];
 
     assert(size > 0);
 
@@ -391,40 +729,33 @@ static int add_range(range_t **ranges, char *lo, int size,
     if (!IS_ALIGNED(lo)) {
 	sprintf(msg, "Payload address (%p) not aligned to %d bytes", 
 		lo, ALIGNMENT);
-        malloc_error(tracenum, opnum, msg);
         return 0;
     }
 
     /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    if ((lo < heap_lo) || (lo > heap_hi) || 
+	(hi < heap_lo) || (hi > heap_hi)) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
-		lo, hi, mem_heap_lo(), mem_heap_hi());
-	malloc_error(tracenum, opnum, msg);
+		lo, hi, heap_lo, heap_hi);
         return 0;
     }
 
     /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    if ((p = find_range(*ranges, lo, hi)) != NULL) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)",
+		lo, hi, p->lo, p->hi);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree.
      */
     if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
 	unix_error("malloc error in add_range");
-    p->next = *ranges;
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    *ranges = insert_range(*ranges, p);
     return 1;
 }
 
@@ -433,19 +764,7 @@ static int add_range(range_t **ranges, char *lo, int size,
  */
 static void remove_range(range_t **ranges, char *lo)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-    int size;
-
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
-    }
+    *ranges = delete_range(*ranges, lo);
 }
 
 /*
@@ -453,119 +772,139 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
+    range_t *p = *ranges;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    if (p == NULL)
+	return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    free(p);
     *ranges = NULL;
 }
 
+/*
+ * find_range - return a range of the tree that overlaps lo:hi, or
+ *     NULL if there is none
+ */
+static range_t *find_range(range_t *ranges, char *lo, char *hi)
+{
+    range_t *p = ranges;
 
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
+    while (p != NULL) {
+	if (hi < p->lo)
+	    p = p->left;
+	else if (lo > p->hi)
+	    p = p->right;
+	else
+	    return p;
+    }
+    return NULL;
+}
 
 /*
- * read_trace - read a trace file and store it in memory
+ * insert_range - add range p, which overlaps no other range, to the
+ *     tree and return the new root
  */
-static trace_t *read_trace(char *tracedir, char *filename)
+static range_t *insert_range(range_t *ranges, range_t *p)
 {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
-
-    if (verbose > 1)
-	printf("Reading tracefile: %s\n", filename);
+    if (ranges == NULL) {
+	p->left = p->right = NULL;
+	p->height = 1;
+	return p;
+    }
+    if (p->lo < ranges->lo)
+	ranges->left = insert_range(ranges->left, p);
+    else
+	ranges->right = insert_range(ranges->right, p);
+    return balance_range(ranges);
+}
 
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
-    }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
+/*
+ * delete_range - free the range starting at lo (if any) and return the
+ *     new root of the tree
+ */
+static range_t *delete_range(range_t *ranges, char *lo)
+{
+    range_t *p, *succ;
+
+    if (ranges == NULL)
+	return NULL;
+    if (lo < ranges->lo)
+	ranges->left = delete_range(ranges->left, lo);
+    else if (lo > ranges->lo)
+	ranges->right = delete_range(ranges->right, lo);
+    else {
+	p = ranges;
+	if (p->left == NULL || p->right == NULL) {
+	    ranges = (p->left != NULL) ? p->left : p->right;
+	    free(p);
+	    return ranges;
 	}
-	op_index++;
-	
+
+	/* Replace p by its successor, the leftmost range on its right */
+	for (succ = p->right; succ->left != NULL; succ = succ->left)
+	    ;
+	p->lo = succ->lo;
+	p->hi = succ->hi;
+	p->right = delete_range(p->right, succ->lo);
     }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
+    return balance_range(ranges);
+}
+
+/*
+ * balance_range - restore the AVL property at p, whose subtrees differ
+ *     in height by at most two, and return the root of the subtree
+ */
+static range_t *balance_range(range_t *p)
+{
+    int diff = range_height(p->left) - range_height(p->right);
+
+    if (diff > 1) {
+	if (range_height(p->left->left) < range_height(p->left->right))
+	    p->left = rotate_range(p->left, 1);
+	return rotate_range(p, 0);
+    }
+    if (diff < -1) {
+	if (range_height(p->right->right) < range_height(p->right->left))
+	    p->right = rotate_range(p->right, 0);
+	return rotate_range(p, 1);
+    }
+    p->height = 1 + ((range_height(p->left) > range_height(p->right)) ?
+		     range_height(p->left) : range_height(p->right));
+    return p;
+}
+
+/*
+ * rotate_range - rotate the subtree rooted at p to the left (its right
+ *     child becomes the root) or to the right, and return the new root
+ */
+static range_t *rotate_range(range_t *p, int left)
+{
+    range_t *q;
+
+    if (left) {
+	q = p->right;
+	p->right = q->left;
+	q->left = p;
+    }
+    else {
+	q = p->left;
+	p->left = q->right;
+	q->right = p;
+    }
+    balance_range(p);
+    return balance_range(q);
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * range_height - height of the subtree rooted at p (0 if empty)
  */
-void free_trace(trace_t *trace)
+static int range_height(range_t *p)
 {
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
+    return (p == NULL) ? 0 : p->height;
 }
 
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -578,13 +917,15 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 {
     int i, j;
     int index;
-    int size;
-    int oldsize;
+    size_t size;
+    size_t oldsize;
+    size_t k;
+    int arena;
     char *newp;
     char *oldp;
     char *p;
     
-    /* Reset the heap and free any records in the range list */
+    /* Reset the heap and free any records in the range tree */
     mem_reset_brk();
     clear_ranges(ranges);
 
@@ -596,8 +937,11 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
     /* Interpret each operation in the trace in order */
     for (i = 0;  i < trace->num_ops;  i++) {
+	if (trace->ops[i].type == WAIT)
+	    continue;  /* only orders the threads of a concurrent replay */
 	index = trace->ops[i].index;
 	size = trace->ops[i].size;
+	arena = trace->ops[i].arena;
 
         switch (trace->ops[i].type) {
 
@@ -611,7 +955,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
-	     * to the range list if OK. The block must be  be aligned properly,
+	     * to the range tree if OK. The block must be  be aligned properly,
 	     * and must not overlap any currently allocated block. 
 	     */ 
 	    if (add_range(ranges, p, size, tracenum, i) == 0)
@@ -638,10 +982,10 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 		return 0;
 	    }
 	    
-	    /* Remove the old region from the range list */
+	    /* Remove the old region from the range tree */
 	    remove_range(ranges, oldp);
 	    
-	    /* Check new block for correctness and add it to range list */
+	    /* Check new block for correctness and add it to range tree */
 	    if (add_range(ranges, newp, size, tracenum, i) == 0)
 		return 0;
 	    
@@ -652,8 +996,8 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     */
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
-	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	    for (k = 0; k < oldsize; k++) {
+	      if (newp[k] != (char)(index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -674,6 +1018,47 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    mm_free(p);
 	    break;
 
+	case ARENA_CREATE: /* mm_arena_create */
+	    if ((trace->arenas[arena] = mm_arena_create()) == NULL) {
+		malloc_error(tracenum, i, "mm_arena_create failed.");
+		return 0;
+	    }
+	    trace->arena_heads[arena] = -1;
+	    break;
+
+	case ARENA_ALLOC: /* mm_arena_alloc */
+	    if ((p = mm_arena_alloc(trace->arenas[arena], size)) == NULL) {
+		malloc_error(tracenum, i, "mm_arena_alloc failed.");
+		return 0;
+	    }
+
+	    /* Same checks as for mm_malloc */
+	    if (add_range(ranges, p, size, tracenum, i) == 0)
+		return 0;
+	    memset(p, index & 0xFF, size);
+
+	    /* Remember region, and that it belongs to this arena */
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    trace->arena_links[index] = trace->arena_heads[arena];
+	    trace->arena_heads[arena] = index;
+	    break;
+
+	case ARENA_RESET: /* mm_arena_reset */
+	case ARENA_DESTROY: /* mm_arena_destroy */
+
+	    /* Every block allocated from the arena goes away with it */
+	    for (j = trace->arena_heads[arena]; j >= 0; 
+		 j = trace->arena_links[j])
+		remove_range(ranges, trace->blocks[j]);
+	    trace->arena_heads[arena] = -1;
+
+	    if (trace->ops[i].type == ARENA_RESET)
+		mm_arena_reset(trace->arenas[arena]);
+	    else
+		mm_arena_destroy(trace->arenas[arena]);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
@@ -693,24 +1078,39 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   package on the trace. Note that our implementation of mem_sbrk() 
  *   doesn't allow the students to decrement the brk pointer, so brk
  *   is always the high water mark of the heap. 
- *   
+ *
+ *   Only the first stop requests are replayed (the heap of -W). If grown
+ *   is not NULL, it is set to the last request that grew the heap. The
+ *   blocks that are still live are left in trace->blocks (the others are 
+ *   NULL), and in the chains of their arenas.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   int stop, int *grown)
 {   
-    int i;
+    int i, j;
     int index;
-    int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
+    size_t size, newsize, oldsize;
+    int arena;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
     char *p;
     char *newp, *oldp;
+    size_t heapsize;
+    timeline_t timeline = {NULL, 0, 0};
+    int sample = timeline_fd >= 0 && stop == trace->num_ops;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
     if (mm_init() < 0)
 	app_error("mm_init failed in eval_mm_util");
-
-    for (i = 0;  i < trace->num_ops;  i++) {
+    memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+    for (i = 0; i < trace->num_arenas; i++)
+	trace->arena_heads[i] = -1;
+    heapsize = mem_heapsize();
+    if (sample)
+	timeline_sample(&timeline, tracenum, 0, 0);
+
+    for (i = 0;  i < stop;  i++) {
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
@@ -761,6 +1161,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    p = trace->blocks[index];
 	    
 	    mm_free(p);
+	    trace->blocks[index] = NULL;
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -768,33 +1169,200 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+	case ARENA_CREATE: /* mm_arena_create */
+	    arena = trace->ops[i].arena;
+	    if ((trace->arenas[arena] = mm_arena_create()) == NULL)
+		app_error("mm_arena_create failed in eval_mm_util");
+	    trace->arena_heads[arena] = -1;
+	    break;
+
+	case ARENA_ALLOC: /* mm_arena_alloc */
+	    arena = trace->ops[i].arena;
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+
+	    if ((p = mm_arena_alloc(trace->arenas[arena], size)) == NULL)
+		app_error("mm_arena_alloc failed in eval_mm_util");
+
+	    /* Remember region and size, and chain it to its arena */
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    trace->arena_links[index] = trace->arena_heads[arena];
+	    trace->arena_heads[arena] = index;
+
+	    /* Keep track of current total size
+	     * of all allocated blocks */
+	    total_size += size;
+
+	    /* Update statistics */
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+	case ARENA_RESET: /* mm_arena_reset */
+	case ARENA_DESTROY: /* mm_arena_destroy */
+	    arena = trace->ops[i].arena;
+
+	    /* All the arena's blocks are released at once */
+	    for (j = trace->arena_heads[arena]; j >= 0; 
+		 j = trace->arena_links[j]) {
+		total_size -= trace->block_sizes[j];
+		trace->blocks[j] = NULL;
+	    }
+	    trace->arena_heads[arena] = -1;
+
+	    if (trace->ops[i].type == ARENA_RESET)
+		mm_arena_reset(trace->arenas[arena]);
+	    else
+		mm_arena_destroy(trace->arenas[arena]);
+	    break;
+
+	case WAIT: /* only orders the threads of a concurrent replay */
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+	if (mem_heapsize() > heapsize) {
+	    heapsize = mem_heapsize();
+	    if (grown != NULL)
+		*grown = i;
+	}
+	if (sample && ((i + 1) % timeline_every == 0 || i + 1 == stop))
+	    timeline_sample(&timeline, tracenum, i + 1, total_size);
     }
+    if (sample)
+	timeline_write(&timeline);
 
     return ((double)max_total_size / (double)mem_heapsize());
 }
 
 
+/*
+ * eval_mm_frag - replay a trace up to the request that last grew the
+ *     heap (request grown), and break the heap down by use (-W). The
+ *     heap then has its final size, with the live blocks that made it
+ *     grow, so the breakdown shows what keeps the utilization down.
+ *     Free blocks smaller than the average live block count as too
+ *     small.
+ */
+static void eval_mm_frag(trace_t *trace, int tracenum, range_t **ranges, 
+			 int grown, frag_t *frag)
+{
+    mm_frag_report_t report;
+    double payload = 0, rounded = 0, usable = 0, arena_payload = 0;
+    int i, j, live = 0;
+    char *in_arena;
+
+    eval_mm_util(trace, tracenum, ranges, grown + 1, NULL);
+
+    /* The arena objects: their payload, inside the arena chunks */
+    if ((in_arena = (char *)calloc(trace->num_ids + 1, 1)) == NULL)
+	unix_error("calloc failed in eval_mm_frag");
+    for (i = 0; i < trace->num_arenas; i++)
+	for (j = trace->arena_heads[i]; j >= 0; j = trace->arena_links[j]) {
+	    in_arena[j] = 1;
+	    arena_payload += trace->block_sizes[j];
+	    live++;
+	}
+
+    /* The blocks from mm_malloc and mm_realloc */
+    for (i = 0; i < trace->num_ids; i++)
+	if (trace->blocks[i] != NULL && !in_arena[i]) {
+	    payload += trace->block_sizes[i];
+	    rounded += mm_round_size(trace->block_sizes[i]);
+	    usable += mm_usable_size(trace->blocks[i]);
+	    live++;
+	}
+    free(in_arena);
+
+    mm_fragmentation_report(live > 0 ? 
+			    (size_t)((payload + arena_payload) / live) : 0, 
+			    &report);
+    frag->heap = report.heapBytes;
+    frag->payload = payload + arena_payload;
+    frag->align = rounded - payload;
+    frag->slack = usable - rounded;
+    frag->arena = report.allocatedBytes - usable - arena_payload;
+    frag->tags = report.tagBytes;
+    frag->state = report.stateBytes;
+    frag->free = report.freeBytes - report.smallFreeBytes;
+    frag->small_free = report.smallFreeBytes;
+}
+
+/*
+ * timeline_sample - add a row to the fragmentation timeline of a trace:
+ *     the requests done so far, the payload bytes live, the heap size,
+ *     and the number of blocks in mm's free list and the largest one
+ */
+static void timeline_sample(timeline_t *timeline, int tracenum, int opnum, 
+			    size_t live)
+{
+    size_t free_blocks, largest;
+    char row[128];
+    int n;
+
+    mm_free_stats(&free_blocks, &largest);
+    n = snprintf(row, sizeof(row), "%d,%d,%lu,%lu,%lu,%lu\n", tracenum, 
+		 opnum, (unsigned long)live, (unsigned long)mem_heapsize(), 
+		 (unsigned long)free_blocks, (unsigned long)largest);
+    if (timeline->len + n > timeline->cap) {
+	timeline->cap = timeline->cap ? 2 * timeline->cap : 4096;
+	if ((timeline->text = realloc(timeline->text, timeline->cap)) == NULL)
+	    unix_error("realloc failed in timeline_sample");
+    }
+    memcpy(timeline->text + timeline->len, row, n);
+    timeline->len += n;
+}
+
+/*
+ * timeline_write - append the rows of a trace to the timeline file. It
+ *     is one write to a file opened for appending, so the rows of traces
+ *     evaluated at once by -j processes do not mix.
+ */
+static void timeline_write(timeline_t *timeline)
+{
+    if (timeline->len > 0 && 
+	write(timeline_fd, timeline->text, timeline->len) != 
+	(ssize_t)timeline->len)
+	unix_error("ERROR: cannot write the timeline file");
+    free(timeline->text);
+    timeline->text = NULL;
+    timeline->len = timeline->cap = 0;
+}
+
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
  *    to measure the running time of the mm malloc package.
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, index, arena;
+    size_t size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
+    lat_hist_t *lat = ((speed_t *)ptr)->lat;
+    perf_sum_t *perf = ((speed_t *)ptr)->perf;
+    perf_raw_t before;
+    uint64_t start = 0;
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
     if (mm_init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
+    if (lat != NULL)
+	for (i = 0; i <= ARENA_DESTROY; i++)
+	    lat_clear(&lat[i]);
 
     /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
+    for (i = 0;  i < trace->num_ops;  i++) {
+	if (trace->ops[i].type == WAIT)
+	    continue;
+	if (lat != NULL)
+	    start = lat_now();
+	if (perf != NULL)
+	    perf_read_raw(&before);
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
@@ -820,34 +1388,1223 @@ static void eval_mm_speed(void *ptr)
             mm_free(block);
             break;
 
+	case ARENA_CREATE: /* mm_arena_create */
+	    arena = trace->ops[i].arena;
+	    if ((trace->arenas[arena] = mm_arena_create()) == NULL)
+		app_error("mm_arena_create error in eval_mm_speed");
+	    break;
+
+	case ARENA_ALLOC: /* mm_arena_alloc */
+	    arena = trace->ops[i].arena;
+	    size = trace->ops[i].size;
+	    if (mm_arena_alloc(trace->arenas[arena], size) == NULL)
+		app_error("mm_arena_alloc error in eval_mm_speed");
+	    break;
+
+	case ARENA_RESET: /* mm_arena_reset */
+	    mm_arena_reset(trace->arenas[trace->ops[i].arena]);
+	    break;
+
+	case ARENA_DESTROY: /* mm_arena_destroy */
+	    mm_arena_destroy(trace->arenas[trace->ops[i].arena]);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
+	if (perf != NULL)
+	    perf_add(&perf[trace->ops[i].type], &before);
+	if (lat != NULL)
+	    lat_record(&lat[trace->ops[i].type], lat_now() - start);
+    }
 }
 
 /*
- * eval_libc_valid - We run this function to make sure that the
- *    libc malloc can run to completion on the set of traces.
- *    We'll be conservative and terminate if any libc malloc call fails.
- *
+ * eval_mm_trace - read one tracefile and evaluate the mm malloc 
+ *     package on it: correctness, then utilization and speed
  */
-static int eval_libc_valid(trace_t *trace, int tracenum)
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats,
+			  range_t **ranges)
 {
-    int i, newsize;
-    char *p, *newp, *oldp;
-
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+    trace_t *trace;
+    speed_t speed_params;
+    int grown = 0;
 
-        case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
-		malloc_error(tracenum, i, "libc malloc failed");
-		unix_error("System message");
-	    }
-	    trace->blocks[trace->ops[i].index] = p;
-	    break;
+    if (streaming) {
+	eval_mm_stream_trace(tracefile, tracenum, stats, ranges);
+	return;
+    }
+    trace = read_trace(tracedir, tracefile);
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, tracenum, ranges);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+	stats->util = eval_mm_util(trace, tracenum, ranges, trace->num_ops, 
+				   &grown);
+	if (breakdown)
+	    eval_mm_frag(trace, tracenum, ranges, grown, &stats->frag);
+	speed_params.trace = trace;
+	speed_params.ranges = *ranges;
+	speed_params.lat = latency ? new_latency() : NULL;
+	speed_params.perf = NULL;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	stats->secs = fsecs_stats(eval_mm_speed, &speed_params, &stats->timing);
+	summarize_latency(speed_params.lat, stats);
+	if (perfctrs)
+	    eval_mm_perf(eval_mm_speed, &speed_params, stats);
+    }
+    free_trace(trace);
+}
 
-	case REALLOC: /* realloc */
+/*
+ * eval_mm_stream_trace - the same as eval_mm_trace for a trace that is
+ *     streamed from its file (-s). Only two chunks of requests and the
+ *     blocks that are live at the same time are held in memory, so the
+ *     trace can be much larger than the memory of the driver.
+ */
+static void eval_mm_stream_trace(char *tracefile, int tracenum, 
+				 stats_t *stats, range_t **ranges)
+{
+    speed_t params;
+
+    params.trace = NULL;
+    params.ranges = NULL;
+    params.stream = open_trace_stream(tracedir, tracefile);
+    params.live = livemap_create();
+    params.arenas = (mm_arena_t **)calloc(UINT16_MAX + 1, 
+					  sizeof(mm_arena_t *));
+    params.arena_heads = (int *)malloc((UINT16_MAX + 1) * sizeof(int));
+    if (params.arenas == NULL || params.arena_heads == NULL)
+	unix_error("malloc failed in eval_mm_stream_trace");
+    memset(params.arena_heads, 0xff, (UINT16_MAX + 1) * sizeof(int));
+
+    stats->ops = params.stream->num_ops;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness and efficiency, ");
+    stats->valid = eval_mm_stream_valid(&params, tracenum, ranges, 
+					&stats->util);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("and performance.\n");
+	params.lat = latency ? new_latency() : NULL;
+	params.perf = NULL;
+	stats->secs = fsecs_stats(eval_mm_stream_speed, &params, 
+				  &stats->timing);
+	summarize_latency(params.lat, stats);
+	if (perfctrs)
+	    eval_mm_perf(eval_mm_stream_speed, &params, stats);
+    }
+
+    close_trace_stream(params.stream);
+    livemap_destroy(params.live);
+    free(params.arenas);
+    free(params.arena_heads);
+}
+
+/*
+ * eval_mm_stream_valid - eval_mm_valid for a streamed trace. The 
+ *     utilization is computed in the same pass (it does not depend on 
+ *     the payload checks), so the trace is read once less.
+ */
+static int eval_mm_stream_valid(speed_t *params, int tracenum, 
+				range_t **ranges, double *util)
+{
+    trace_stream_t *stream = params->stream;
+    livemap_t *live = params->live;
+    traceop_t *ops;
+    live_t *block;
+    int i, n, opnum, index, arena;
+    int j, link;
+    size_t size, oldsize, k;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
+    char *p, *newp, *oldp;
+    timeline_t timeline = {NULL, 0, 0};
+
+    /* Reset the heap, the range tree and the live blocks */
+    rewind_trace_stream(stream);
+    mem_reset_brk();
+    clear_ranges(ranges);
+    livemap_clear(live);
+    memset(params->arenas, 0, (UINT16_MAX + 1) * sizeof(mm_arena_t *));
+    if (mm_init() < 0) {
+	malloc_error(tracenum, 0, "mm_init failed.");
+	return 0;
+    }
+    if (timeline_fd >= 0)
+	timeline_sample(&timeline, tracenum, 0, 0);
+
+    /* Interpret each operation in the trace in order, a chunk at a time.
+       A streamed trace is not checked when it is read, so an arena must
+       be found live here before it is used (the timing passes trust it) */
+    for (opnum = 0; (n = next_trace_chunk(stream, &ops)) > 0; opnum += n) {
+	for (i = 0; i < n; i++) {
+	    index = ops[i].index;
+	    size = ops[i].size;
+	    arena = ops[i].arena;
+
+	    switch (ops[i].type) {
+
+	    case ALLOC: /* mm_malloc */
+		if ((p = mm_malloc(size)) == NULL) {
+		    malloc_error(tracenum, opnum + i, "mm_malloc failed.");
+		    return 0;
+		}
+		if (add_range(ranges, p, size, tracenum, opnum + i) == 0)
+		    return 0;
+		memset(p, index & 0xFF, size);
+
+		block = livemap_put(live, index);
+		block->ptr = p;
+		block->size = size;
+		total_size += size;
+		break;
+
+	    case REALLOC: /* mm_realloc */
+		if ((block = livemap_get(live, index)) == NULL)
+		    app_error("realloc of a block that is not allocated in "
+			      "eval_mm_stream_valid");
+		oldp = block->ptr;
+		if ((newp = mm_realloc(oldp, size)) == NULL) {
+		    malloc_error(tracenum, opnum + i, "mm_realloc failed.");
+		    return 0;
+		}
+		remove_range(ranges, oldp);
+		if (add_range(ranges, newp, size, tracenum, opnum + i) == 0)
+		    return 0;
+
+		/* The old data must have been copied to the new block */
+		oldsize = (size < block->size) ? size : block->size;
+		for (k = 0; k < oldsize; k++) {
+		    if (newp[k] != (char)(index & 0xFF)) {
+			malloc_error(tracenum, opnum + i, "mm_realloc did not "
+				     "preserve the data from old block");
+			return 0;
+		    }
+		}
+		memset(newp, index & 0xFF, size);
+
+		total_size += size - block->size;
+		block->ptr = newp;
+		block->size = size;
+		break;
+
+	    case FREE: /* mm_free */
+		if ((block = livemap_get(live, index)) == NULL)
+		    app_error("free of a block that is not allocated in "
+			      "eval_mm_stream_valid");
+		p = block->ptr;
+		total_size -= block->size;
+		livemap_remove(live, index);
+		remove_range(ranges, p);
+		mm_free(p);
+		break;
+
+	    case ARENA_CREATE: /* mm_arena_create */
+		if (params->arenas[arena] != NULL) {
+		    malloc_error(tracenum, opnum + i, "arena created again "
+				 "before it is destroyed.");
+		    return 0;
+		}
+		if ((params->arenas[arena] = mm_arena_create()) == NULL) {
+		    malloc_error(tracenum, opnum + i, 
+				 "mm_arena_create failed.");
+		    return 0;
+		}
+		params->arena_heads[arena] = -1;
+		break;
+
+	    case ARENA_ALLOC: /* mm_arena_alloc */
+		if (params->arenas[arena] == NULL) {
+		    malloc_error(tracenum, opnum + i, "arena used before it "
+				 "is created or after it is destroyed.");
+		    return 0;
+		}
+		if ((p = mm_arena_alloc(params->arenas[arena], size)) == NULL) {
+		    malloc_error(tracenum, opnum + i, "mm_arena_alloc failed.");
+		    return 0;
+		}
+		if (add_range(ranges, p, size, tracenum, opnum + i) == 0)
+		    return 0;
+		memset(p, index & 0xFF, size);
+
+		/* Chain the block to its arena through the live map */
+		block = livemap_put(live, index);
+		block->ptr = p;
+		block->size = size;
+		block->link = params->arena_heads[arena];
+		params->arena_heads[arena] = index;
+		total_size += size;
+		break;
+
+	    case ARENA_RESET: /* mm_arena_reset */
+	    case ARENA_DESTROY: /* mm_arena_destroy */
+		if (params->arenas[arena] == NULL) {
+		    malloc_error(tracenum, opnum + i, "arena used before it "
+				 "is created or after it is destroyed.");
+		    return 0;
+		}
+
+		/* Every block allocated from the arena goes away with it */
+		for (j = params->arena_heads[arena]; j >= 0; j = link) {
+		    block = livemap_get(live, j);
+		    link = block->link;
+		    total_size -= block->size;
+		    remove_range(ranges, block->ptr);
+		    livemap_remove(live, j);
+		}
+		params->arena_heads[arena] = -1;
+
+		if (ops[i].type == ARENA_RESET)
+		    mm_arena_reset(params->arenas[arena]);
+		else {
+		    mm_arena_destroy(params->arenas[arena]);
+		    params->arenas[arena] = NULL;
+		}
+		break;
+
+	    case WAIT: /* only orders the threads of a concurrent replay */
+		break;
+
+	    default:
+		app_error("Nonexistent request type in eval_mm_stream_valid");
+	    }
+
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    if (timeline_fd >= 0 && 
+		((opnum + i + 1) % timeline_every == 0 || 
+		 opnum + i + 1 == stream->num_ops))
+		timeline_sample(&timeline, tracenum, opnum + i + 1, 
+				total_size);
+	}
+    }
+    if (timeline_fd >= 0)
+	timeline_write(&timeline);
+
+    *util = (double)max_total_size / (double)mem_heapsize();
+    return 1;
+}
+
+/*
+ * eval_mm_stream_speed - eval_mm_speed for a streamed trace, timed by
+ *     fsecs(). The time includes the live map lookups, but not reading
+ *     the trace, which is done ahead by the stream's reader thread.
+ */
+static void eval_mm_stream_speed(void *ptr)
+{
+    speed_t *params = (speed_t *)ptr;
+    livemap_t *live = params->live;
+    traceop_t *ops;
+    live_t *block;
+    lat_hist_t *lat = params->lat;
+    perf_sum_t *perf = params->perf;
+    perf_raw_t before;
+    uint64_t start = 0;
+    int i, n;
+    char *p;
+
+    /* Reset the heap and initialize the mm package */
+    rewind_trace_stream(params->stream);
+    livemap_clear(live);
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_stream_speed");
+    if (lat != NULL)
+	for (i = 0; i <= ARENA_DESTROY; i++)
+	    lat_clear(&lat[i]);
+
+    while ((n = next_trace_chunk(params->stream, &ops)) > 0)
+	for (i = 0; i < n; i++) {
+	    if (ops[i].type == WAIT)
+		continue;
+	    if (lat != NULL)
+		start = lat_now();
+	    if (perf != NULL)
+		perf_read_raw(&before);
+	    switch (ops[i].type) {
+
+	    case ALLOC: /* mm_malloc */
+		if ((p = mm_malloc(ops[i].size)) == NULL)
+		    app_error("mm_malloc error in eval_mm_stream_speed");
+		livemap_put(live, ops[i].index)->ptr = p;
+		break;
+
+	    case REALLOC: /* mm_realloc */
+		block = livemap_get(live, ops[i].index);
+		if ((p = mm_realloc(block->ptr, ops[i].size)) == NULL)
+		    app_error("mm_realloc error in eval_mm_stream_speed");
+		block->ptr = p;
+		break;
+
+	    case FREE: /* mm_free */
+		mm_free(livemap_get(live, ops[i].index)->ptr);
+		livemap_remove(live, ops[i].index);
+		break;
+
+	    case ARENA_CREATE: /* mm_arena_create */
+		if ((params->arenas[ops[i].arena] = mm_arena_create()) == NULL)
+		    app_error("mm_arena_create error in eval_mm_stream_speed");
+		break;
+
+	    case ARENA_ALLOC: /* mm_arena_alloc */
+		if (mm_arena_alloc(params->arenas[ops[i].arena], 
+				   ops[i].size) == NULL)
+		    app_error("mm_arena_alloc error in eval_mm_stream_speed");
+		break;
+
+	    case ARENA_RESET: /* mm_arena_reset */
+		mm_arena_reset(params->arenas[ops[i].arena]);
+		break;
+
+	    case ARENA_DESTROY: /* mm_arena_destroy */
+		mm_arena_destroy(params->arenas[ops[i].arena]);
+		break;
+
+	    default:
+		app_error("Nonexistent request type in eval_mm_stream_speed");
+	    }
+	    if (perf != NULL)
+		perf_add(&perf[ops[i].type], &before);
+	    if (lat != NULL)
+		lat_record(&lat[ops[i].type], lat_now() - start);
+	}
+}
+
+/*
+ * eval_mm_parallel - evaluate the traces in up to jobs child processes
+ *     at a time (-j). Each child has its own memlib heap, runs on a cpu
+ *     of its own while other children run, and sends its stats_t and 
+ *     error count back through a pipe.
+ */
+static void eval_mm_parallel(char **tracefiles, int num_tracefiles, 
+			     int jobs, stats_t *stats)
+{
+    int i, slot, status;
+    int next = 0;      /* next trace to start */
+    int running = 0;   /* number of children running */
+    int fd[2];
+    int ncpus;
+    cpu_set_t allowed;
+    pid_t pid;
+    pid_t *pids;       /* child evaluating each trace */
+    int *fds;          /* read end of the pipe from that child */
+    int *slots;        /* cpu slot of that child */
+    char *busy;        /* cpu slots in use */
+    range_t *ranges = NULL;
+    result_t result;
+
+    /* The cpus this process may run on (taskset, cpuset cgroup) */
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+	ncpus = CPU_COUNT(&allowed);
+    else
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus < 1)
+	ncpus = 1;
+    if (jobs > ncpus)
+	printf("Warning: -j %d is more than the %d usable cpus, timings "
+	       "will not be comparable\n", jobs, ncpus);
+
+    pids = (pid_t *)calloc(num_tracefiles, sizeof(pid_t));
+    fds = (int *)calloc(num_tracefiles, sizeof(int));
+    slots = (int *)calloc(num_tracefiles, sizeof(int));
+    busy = (char *)calloc(jobs, sizeof(char));
+    if (pids == NULL || fds == NULL || slots == NULL || busy == NULL)
+	unix_error("calloc failed in eval_mm_parallel");
+
+    while (next < num_tracefiles || running > 0) {
+
+	/* Start traces until jobs children are running */
+	while (next < num_tracefiles && running < jobs) {
+	    for (slot = 0; busy[slot]; slot++)
+		;
+	    if (pipe(fd) < 0)
+		unix_error("pipe failed in eval_mm_parallel");
+	    fflush(stdout);
+	    if ((pid = fork()) < 0)
+		unix_error("fork failed in eval_mm_parallel");
+	    if (pid == 0) {
+		close(fd[0]);
+		pin_cpu(slot);
+		if (perfctrs) {
+		    /* The counters of the parent do not count the child */
+		    perf_close();
+		    perf_open();
+		}
+		mem_init();
+		errors = 0;
+		eval_mm_trace(tracefiles[next], next, &result.stats, &ranges);
+		result.errors = errors;
+		fflush(stdout);
+		if (write(fd[1], &result, sizeof(result)) != sizeof(result))
+		    exit(1);
+		exit(0);
+	    }
+	    close(fd[1]);
+	    pids[next] = pid;
+	    fds[next] = fd[0];
+	    slots[next] = slot;
+	    busy[slot] = 1;
+	    next++;
+	    running++;
+	}
+
+	/* Collect the stats of the next child to finish */
+	if ((pid = wait(&status)) < 0)
+	    unix_error("wait failed in eval_mm_parallel");
+	for (i = 0; i < next && pids[i] != pid; i++)
+	    ;
+	if (i == next)
+	    continue;
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+	    read(fds[i], &result, sizeof(result)) == sizeof(result)) {
+	    stats[i] = result.stats;
+	    errors += result.errors;
+	}
+	else {
+	    printf("ERROR [trace %d]: evaluation of %s terminated "
+		   "abnormally\n", i, tracefiles[i]);
+	    stats[i].valid = 0;
+	    errors++;
+	}
+	close(fds[i]);
+	busy[slots[i]] = 0;
+	running--;
+    }
+
+    free(pids);
+    free(fds);
+    free(slots);
+    free(busy);
+}
+
+/*
+ * pin_cpu - run the calling process on the slot-th of the cpus it may
+ *     use only, so that traces timed at the same time do not compete
+ *     for a core. Failing to pin only makes the timings less precise.
+ */
+static void pin_cpu(int slot)
+{
+    cpu_set_t allowed, set;
+    int cpu;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0 ||
+	CPU_COUNT(&allowed) == 0)
+	return;
+    slot %= CPU_COUNT(&allowed);
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	if (CPU_ISSET(cpu, &allowed) && slot-- == 0)
+	    break;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+/*
+ * eval_threads - replay each trace on 1, 2, 4, ... maxthreads threads at
+ *     once, with mm (made thread safe by its heap lock) and with libc, and
+ *     print the aggregate throughput, the speedup over one thread and the
+ *     fairness between the threads.
+ *
+ *     The trace is split into as many shards as there are threads: the
+ *     requests of block id b (or arena a) go to shard b (or a) mod the
+ *     number of threads, so every shard is a valid trace and together
+ *     they hold the same blocks at the same time as the whole trace. The
+ *     work is the same at every thread count, and so is the heap size.
+ *     Each run replays the shards often enough to make THREAD_MIN_OPS
+ *     requests in all, and the fastest of THREAD_RUNS runs counts.
+ *
+ *     Fairness is Jain's index of the throughputs of the threads: 1 if
+ *     they all got as far as each other, 1/n if one thread did all the
+ *     work while the others waited for the lock.
+ */
+static void eval_threads(char **tracefiles, int num_tracefiles)
+{
+    int i, j, k, n, use_libc, shard, reps;
+    double secs[2], fair[2], base[2], ops;
+    trace_t *trace;
+    shard_t *shards;
+    traceop_t *op;
+
+    printf("Threaded replay (traces split into one shard per thread, "
+	   "%d+ requests a run):\n", THREAD_MIN_OPS);
+    printf("%5s%8s%11s%9s%7s%11s%9s%7s\n", "trace", "threads", "mm Kops", 
+	   "speedup", "fair", "libc Kops", "speedup", "fair");
+
+    if ((shards = calloc(maxthreads, sizeof(shard_t))) == NULL)
+	unix_error("calloc failed in eval_threads");
+    for (i = 0; i < num_tracefiles; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	reps = (THREAD_MIN_OPS + trace->num_ops - 1) / trace->num_ops;
+	ops = (double)trace->num_ops * reps;
+
+	for (n = 1; n <= maxthreads; n = (n < maxthreads && 2 * n > maxthreads)
+		 ? maxthreads : 2 * n) {
+	    /* Split the trace */
+	    for (j = 0; j < n; j++) {
+		shards[j].ops = malloc(trace->num_ops * sizeof(traceop_t));
+		shards[j].blocks = calloc(trace->num_ids + 1, sizeof(char *));
+		shards[j].arenas = calloc(trace->num_arenas + 1, 
+					  sizeof(mm_arena_t *));
+		shards[j].arena_heads = calloc(trace->num_arenas + 1, 
+					       sizeof(int));
+		shards[j].arena_links = calloc(trace->num_ids + 1, sizeof(int));
+		if (shards[j].ops == NULL || shards[j].blocks == NULL || 
+		    shards[j].arenas == NULL || shards[j].arena_heads == NULL ||
+		    shards[j].arena_links == NULL)
+		    unix_error("malloc failed in eval_threads");
+		shards[j].num_ops = 0;
+		shards[j].reps = reps;
+	    }
+	    for (k = 0; k < trace->num_ops; k++) {
+		op = &trace->ops[k];
+		if (op->type == WAIT)
+		    continue;
+		shard = (op->type >= ARENA_CREATE ? op->arena : op->index) % n;
+		shards[shard].ops[shards[shard].num_ops++] = *op;
+	    }
+
+	    /* Replay it with mm on one heap, then with libc */
+	    for (use_libc = 0; use_libc < 2; use_libc++) {
+		for (j = 0; j < n; j++)
+		    shards[j].use_libc = use_libc;
+		run_shards(shards, n, &secs[use_libc], &fair[use_libc]);
+		if (n == 1)
+		    base[use_libc] = secs[use_libc];
+	    }
+	    printf("%5d%8d%11.0f%9.2f%7.3f%11.0f%9.2f%7.3f\n", i, n, 
+		   ops / 1e3 / secs[0], base[0] / secs[0], fair[0], 
+		   ops / 1e3 / secs[1], base[1] / secs[1], fair[1]);
+
+	    for (j = 0; j < n; j++) {
+		free(shards[j].ops);
+		free(shards[j].blocks);
+		free(shards[j].arenas);
+		free(shards[j].arena_heads);
+		free(shards[j].arena_links);
+	    }
+	}
+	free_trace(trace);
+    }
+    free(shards);
+}
+
+/*
+ * run_shards - replay n shards at once, one per thread, THREAD_RUNS
+ *     times, and return the time of the fastest run (from the first
+ *     thread starting to the last one finishing: with fewer cpus than
+ *     threads, some only start when others are done) and the fairness
+ *     of that run
+ */
+static void run_shards(shard_t *shards, int n, double *secs, double *fair)
+{
+    pthread_t *threads;
+    pthread_barrier_t start;
+    double begin, end, rate, sum, sumsq;
+    int run, j;
+
+    if ((threads = calloc(n, sizeof(pthread_t))) == NULL)
+	unix_error("calloc failed in run_shards");
+    *secs = DBL_MAX;
+    mm_set_threaded(1);
+    for (run = 0; run < THREAD_RUNS; run++) {
+	if (!shards[0].use_libc) {
+	    mem_reset_brk();
+	    if (mm_init() < 0)
+		app_error("mm_init failed in run_shards");
+	}
+	pthread_barrier_init(&start, NULL, n + 1);
+	for (j = 0; j < n; j++) {
+	    shards[j].start = &start;
+	    if ((errno = pthread_create(&threads[j], NULL, replay_shard, 
+					&shards[j])) != 0)
+		unix_error("pthread_create failed in run_shards");
+	}
+	pthread_barrier_wait(&start);
+	for (j = 0; j < n; j++)
+	    pthread_join(threads[j], NULL);
+	pthread_barrier_destroy(&start);
+
+	begin = DBL_MAX;
+	end = 0;
+	for (j = 0; j < n; j++) {
+	    begin = shards[j].begin < begin ? shards[j].begin : begin;
+	    end = shards[j].end > end ? shards[j].end : end;
+	}
+	if (end - begin < *secs) {
+	    *secs = end - begin;
+	    for (j = 0, sum = sumsq = 0; j < n; j++) {
+		rate = shards[j].num_ops / (shards[j].end - shards[j].begin);
+		sum += rate;
+		sumsq += rate * rate;
+	    }
+	    *fair = sum * sum / (n * sumsq);
+	}
+    }
+    mm_set_threaded(0);
+    free(threads);
+}
+
+/*
+ * replay_shard - the body of a thread of run_shards: wait for the
+ *     others, then replay the shard reps times, freeing what is left of
+ *     it after each replay
+ */
+static void *replay_shard(void *ptr)
+{
+    shard_t *shard = (shard_t *)ptr;
+    traceop_t *op;
+    struct timespec ts;
+    int r, i, j, index, arena;
+    char *p;
+
+    pthread_barrier_wait(shard->start);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    shard->begin = ts.tv_sec + 1e-9 * ts.tv_nsec;
+    for (r = 0; r < shard->reps; r++) {
+	for (i = 0; i < shard->num_ops; i++) {
+	    op = &shard->ops[i];
+	    index = op->index;
+	    arena = op->arena;
+	    switch (op->type) {
+
+	    case ALLOC:
+		p = shard->use_libc ? malloc(op->size) : mm_malloc(op->size);
+		if (p == NULL)
+		    app_error("malloc failed in replay_shard");
+		shard->blocks[index] = p;
+		break;
+
+	    case REALLOC:
+		p = shard->use_libc ? realloc(shard->blocks[index], op->size) :
+		    mm_realloc(shard->blocks[index], op->size);
+		if (p == NULL)
+		    app_error("realloc failed in replay_shard");
+		shard->blocks[index] = p;
+		break;
+
+	    case FREE:
+		if (shard->use_libc)
+		    free(shard->blocks[index]);
+		else
+		    mm_free(shard->blocks[index]);
+		shard->blocks[index] = NULL;
+		break;
+
+	    case ARENA_CREATE: /* libc: emulated with malloc and free */
+		if (shard->use_libc)
+		    shard->arena_heads[arena] = -1;
+		else if ((shard->arenas[arena] = mm_arena_create()) == NULL)
+		    app_error("mm_arena_create failed in replay_shard");
+		break;
+
+	    case ARENA_ALLOC:
+		if (!shard->use_libc) {
+		    if (mm_arena_alloc(shard->arenas[arena], op->size) == NULL)
+			app_error("mm_arena_alloc failed in replay_shard");
+		    break;
+		}
+		if ((p = malloc(op->size)) == NULL)
+		    app_error("malloc failed in replay_shard");
+		shard->blocks[index] = p;
+		shard->arena_links[index] = shard->arena_heads[arena];
+		shard->arena_heads[arena] = index;
+		break;
+
+	    case ARENA_RESET:
+	    case ARENA_DESTROY:
+		if (!shard->use_libc) {
+		    if (op->type == ARENA_RESET)
+			mm_arena_reset(shard->arenas[arena]);
+		    else {
+			mm_arena_destroy(shard->arenas[arena]);
+			shard->arenas[arena] = NULL;
+		    }
+		    break;
+		}
+		for (j = shard->arena_heads[arena]; j >= 0; 
+		     j = shard->arena_links[j]) {
+		    free(shard->blocks[j]);
+		    shard->blocks[j] = NULL;
+		}
+		shard->arena_heads[arena] = -1;
+		break;
+	    }
+	}
+	cleanup_shard(shard);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    shard->end = ts.tv_sec + 1e-9 * ts.tv_nsec;
+    return NULL;
+}
+
+/*
+ * cleanup_shard - free the blocks and arenas a replay of the shard left
+ *     allocated, so that the next replay starts from the same heap
+ */
+static void cleanup_shard(shard_t *shard)
+{
+    traceop_t *op;
+    int i;
+
+    for (i = 0; i < shard->num_ops; i++) {
+	op = &shard->ops[i];
+	if (op->type == ARENA_CREATE && shard->arenas[op->arena] != NULL) {
+	    mm_arena_destroy(shard->arenas[op->arena]);
+	    shard->arenas[op->arena] = NULL;
+	}
+	else if (op->type != ARENA_CREATE && op->type < ARENA_RESET &&
+		 shard->blocks[op->index] != NULL) {
+	    if (shard->use_libc)
+		free(shard->blocks[op->index]);
+	    else
+		mm_free(shard->blocks[op->index]);
+	    shard->blocks[op->index] = NULL;
+	}
+    }
+}
+
+/*
+ * eval_concurrent - replay each trace that passed the checks with one
+ *     thread per thread of the trace, with mm (made thread safe by its
+ *     heap lock) and with libc, and print the throughput. The fastest of
+ *     THREAD_RUNS runs counts.
+ *
+ *     A thread does its requests in the order of the trace, but only
+ *     after the requests of other threads that the trace orders before
+ *     them: the previous request on the same block (a cross-thread free
+ *     or realloc) or the same arena, and the point named by a WAIT. The
+ *     waits column counts the requests that found they had to wait.
+ */
+static void eval_concurrent(char **tracefiles, int num_tracefiles, 
+			    stats_t *stats)
+{
+    int i, j, waits, requests;
+    double secs[2];
+    trace_t *trace;
+    replay_t replay;
+
+    printf("Concurrent replay (one thread per trace thread, "
+	   "cross-thread order kept):\n");
+    printf("%5s%8s%10s%9s%11s%11s\n", "trace", "threads", "requests", 
+	   "waits", "mm Kops", "libc Kops");
+    for (i = 0; i < num_tracefiles; i++) {
+	if (!stats[i].valid)
+	    continue;
+	trace = read_trace(tracedir, tracefiles[i]);
+	if (split_threads(trace, i, &replay) == 0) {
+	    for (replay.use_libc = 0; replay.use_libc < 2; replay.use_libc++)
+		secs[replay.use_libc] = run_replay(&replay, 
+						   replay.use_libc ? NULL : &waits);
+	    for (j = 0, requests = 0; j < trace->num_ops; j++)
+		requests += trace->ops[j].type != WAIT;
+	    printf("%5d%8d%10d%9d%11.0f%11.0f\n", i, replay.num_threads, 
+		   requests, waits, requests / 1e3 / secs[0], 
+		   requests / 1e3 / secs[1]);
+	    for (j = 0; j < replay.num_threads; j++) {
+		free(replay.threads[j].ops);
+		free(replay.threads[j].wait_thread);
+		free(replay.threads[j].wait_count);
+	    }
+	    free(replay.threads);
+	    free(replay.progress);
+	}
+	free_trace(trace);
+    }
+}
+
+/*
+ * eval_scaling - time each trace that passed the checks as 1, 10, 100...
+ *     copies of itself interleaved (see scale_trace), up to maxscale, and
+ *     fit log(time per request) against log(requests). A slope of 0 is a
+ *     constant cost per request; a trace with a slope above
+ *     SCALE_SLOPE_TOL is flagged, since its requests get slower as the
+ *     heap holds more blocks (e.g. a free list scanned from end to end).
+ *     The copies are checked like the trace first. Scales whose heap
+ *     would not fit in MAX_HEAP are left out.
+ */
+static void eval_scaling(char **tracefiles, int num_tracefiles, 
+			 stats_t *stats)
+{
+    int i, k, n, saved;
+    size_t heapsize;
+    double ns, x, y, sx, sy, sxx, sxy, slope;
+    trace_t *trace, *scaled;
+    range_t *ranges = NULL;
+    speed_t params;
+    ftimer_stats_t timing;
+
+    printf("Scaling (copies of each trace interleaved, ns per request):\n");
+    printf("%5s", "trace");
+    for (k = 1; k <= maxscale; k *= 10) {
+	sprintf(msg, "x%d", k);
+	printf("%10s", msg);
+    }
+    printf("%8s\n", "slope");
+    for (i = 0; i < num_tracefiles; i++) {
+	if (!stats[i].valid)
+	    continue;
+	trace = read_trace(tracedir, tracefiles[i]);
+	eval_mm_util(trace, i, &ranges, trace->num_ops, NULL);
+	heapsize = mem_heapsize();
+	printf("%5d", i);
+	n = 0;
+	sx = sy = sxx = sxy = 0;
+	for (k = 1; k <= maxscale; k *= 10) {
+	    if ((double)heapsize * k > MAX_HEAP || 
+		(scaled = scale_trace(trace, k)) == NULL) {
+		printf("%10s", "-");
+		continue;
+	    }
+
+	    /* A failure here is not an error of the run */
+	    saved = errors;
+	    if (!eval_mm_valid(scaled, i, &ranges)) {
+		errors = saved;
+		printf("%10s", "-");
+		free_trace(scaled);
+		continue;
+	    }
+	    params.trace = scaled;
+	    params.ranges = ranges;
+	    params.lat = NULL;
+	    params.perf = NULL;
+	    ns = fsecs_stats(eval_mm_speed, &params, &timing) * 1e9 / 
+		scaled->num_ops;
+	    printf("%10.1f", ns);
+
+	    /* Least squares fit of log(ns) = a + slope * log(requests) */
+	    x = log(scaled->num_ops);
+	    y = log(ns);
+	    sx += x;
+	    sy += y;
+	    sxx += x * x;
+	    sxy += x * y;
+	    n++;
+	    free_trace(scaled);
+	}
+	if (n < 2)
+	    printf("%8s\n", "-");
+	else {
+	    slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+	    printf("%8.2f%s\n", slope, 
+		   slope > SCALE_SLOPE_TOL ? "  grows with the heap" : "");
+	}
+	free_trace(trace);
+    }
+    clear_ranges(&ranges);
+}
+
+/*
+ * split_threads - give each thread of the trace its requests, and find
+ *     what each request must wait for. Returns -1 (after saying why) if
+ *     a WAIT names a point the trace has not reached yet.
+ */
+static int split_threads(trace_t *trace, int tracenum, replay_t *replay)
+{
+    int i, k, t, nthreads = 1;
+    int *count;              /* requests of each thread so far */
+    int *block_thread, *block_count;  /* last request on each block */
+    int *arena_thread, *arena_count;  /* last request on each arena */
+    int *last_thread, *last_count;
+    traceop_t *op;
+    cthread_t *thread;
+
+    for (i = 0; i < trace->num_ops; i++)
+	if (trace->ops[i].thread >= nthreads)
+	    nthreads = trace->ops[i].thread + 1;
+    replay->trace = trace;
+    replay->num_threads = nthreads;
+    replay->threads = (cthread_t *)calloc(nthreads, sizeof(cthread_t));
+    if (posix_memalign((void **)&replay->progress, 64, 
+		       nthreads * sizeof(progress_t)) != 0)
+	replay->progress = NULL;
+    count = (int *)calloc(nthreads, sizeof(int));
+    block_thread = (int *)malloc((trace->num_ids + 1) * sizeof(int));
+    block_count = (int *)malloc((trace->num_ids + 1) * sizeof(int));
+    arena_thread = (int *)malloc((trace->num_arenas + 1) * sizeof(int));
+    arena_count = (int *)malloc((trace->num_arenas + 1) * sizeof(int));
+    if (replay->threads == NULL || replay->progress == NULL || 
+	count == NULL || block_thread == NULL || block_count == NULL || 
+	arena_thread == NULL || arena_count == NULL)
+	unix_error("malloc failed in split_threads");
+    for (i = 0; i <= trace->num_ids; i++)
+	block_thread[i] = -1;
+    for (i = 0; i <= trace->num_arenas; i++)
+	arena_thread[i] = -1;
+
+    /* Count the requests of each thread */
+    for (i = 0; i < trace->num_ops; i++)
+	count[trace->ops[i].thread]++;
+    for (t = 0; t < nthreads; t++) {
+	thread = &replay->threads[t];
+	thread->replay = replay;
+	thread->ops = (int *)malloc((count[t] + 1) * sizeof(int));
+	thread->wait_thread = (int *)malloc((count[t] + 1) * sizeof(int));
+	thread->wait_count = (int *)malloc((count[t] + 1) * sizeof(int));
+	if (thread->ops == NULL || thread->wait_thread == NULL || 
+	    thread->wait_count == NULL)
+	    unix_error("malloc failed in split_threads");
+	count[t] = 0;
+    }
+
+    /* Then hand them out in trace order, which is a valid order */
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	t = op->thread;
+	thread = &replay->threads[t];
+	k = count[t]++;
+	thread->ops[k] = i;
+	thread->wait_count[k] = 0;
+
+	if (op->type == WAIT) {
+	    /* Its own thread has done k requests so far, not count[t] */
+	    if (op->arena >= nthreads || (int)op->index > 
+		(op->arena == t ? k : count[op->arena])) {
+		printf("ERROR [trace %d, line %d]: w %u %u waits for a later "
+		       "request, not replayed concurrently\n", tracenum, 
+		       LINENUM(i), op->arena, op->index);
+		free(count);
+		free(block_thread);
+		free(block_count);
+		free(arena_thread);
+		free(arena_count);
+		for (t = 0; t < nthreads; t++) {
+		    free(replay->threads[t].ops);
+		    free(replay->threads[t].wait_thread);
+		    free(replay->threads[t].wait_count);
+		}
+		free(replay->threads);
+		free(replay->progress);
+		return -1;
+	    }
+	    thread->wait_thread[k] = op->arena;
+	    thread->wait_count[k] = op->index;
+	    continue;
+	}
+
+	/* Wait for the last request on the same block or arena */
+	if (op->type >= ARENA_CREATE) {
+	    last_thread = &arena_thread[op->arena];
+	    last_count = &arena_count[op->arena];
+	}
+	else {
+	    last_thread = &block_thread[op->index];
+	    last_count = &block_count[op->index];
+	}
+	if (*last_thread >= 0 && *last_thread != t) {
+	    thread->wait_thread[k] = *last_thread;
+	    thread->wait_count[k] = *last_count;
+	}
+	*last_thread = t;
+	*last_count = k + 1;
+    }
+    for (t = 0; t < nthreads; t++)
+	replay->threads[t].num_ops = count[t];
+
+    free(count);
+    free(block_thread);
+    free(block_count);
+    free(arena_thread);
+    free(arena_count);
+    return 0;
+}
+
+/*
+ * run_replay - replay the trace THREAD_RUNS times with its threads and
+ *     return the time of the fastest run, from the first thread starting
+ *     to the last one finishing (and its waits, if waits is not NULL)
+ */
+static double run_replay(replay_t *replay, int *waits)
+{
+    trace_t *trace = replay->trace;
+    int n = replay->num_threads;
+    pthread_t *threads;
+    double begin, end, best = DBL_MAX;
+    int run, j;
+
+    if ((threads = (pthread_t *)calloc(n, sizeof(pthread_t))) == NULL)
+	unix_error("calloc failed in run_replay");
+    mm_set_threaded(1);
+    for (run = 0; run < THREAD_RUNS; run++) {
+	memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+	if (!replay->use_libc) {
+	    mem_reset_brk();
+	    if (mm_init() < 0)
+		app_error("mm_init failed in run_replay");
+	}
+	pthread_barrier_init(&replay->start, NULL, n);
+	for (j = 0; j < n; j++) {
+	    replay->progress[j].done = 0;
+	    replay->threads[j].waits = 0;
+	}
+	for (j = 0; j < n; j++)
+	    if ((errno = pthread_create(&threads[j], NULL, replay_thread, 
+					&replay->threads[j])) != 0)
+		unix_error("pthread_create failed in run_replay");
+	for (j = 0; j < n; j++)
+	    pthread_join(threads[j], NULL);
+	pthread_barrier_destroy(&replay->start);
+
+	/* Blocks a captured program never freed */
+	if (replay->use_libc)
+	    for (j = 0; j < trace->num_ids; j++)
+		free(trace->blocks[j]);
+
+	begin = DBL_MAX;
+	end = 0;
+	for (j = 0; j < n; j++) {
+	    begin = replay->threads[j].begin < begin ? 
+		replay->threads[j].begin : begin;
+	    end = replay->threads[j].end > end ? replay->threads[j].end : end;
+	}
+	if (end - begin < best) {
+	    best = end - begin;
+	    if (waits != NULL)
+		for (j = 0, *waits = 0; j < n; j++)
+		    *waits += replay->threads[j].waits;
+	}
+    }
+    mm_set_threaded(0);
+    free(threads);
+    return best;
+}
+
+/*
+ * replay_thread - the body of a thread of run_replay: do the requests
+ *     of one trace thread, each once the request it waits for is done
+ */
+static void *replay_thread(void *ptr)
+{
+    cthread_t *thread = (cthread_t *)ptr;
+    replay_t *replay = thread->replay;
+    trace_t *trace = replay->trace;
+    int self = thread - replay->threads;
+    int libc = replay->use_libc;
+    progress_t *other;
+    traceop_t *op;
+    struct timespec ts;
+    int k, j, index, arena;
+    char *p;
+
+    pthread_barrier_wait(&replay->start);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    thread->begin = ts.tv_sec + 1e-9 * ts.tv_nsec;
+    for (k = 0; k < thread->num_ops; k++) {
+	if (thread->wait_count[k] > 0) {
+	    other = &replay->progress[thread->wait_thread[k]];
+	    if (__atomic_load_n(&other->done, __ATOMIC_ACQUIRE) < 
+		thread->wait_count[k]) {
+		thread->waits++;
+		while (__atomic_load_n(&other->done, __ATOMIC_ACQUIRE) < 
+		       thread->wait_count[k])
+		    sched_yield();
+	    }
+	}
+
+	op = &trace->ops[thread->ops[k]];
+	index = op->index;
+	arena = op->arena;
+	switch (op->type) {
+
+	case ALLOC:
+	    p = libc ? malloc(op->size) : mm_malloc(op->size);
+	    if (p == NULL)
+		app_error("malloc failed in replay_thread");
+	    trace->blocks[index] = p;
+	    break;
+
+	case REALLOC:
+	    p = libc ? realloc(trace->blocks[index], op->size) :
+		mm_realloc(trace->blocks[index], op->size);
+	    if (p == NULL)
+		app_error("realloc failed in replay_thread");
+	    trace->blocks[index] = p;
+	    break;
+
+	case FREE:
+	    if (libc)
+		free(trace->blocks[index]);
+	    else
+		mm_free(trace->blocks[index]);
+	    trace->blocks[index] = NULL;
+	    break;
+
+	case ARENA_CREATE: /* libc: emulated with malloc and free */
+	    if (libc)
+		trace->arena_heads[arena] = -1;
+	    else if ((trace->arenas[arena] = mm_arena_create()) == NULL)
+		app_error("mm_arena_create failed in replay_thread");
+	    break;
+
+	case ARENA_ALLOC:
+	    if (!libc) {
+		if (mm_arena_alloc(trace->arenas[arena], op->size) == NULL)
+		    app_error("mm_arena_alloc failed in replay_thread");
+		break;
+	    }
+	    if ((p = malloc(op->size)) == NULL)
+		app_error("malloc failed in replay_thread");
+	    trace->blocks[index] = p;
+	    trace->arena_links[index] = trace->arena_heads[arena];
+	    trace->arena_heads[arena] = index;
+	    break;
+
+	case ARENA_RESET:
+	case ARENA_DESTROY:
+	    if (!libc) {
+		if (op->type == ARENA_RESET)
+		    mm_arena_reset(trace->arenas[arena]);
+		else
+		    mm_arena_destroy(trace->arenas[arena]);
+		break;
+	    }
+	    for (j = trace->arena_heads[arena]; j >= 0; 
+		 j = trace->arena_links[j]) {
+		free(trace->blocks[j]);
+		trace->blocks[j] = NULL;
+	    }
+	    trace->arena_heads[arena] = -1;
+	    break;
+
+	case WAIT: /* done above */
+	    break;
+	}
+	__atomic_store_n(&replay->progress[self].done, k + 1, __ATOMIC_RELEASE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    thread->end = ts.tv_sec + 1e-9 * ts.tv_nsec;
+    return NULL;
+}
+
+/*
+ * eval_libc_valid - We run this function to make sure that the
+ *    libc malloc can run to completion on the set of traces.
+ *    We'll be conservative and terminate if any libc malloc call fails.
+ *
+ */
+static int eval_libc_valid(trace_t *trace, int tracenum)
+{
+    int i, j, arena;
+    size_t newsize;
+    char *p, *newp, *oldp;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* malloc */
+	    if ((p = malloc(trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc malloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+	case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[trace->ops[i].index];
 	    if ((newp = realloc(oldp, newsize)) == NULL) {
@@ -861,6 +2618,34 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    free(trace->blocks[trace->ops[i].index]);
 	    break;
 
+	/* libc has no arenas, so they are emulated with malloc and free */
+	case ARENA_CREATE:
+	    trace->arena_heads[trace->ops[i].arena] = -1;
+	    break;
+
+	case ARENA_ALLOC:
+	    arena = trace->ops[i].arena;
+	    if ((p = malloc(trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc malloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    trace->arena_links[trace->ops[i].index] = trace->arena_heads[arena];
+	    trace->arena_heads[arena] = trace->ops[i].index;
+	    break;
+
+	case ARENA_RESET:
+	case ARENA_DESTROY:
+	    arena = trace->ops[i].arena;
+	    for (j = trace->arena_heads[arena]; j >= 0; 
+		 j = trace->arena_links[j])
+		free(trace->blocks[j]);
+	    trace->arena_heads[arena] = -1;
+	    break;
+
+	case WAIT:
+	    break;
+
 	default:
 	    app_error("invalid operation type  in eval_libc_valid");
 	}
@@ -876,8 +2661,9 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
-    int index, size, newsize;
+    int i, j;
+    int index, arena;
+    size_t size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -906,6 +2692,275 @@ static void eval_libc_speed(void *ptr)
 	    block = trace->blocks[index];
 	    free(block);
 	    break;
+
+	case ARENA_CREATE: /* emulated with malloc and free */
+	    trace->arena_heads[trace->ops[i].arena] = -1;
+	    break;
+
+	case ARENA_ALLOC:
+	    arena = trace->ops[i].arena;
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = malloc(size)) == NULL)
+		unix_error("malloc failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    trace->arena_links[index] = trace->arena_heads[arena];
+	    trace->arena_heads[arena] = index;
+	    break;
+
+	case ARENA_RESET:
+	case ARENA_DESTROY:
+	    arena = trace->ops[i].arena;
+	    for (j = trace->arena_heads[arena]; j >= 0; 
+		 j = trace->arena_links[j])
+		free(trace->blocks[j]);
+	    trace->arena_heads[arena] = -1;
+	    break;
+	}
+    }
+}
+
+/*
+ * load_alloc - load the allocator in the shared object path (-A). It
+ *     must export mm_init, mm_malloc, mm_free and mm_realloc, and the
+ *     mem_init, mem_reset_brk, mem_heapsize, mem_heap_lo and mem_heap_hi
+ *     of its own memlib (see the %.so rule of the Makefile).
+ */
+static void load_alloc(char *path)
+{
+    alloc_t *alloc;
+    char *name = path;
+
+    if ((allocs = realloc(allocs, (num_allocs + 1) * sizeof(alloc_t))) == NULL)
+	unix_error("realloc failed in load_alloc");
+    alloc = &allocs[num_allocs++];
+    memset(alloc, 0, sizeof(*alloc));
+    alloc->path = path;
+
+    /* dlopen searches the library path for names without a slash */
+    if (strchr(path, '/') == NULL) {
+	if ((name = malloc(strlen(path) + 3)) == NULL)
+	    unix_error("malloc failed in load_alloc");
+	sprintf(name, "./%s", path);
+    }
+    if ((alloc->handle = dlopen(name, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+	sprintf(msg, "ERROR: cannot load %s: %s", path, dlerror());
+	app_error(msg);
+    }
+    if (name != path)
+	free(name);
+    if ((alloc->init = dlsym(alloc->handle, "mm_init")) == NULL ||
+	(alloc->malloc = dlsym(alloc->handle, "mm_malloc")) == NULL ||
+	(alloc->free = dlsym(alloc->handle, "mm_free")) == NULL ||
+	(alloc->realloc = dlsym(alloc->handle, "mm_realloc")) == NULL ||
+	(alloc->mem_init = dlsym(alloc->handle, "mem_init")) == NULL ||
+	(alloc->mem_reset_brk = dlsym(alloc->handle, "mem_reset_brk")) == NULL ||
+	(alloc->mem_heapsize = dlsym(alloc->handle, "mem_heapsize")) == NULL ||
+	(alloc->mem_heap_lo = dlsym(alloc->handle, "mem_heap_lo")) == NULL ||
+	(alloc->mem_heap_hi = dlsym(alloc->handle, "mem_heap_hi")) == NULL) {
+	sprintf(msg, "ERROR: %s does not export mm_init, mm_malloc, mm_free, "
+		"mm_realloc and memlib's mem_init, mem_reset_brk, "
+		"mem_heapsize, mem_heap_lo and mem_heap_hi", path);
+	app_error(msg);
+    }
+    alloc->mem_init();
+}
+
+/*
+ * eval_allocs - evaluate each allocator loaded with -A on every trace
+ *     that mm ran correctly: utilization, then throughput timed the 
+ *     same way as mm's
+ */
+static void eval_allocs(char **tracefiles, int num_tracefiles)
+{
+    alloc_speed_t params;
+    trace_t *trace;
+    stats_t *stats;
+    int i, a;
+
+    for (a = 0; a < num_allocs; a++)
+	if ((allocs[a].stats = (stats_t *)calloc(num_tracefiles, 
+						 sizeof(stats_t))) == NULL)
+	    unix_error("calloc failed in eval_allocs");
+    for (i = 0; i < num_tracefiles; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	for (a = 0; a < num_allocs; a++) {
+	    stats = &allocs[a].stats[i];
+	    stats->ops = trace->num_ops;
+	    if ((stats->util = eval_alloc_util(&allocs[a], trace, i)) < 0)
+		continue;
+	    stats->valid = 1;
+	    params.alloc = &allocs[a];
+	    params.trace = trace;
+	    stats->secs = fsecs_stats(eval_alloc_speed, &params, 
+				      &stats->timing);
+	}
+	free_trace(trace);
+    }
+}
+
+/*
+ * eval_alloc_util - the utilization of a loaded allocator on a trace, as
+ *     eval_mm_util computes it. Arenas are emulated with malloc and free,
+ *     as for libc. The blocks get the checks of eval_mm_valid (in the
+ *     allocator's own heap), the payloads are filled, and realloc must
+ *     keep them; returns -1 (after saying why) if the allocator fails
+ *     the trace.
+ */
+static double eval_alloc_util(alloc_t *alloc, trace_t *trace, int tracenum)
+{
+    int i, j, index, arena;
+    size_t size, oldsize, k;
+    size_t total_size = 0, max_total_size = 0;
+    char *p, *error = NULL;
+    char why[MAXLINE];
+    range_t *ranges = NULL;
+
+    alloc->mem_reset_brk();
+    if (alloc->init() < 0) {
+	printf("ERROR [%s, trace %d]: mm_init failed\n", alloc->path, 
+	       tracenum);
+	return -1;
+    }
+    for (i = 0; i < trace->num_ops && error == NULL; i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+	arena = trace->ops[i].arena;
+        switch (trace->ops[i].type) {
+
+        case ALLOC:
+	case ARENA_ALLOC:
+	    if ((p = alloc->malloc(size)) == NULL) {
+		error = "mm_malloc failed";
+		break;
+	    }
+	    if (add_heap_range(&ranges, p, size, alloc->mem_heap_lo(), 
+			       alloc->mem_heap_hi(), why) == 0) {
+		error = why;
+		break;
+	    }
+	    memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    if (trace->ops[i].type == ARENA_ALLOC) {
+		trace->arena_links[index] = trace->arena_heads[arena];
+		trace->arena_heads[arena] = index;
+	    }
+	    break;
+
+	case REALLOC:
+	    oldsize = trace->block_sizes[index];
+	    if ((p = alloc->realloc(trace->blocks[index], size)) == NULL) {
+		error = "mm_realloc failed";
+		break;
+	    }
+	    remove_range(&ranges, trace->blocks[index]);
+	    if (add_heap_range(&ranges, p, size, alloc->mem_heap_lo(), 
+			       alloc->mem_heap_hi(), why) == 0) {
+		error = why;
+		break;
+	    }
+	    for (k = 0; k < oldsize && k < size; k++)
+		if (p[k] != (char)(index & 0xFF))
+		    error = "mm_realloc did not preserve the data from old block";
+	    memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size - oldsize;
+	    break;
+
+        case FREE:
+	    remove_range(&ranges, trace->blocks[index]);
+	    alloc->free(trace->blocks[index]);
+	    total_size -= trace->block_sizes[index];
+	    break;
+
+	case ARENA_CREATE:
+	    trace->arena_heads[arena] = -1;
+	    break;
+
+	case ARENA_RESET:
+	case ARENA_DESTROY:
+	    for (j = trace->arena_heads[arena]; j >= 0; 
+		 j = trace->arena_links[j]) {
+		remove_range(&ranges, trace->blocks[j]);
+		alloc->free(trace->blocks[j]);
+		total_size -= trace->block_sizes[j];
+	    }
+	    trace->arena_heads[arena] = -1;
+	    break;
+
+	case WAIT:
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_alloc_util");
+	}
+	max_total_size = (total_size > max_total_size) ? 
+	    total_size : max_total_size;
+    }
+    clear_ranges(&ranges);
+    if (error != NULL) {
+	printf("ERROR [%s, trace %d, line %d]: %s\n", alloc->path, tracenum,
+	       LINENUM(i - 1), error);
+	return -1;
+    }
+
+    return (double)max_total_size / (double)alloc->mem_heapsize();
+}
+
+/*
+ * eval_alloc_speed - eval_mm_speed for a loaded allocator, timed by fsecs
+ */
+static void eval_alloc_speed(void *ptr)
+{
+    alloc_t *alloc = ((alloc_speed_t *)ptr)->alloc;
+    trace_t *trace = ((alloc_speed_t *)ptr)->trace;
+    int i, j, index, arena;
+    char *p;
+
+    alloc->mem_reset_brk();
+    if (alloc->init() < 0)
+	app_error("mm_init failed in eval_alloc_speed");
+    for (i = 0; i < trace->num_ops; i++) {
+	index = trace->ops[i].index;
+	arena = trace->ops[i].arena;
+        switch (trace->ops[i].type) {
+
+        case ALLOC:
+	case ARENA_ALLOC:
+	    if ((p = alloc->malloc(trace->ops[i].size)) == NULL)
+		app_error("mm_malloc failed in eval_alloc_speed");
+	    trace->blocks[index] = p;
+	    if (trace->ops[i].type == ARENA_ALLOC) {
+		trace->arena_links[index] = trace->arena_heads[arena];
+		trace->arena_heads[arena] = index;
+	    }
+	    break;
+
+	case REALLOC:
+	    if ((p = alloc->realloc(trace->blocks[index], 
+				    trace->ops[i].size)) == NULL)
+		app_error("mm_realloc failed in eval_alloc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case FREE:
+	    alloc->free(trace->blocks[index]);
+	    break;
+
+	case ARENA_CREATE:
+	    trace->arena_heads[arena] = -1;
+	    break;
+
+	case ARENA_RESET:
+	case ARENA_DESTROY:
+	    for (j = trace->arena_heads[arena]; j >= 0; 
+		 j = trace->arena_links[j])
+		alloc->free(trace->blocks[j]);
+	    trace->arena_heads[arena] = -1;
+	    break;
 	}
     }
 }
@@ -926,23 +2981,29 @@ static void printresults(int n, stats_t *stats)
     double util = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-	   "trace", " valid", "util", "ops", "secs", "Kops");
+    printf("%5s%7s %5s%8s%10s%7s%10s%7s\n", 
+	   "trace", " valid", "util", "ops", "secs", "Kops", "median", "+-95%");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%8.0f%10.6f%7.0f", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
 		   stats[i].ops,
 		   stats[i].secs,
 		   (stats[i].ops/1e3)/stats[i].secs);
+	    /* The median sample and the confidence interval of the mean */
+	    if (stats[i].timing.samples > 1)
+		printf("%10.6f%6.1f%%\n", stats[i].timing.median,
+		       100.0 * stats[i].timing.ci / stats[i].timing.median);
+	    else
+		printf("\n");
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
 	}
 	else {
-	    printf("%2d%10s%6s%8s%10s%6s\n", 
+	    printf("%2d%10s%6s%8s%10s%7s\n", 
 		   i,
 		   "no",
 		   "-",
@@ -954,7 +3015,7 @@ static void printresults(int n, stats_t *stats)
 
     /* Print the aggregate results for the set of traces */
     if (errors == 0) {
-	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	printf("%12s%5.0f%%%8.0f%10.6f%7.0f\n", 
 	       "Total       ",
 	       (util/n)*100.0,
 	       ops, 
@@ -962,7 +3023,7 @@ static void printresults(int n, stats_t *stats)
 	       (ops/1e3)/secs);
     }
     else {
-	printf("%12s%6s%8s%10s%6s\n", 
+	printf("%12s%6s%8s%10s%7s\n", 
 	       "Total       ",
 	       "-", 
 	       "-", 
@@ -972,6 +3033,618 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printlatency - prints the latency percentiles of each type of request
+ *     in each trace (-L)
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    int i, type;
+    lat_summary_t *lat;
+
+    printf("%5s  %-14s%9s%9s%9s%9s%11s\n",
+	   "trace", "request", "count", "p50", "p99", "p99.9", "max");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	for (type = 0; type <= ARENA_DESTROY; type++) {
+	    lat = &stats[i].lat[type];
+	    if (lat->count == 0)
+		continue;
+	    printf("%5d  %-14s%9.0f%9.0f%9.0f%9.0f%11.0f\n",
+		   i, request_names[type], lat->count,
+		   lat->p50, lat->p99, lat->p999, lat->max);
+	}
+    }
+}
+
+/*
+ * new_latency - a histogram for each request type, for one trace (-L)
+ */
+static lat_hist_t *new_latency(void)
+{
+    lat_hist_t *lat;
+
+    lat = (lat_hist_t *)calloc(ARENA_DESTROY + 1, sizeof(lat_hist_t));
+    if (lat == NULL)
+	unix_error("calloc failed in new_latency");
+    return lat;
+}
+
+/*
+ * summarize_latency - keep the percentiles of the histograms of a trace
+ *     in its stats (which -j sends back to the parent), and free them
+ */
+static void summarize_latency(lat_hist_t *lat, stats_t *stats)
+{
+    int type;
+
+    if (lat == NULL)
+	return;
+    for (type = 0; type <= ARENA_DESTROY; type++)
+	lat_summarize(&lat[type], &stats->lat[type]);
+    free(lat);
+}
+
+/*
+ * eval_mm_perf - count hardware events in two more runs of a trace (-P):
+ *     one as it is timed, for the events per request, and one that reads
+ *     the counters around every request, to split them by request type.
+ *     The second run also counts the user-space part of those reads.
+ */
+static void eval_mm_perf(fsecs_test_funct f, speed_t *params, stats_t *stats)
+{
+    perf_raw_t from, to, zero;
+    perf_sum_t *sums;
+    int type, i;
+
+    params->lat = NULL;
+    params->perf = NULL;
+    perf_read_raw(&from);
+    perf_start();
+    f(params);
+    perf_stop();
+    perf_read_raw(&to);
+    perf_counts(&from, &to, &stats->perf_all);
+    for (i = 0; i < PERF_NEVENTS; i++)
+	if (stats->perf_all.counts[i] != PERF_MISSING)
+	    stats->perf_all.counts[i] /= stats->ops;
+
+    if ((sums = (perf_sum_t *)calloc(ARENA_DESTROY + 1, 
+				     sizeof(perf_sum_t))) == NULL)
+	unix_error("calloc failed in eval_mm_perf");
+    params->perf = sums;
+    perf_start();
+    f(params);
+    perf_stop();
+    params->perf = NULL;
+
+    memset(&zero, 0, sizeof(zero));
+    for (type = 0; type <= ARENA_DESTROY; type++) {
+	perf_counts(&zero, &sums[type].sum, &stats->perf[type]);
+	for (i = 0; i < PERF_NEVENTS; i++)
+	    if (sums[type].requests == 0)
+		stats->perf[type].counts[i] = PERF_MISSING;
+	    else if (stats->perf[type].counts[i] != PERF_MISSING)
+		stats->perf[type].counts[i] /= sums[type].requests;
+    }
+    free(sums);
+}
+
+/*
+ * perf_add - add the events since before to the counts of a request type
+ */
+static void perf_add(perf_sum_t *perf, perf_raw_t *before)
+{
+    perf_raw_t after;
+    int i;
+
+    perf_read_raw(&after);
+    perf->sum.enabled += after.enabled - before->enabled;
+    perf->sum.running += after.running - before->running;
+    for (i = 0; i < PERF_NEVENTS; i++)
+	perf->sum.values[i] += after.values[i] - before->values[i];
+    perf->requests++;
+}
+
+/*
+ * printperf - prints the hardware events per request of each trace, and
+ *     of each type of request in it (-P). "-" marks events that are not
+ *     counted on this machine.
+ */
+static void printperf(int n, stats_t *stats)
+{
+    int i, type, event;
+    perf_counts_t *counts;
+
+    printf("%5s  %-14s", "trace", "request");
+    for (event = 0; event < PERF_NEVENTS; event++)
+	printf("%10s", perf_name(event));
+    printf("\n");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	for (type = -1; type <= ARENA_DESTROY; type++) {
+	    counts = type < 0 ? &stats[i].perf_all : &stats[i].perf[type];
+
+	    /* Skip the types the trace has no requests of */
+	    for (event = 0; event < PERF_NEVENTS; event++)
+		if (counts->counts[event] != PERF_MISSING)
+		    break;
+	    if (event == PERF_NEVENTS)
+		continue;
+	    printf("%5d  %-14s", i, type < 0 ? "all" : request_names[type]);
+	    for (event = 0; event < PERF_NEVENTS; event++)
+		if (counts->counts[event] == PERF_MISSING)
+		    printf("%10s", "-");
+		else
+		    printf("%10.2f", counts->counts[event]);
+	    printf("\n");
+	}
+    }
+}
+
+/*
+ * printallocs - prints the utilization and throughput of mm and of each
+ *     allocator loaded with -A on each trace, side by side, then their
+ *     averages and performance indexes. "-" marks the traces an
+ *     allocator failed.
+ */
+static void printallocs(int n, stats_t *mm_stats)
+{
+    int i, a, valid;
+    char *name;
+    stats_t *stats;
+    double util, ops, secs, thru, *index;
+
+    printf("%5s", "trace");
+    for (a = -1; a < num_allocs; a++) {
+	name = a < 0 ? "mm" : allocs[a].path;
+	if (strrchr(name, '/') != NULL)
+	    name = strrchr(name, '/') + 1;
+	printf("  %15.15s", name);
+    }
+    printf("\n");
+    for (i = 0; i < n; i++) {
+	printf("%5d", i);
+	for (a = -1; a < num_allocs; a++) {
+	    stats = a < 0 ? &mm_stats[i] : &allocs[a].stats[i];
+	    if (stats->valid)
+		printf("  %4.0f%%%10.0f", 100 * stats->util, 
+		       stats->ops / 1e3 / stats->secs);
+	    else
+		printf("  %15s", "-");
+	}
+	printf("\n");
+    }
+
+    /* The averages, and the performance index as main computes it */
+    if ((index = (double *)calloc(num_allocs + 1, sizeof(double))) == NULL)
+	unix_error("calloc failed in printallocs");
+    printf("%5s", "avg");
+    for (a = -1; a < num_allocs; a++) {
+	util = ops = secs = 0;
+	for (i = 0, valid = 1; i < n; i++) {
+	    stats = a < 0 ? &mm_stats[i] : &allocs[a].stats[i];
+	    valid = valid && stats->valid;
+	    util += stats->util / n;
+	    ops += stats->ops;
+	    secs += stats->secs;
+	}
+	if (!valid) {
+	    index[a + 1] = -1;
+	    printf("  %15s", "-");
+	    continue;
+	}
+	thru = ops / secs;
+	index[a + 1] = 100 * (UTIL_WEIGHT * util + (1.0 - UTIL_WEIGHT) * 
+			      (thru > AVG_LIBC_THRUPUT ? 
+			       1.0 : thru / AVG_LIBC_THRUPUT));
+	printf("  %4.0f%%%10.0f", 100 * util, thru / 1e3);
+    }
+    printf("\n%5s", "index");
+    for (a = -1; a < num_allocs; a++)
+	if (index[a + 1] < 0)
+	    printf("  %15s", "-");
+	else
+	    printf("  %15.0f", index[a + 1]);
+    printf("\n");
+    free(index);
+}
+
+/*
+ * printfrag - prints where the heap of each trace went when it last
+ *     grew (-W), in percent of the heap
+ */
+static void printfrag(int n, stats_t *stats)
+{
+    int i;
+    frag_t *f;
+
+    printf("%5s%11s%9s%7s%7s%7s%7s%7s%7s%7s\n", "trace", "heap KB", 
+	   "payload", "align", "slack", "arena", "tags", "state", "free", 
+	   "small");
+    for (i = 0; i < n; i++) {
+	f = &stats[i].frag;
+	if (!stats[i].valid || f->heap == 0)
+	    continue;
+	printf("%5d%11.0f%8.1f%%%6.1f%%%6.1f%%%6.1f%%%6.1f%%%6.1f%%%6.1f%%"
+	       "%6.1f%%\n", i, f->heap / 1024, 100 * f->payload / f->heap, 
+	       100 * f->align / f->heap, 100 * f->slack / f->heap, 
+	       100 * f->arena / f->heap, 100 * f->tags / f->heap, 
+	       100 * f->state / f->heap, 100 * f->free / f->heap, 
+	       100 * f->small_free / f->heap);
+    }
+}
+
+/*
+ * write_results - write the mm stats of every trace to path: as CSV if
+ *     its name ends in .csv, otherwise as JSON
+ */
+static void write_results(char *path, char **tracefiles, int n, 
+			  stats_t *stats, double perfindex)
+{
+    FILE *fp;
+    size_t len = strlen(path);
+
+    if ((fp = fopen(path, "w")) == NULL)
+	unix_error("Could not create the results file");
+    if (len > 4 && strcmp(path + len - 4, ".csv") == 0)
+	write_csv(fp, tracefiles, n, stats);
+    else
+	write_json(fp, tracefiles, n, stats, perfindex);
+    if (ferror(fp) || fclose(fp) != 0)
+	unix_error("Could not write the results file");
+}
+
+/*
+ * write_json - one object for the run, with the totals and one object
+ *     per trace. Latencies (-L) and hardware events (-P) are included if
+ *     they were measured; events this machine cannot count are null.
+ */
+static void write_json(FILE *fp, char **tracefiles, int n, stats_t *stats,
+		       double perfindex)
+{
+    int i, type, event, first;
+    double secs = 0, ops = 0, util = 0;
+    perf_counts_t *counts;
+    lat_summary_t *lat;
+
+    for (i = 0; i < n; i++)
+	if (stats[i].valid) {
+	    secs += stats[i].secs;
+	    ops += stats[i].ops;
+	    util += stats[i].util;
+	}
+    fprintf(fp, "{\n  \"errors\": %d,\n  \"perfindex\": %.2f,\n", 
+	    errors, perfindex);
+    fprintf(fp, "  \"total\": {");
+    json_number(fp, "util", util / n, 0);
+    json_number(fp, "ops", ops, 0);
+    json_number(fp, "secs", secs, 0);
+    json_number(fp, "kops", secs > 0 ? ops / 1e3 / secs : 0, 1);
+    fprintf(fp, "},\n  \"traces\": [\n");
+    for (i = 0; i < n; i++) {
+	fprintf(fp, "    {\"trace\": %d, \"file\": \"%s\", \"valid\": %s, ", 
+		i, tracefiles[i], stats[i].valid ? "true" : "false");
+	json_number(fp, "util", stats[i].util, 0);
+	json_number(fp, "ops", stats[i].ops, 0);
+	json_number(fp, "secs", stats[i].secs, 0);
+	json_number(fp, "kops", stats[i].secs > 0 ? 
+		    stats[i].ops / 1e3 / stats[i].secs : 0, 0);
+	json_number(fp, "samples", stats[i].timing.samples, 0);
+	json_number(fp, "median", stats[i].timing.median, 0);
+	json_number(fp, "ci95", stats[i].timing.ci, 0);
+	json_number(fp, "spread", stats[i].timing.spread, 1);
+
+	if (latency) {
+	    fprintf(fp, ",\n     \"latency_ns\": {");
+	    for (type = 0, first = 1; type <= ARENA_DESTROY; type++) {
+		lat = &stats[i].lat[type];
+		if (lat->count == 0)
+		    continue;
+		fprintf(fp, "%s\"%s\": {", first ? "" : ", ", 
+			request_names[type]);
+		json_number(fp, "count", lat->count, 0);
+		json_number(fp, "p50", lat->p50, 0);
+		json_number(fp, "p99", lat->p99, 0);
+		json_number(fp, "p99.9", lat->p999, 0);
+		json_number(fp, "max", lat->max, 1);
+		fprintf(fp, "}");
+		first = 0;
+	    }
+	    fprintf(fp, "}");
+	}
+
+	if (perfctrs) {
+	    fprintf(fp, ",\n     \"events_per_request\": {");
+	    for (type = -1, first = 1; type <= ARENA_DESTROY; type++) {
+		counts = type < 0 ? &stats[i].perf_all : &stats[i].perf[type];
+		if (type >= 0 && stats[i].lat[type].count == 0 && 
+		    counts->counts[PERF_PAGE_FAULTS] == PERF_MISSING)
+		    continue;
+		fprintf(fp, "%s\"%s\": {", first ? "" : ", ", 
+			type < 0 ? "all" : request_names[type]);
+		for (event = 0; event < PERF_NEVENTS; event++)
+		    json_number(fp, perf_name(event), counts->counts[event],
+				event == PERF_NEVENTS - 1);
+		fprintf(fp, "}");
+		first = 0;
+	    }
+	    fprintf(fp, "}");
+	}
+	fprintf(fp, "}%s\n", i < n - 1 ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+/*
+ * json_number - write "name": value, with null for a missing count
+ */
+static void json_number(FILE *fp, char *name, double value, int last)
+{
+    if (value == PERF_MISSING)
+	fprintf(fp, "\"%s\": null", name);
+    else
+	fprintf(fp, "\"%s\": %.9g", name, value);
+    fprintf(fp, "%s", last ? "" : ", ");
+}
+
+/*
+ * write_csv - one line per trace, with latency (-L) and hardware event
+ *     (-P) columns if they were measured. Missing values are empty.
+ */
+static void write_csv(FILE *fp, char **tracefiles, int n, stats_t *stats)
+{
+    int i, type, event;
+    perf_counts_t *counts;
+    lat_summary_t *lat;
+
+    fprintf(fp, "trace,file,valid,util,ops,secs,kops,samples,median,ci95,"
+	    "spread");
+    if (latency)
+	for (type = 0; type <= ARENA_DESTROY; type++)
+	    fprintf(fp, ",lat_%s_count,lat_%s_p50,lat_%s_p99,lat_%s_p99.9,"
+		    "lat_%s_max", request_names[type], request_names[type], 
+		    request_names[type], request_names[type], 
+		    request_names[type]);
+    if (perfctrs)
+	for (type = -1; type <= ARENA_DESTROY; type++)
+	    for (event = 0; event < PERF_NEVENTS; event++)
+		fprintf(fp, ",ev_%s_%s", type < 0 ? "all" : request_names[type],
+			perf_name(event));
+    fprintf(fp, "\n");
+
+    for (i = 0; i < n; i++) {
+	fprintf(fp, "%d,%s,%d,%.9g,%.0f,%.9g,%.9g,%d,%.9g,%.9g,%.9g", i, 
+		tracefiles[i], stats[i].valid, stats[i].util, stats[i].ops, 
+		stats[i].secs, stats[i].secs > 0 ? 
+		stats[i].ops / 1e3 / stats[i].secs : 0, 
+		stats[i].timing.samples, stats[i].timing.median, 
+		stats[i].timing.ci, stats[i].timing.spread);
+	if (latency)
+	    for (type = 0; type <= ARENA_DESTROY; type++) {
+		lat = &stats[i].lat[type];
+		fprintf(fp, ",%.0f,%.0f,%.0f,%.0f,%.0f", lat->count, lat->p50, 
+			lat->p99, lat->p999, lat->max);
+	    }
+	if (perfctrs)
+	    for (type = -1; type <= ARENA_DESTROY; type++) {
+		counts = type < 0 ? &stats[i].perf_all : &stats[i].perf[type];
+		for (event = 0; event < PERF_NEVENTS; event++)
+		    if (counts->counts[event] == PERF_MISSING)
+			fprintf(fp, ",");
+		    else
+			fprintf(fp, ",%.6g", counts->counts[event]);
+	    }
+	fprintf(fp, "\n");
+    }
+}
+
+/*
+ * compare_baseline - compare the mm stats of each trace with the ones
+ *     saved in the JSON or CSV file path (by -o) for the same tracefile,
+ *     print the differences, and return the number of regressions. 
+ *
+ *     Utilization is deterministic, so any loss of more than 
+ *     BASELINE_UTIL_TOL is a regression. Timings are not. The fastest
+ *     samples of the two runs are compared, and throughput regresses if
+ *     it drops by more than BASELINE_THRU_TOL plus the spread of the K
+ *     fastest samples of each run. The spread says nothing of the noise
+ *     between runs, so a trace that looks slower is timed again, up to
+ *     BASELINE_RETRIES times, and only regresses if it stays slower.
+ */
+static int compare_baseline(char *path, char **tracefiles, int n, 
+			    stats_t *stats)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t linesize = 0;
+    char *fields[512];
+    int nfields, i, j, regressions = 0, compared = 0;
+    int col_file = -1, col_util = -1, col_secs = -1;
+    int col_spread = -1, col_valid = -1, base_latency = 0, retry, json;
+    double base_util, base_secs, base_spread, secs, spread, change, tol;
+    double retry_secs, retry_spread;
+    char *verdict;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	unix_error("Could not open the baseline file");
+
+    /* The header of a CSV file gives the columns. JSON has none: each
+       trace is an object on a line of its own, split by json_split */
+    if (getline(&line, &linesize, fp) < 0)
+	app_error("Empty baseline file");
+    json = (line[0] == '{');
+    if (json) {
+	while (getline(&line, &linesize, fp) >= 0)
+	    if (strstr(line, "\"latency_ns\": ") != NULL)
+		base_latency = 1;
+	rewind(fp);
+	nfields = 5;
+	col_file = 0, col_valid = 1, col_util = 2, col_secs = 3;
+	col_spread = 4;
+    }
+    else {
+	nfields = csv_split(line, fields, 512);
+	for (j = 0; j < nfields; j++) {
+	    if (!strcmp(fields[j], "file")) col_file = j;
+	    else if (!strcmp(fields[j], "valid")) col_valid = j;
+	    else if (!strcmp(fields[j], "util")) col_util = j;
+	    else if (!strcmp(fields[j], "secs")) col_secs = j;
+	    else if (!strcmp(fields[j], "spread")) col_spread = j;
+	    else if (!strncmp(fields[j], "lat_", 4)) base_latency = 1;
+	}
+	if (col_file < 0 || col_valid < 0 || col_util < 0 || col_secs < 0)
+	    app_error("The baseline file is not a file written by -o");
+    }
+
+    printf("Comparison with %s:\n", path);
+    if (base_latency != latency)
+	printf("Warning: the baseline was %s -L; timing each request slows "
+	       "the whole run\n", base_latency ? "run with" : "not run with");
+    printf("%5s  %-22s%7s%7s%10s%10s%8s%8s  %s\n", "trace", "file", 
+	   "util", "was", "Kops", "was", "change", "tol", "");
+    while (getline(&line, &linesize, fp) >= 0) {
+	if ((json ? json_split(line, fields) : 
+	     csv_split(line, fields, 512)) < nfields)
+	    continue;
+	for (i = 0; i < n && strcmp(tracefiles[i], fields[col_file]); i++)
+	    ;
+	if (i == n || !stats[i].valid || !atoi(fields[col_valid]))
+	    continue;
+	compared++;
+	base_util = atof(fields[col_util]);
+	base_secs = atof(fields[col_secs]);
+	base_spread = col_spread >= 0 ? atof(fields[col_spread]) : 0;
+	secs = stats[i].secs;
+	spread = stats[i].timing.samples > 0 ? stats[i].timing.spread : 0;
+
+	/* Relative change of throughput (ops/secs), confirmed if slower */
+	change = base_secs / secs - 1.0;
+	tol = BASELINE_THRU_TOL + base_spread + spread;
+	for (retry = 0; retry < BASELINE_RETRIES && change < -tol; retry++) {
+	    retry_secs = retime_trace(tracefiles[i], &retry_spread);
+	    if (retry_secs < secs) {
+		secs = retry_secs;
+		spread = retry_spread;
+		change = base_secs / secs - 1.0;
+		tol = BASELINE_THRU_TOL + base_spread + spread;
+	    }
+	}
+	if (stats[i].util < base_util - BASELINE_UTIL_TOL || change < -tol) {
+	    verdict = "REGRESSION";
+	    regressions++;
+	}
+	else if (stats[i].util > base_util + BASELINE_UTIL_TOL || change > tol)
+	    verdict = "better";
+	else
+	    verdict = "";
+	printf("%5d  %-22s%6.1f%%%6.1f%%%10.0f%10.0f%7.1f%%%7.1f%%  %s\n", 
+	       i, tracefiles[i], stats[i].util * 100, base_util * 100,
+	       stats[i].ops / 1e3 / secs, stats[i].ops / 1e3 / base_secs,
+	       change * 100, tol * 100, verdict);
+    }
+    free(line);
+    fclose(fp);
+
+    if (compared == 0)
+	printf("No trace of this run is in the baseline\n");
+    else if (regressions > 0)
+	printf("%d of %d traces regressed\n", regressions, compared);
+    else
+	printf("No regressions in %d traces\n", compared);
+    printf("\n");
+    return regressions;
+}
+
+/*
+ * retime_trace - time mm on a tracefile again, as eval_mm_trace does
+ *     (it was found correct then). Returns the fastest sample, and the
+ *     spread of the K fastest in spread.
+ */
+static double retime_trace(char *tracefile, double *spread)
+{
+    speed_t params;
+    ftimer_stats_t timing;
+    double secs;
+
+    memset(&params, 0, sizeof(params));
+    params.lat = latency ? new_latency() : NULL;
+    if (streaming) {
+	params.stream = open_trace_stream(tracedir, tracefile);
+	params.live = livemap_create();
+	params.arenas = (mm_arena_t **)calloc(UINT16_MAX + 1, 
+					      sizeof(mm_arena_t *));
+	params.arena_heads = (int *)malloc((UINT16_MAX + 1) * sizeof(int));
+	if (params.arenas == NULL || params.arena_heads == NULL)
+	    unix_error("malloc failed in retime_trace");
+	memset(params.arena_heads, 0xff, (UINT16_MAX + 1) * sizeof(int));
+	secs = fsecs_stats(eval_mm_stream_speed, &params, &timing);
+	close_trace_stream(params.stream);
+	livemap_destroy(params.live);
+	free(params.arenas);
+	free(params.arena_heads);
+    }
+    else {
+	params.trace = read_trace(tracedir, tracefile);
+	secs = fsecs_stats(eval_mm_speed, &params, &timing);
+	free_trace(params.trace);
+    }
+    free(params.lat);
+    *spread = timing.samples > 0 ? timing.spread : 0;
+    return secs;
+}
+
+/*
+ * csv_split - split a CSV line (with no quoting) into at most max fields
+ *     in place, and return their number
+ */
+static int csv_split(char *line, char **fields, int max)
+{
+    int n = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    while (n < max) {
+	fields[n++] = line;
+	if ((line = strchr(line, ',')) == NULL)
+	    break;
+	*line++ = '\0';
+    }
+    return n;
+}
+
+/*
+ * json_split - split a trace object of a JSON file written by -o into
+ *     its file, valid (as 1 or 0), util, secs and spread. Returns the
+ *     number of fields found, 0 for a line that holds no trace.
+ */
+static int json_split(char *line, char **fields)
+{
+    static char *names[] = {"file", "valid", "util", "secs", "spread"};
+    char key[16];
+    int n;
+
+    if (strstr(line, "{\"trace\": ") == NULL)
+	return 0;
+
+    /* Find every value before cutting the line at the end of any */
+    for (n = 0; n < 5; n++) {
+	sprintf(key, "\"%s\": ", names[n]);
+	if ((fields[n] = strstr(line, key)) == NULL)
+	    break;
+	fields[n] += strlen(key);
+    }
+    if (n < 5)
+	return n;
+    fields[1] = strncmp(fields[1], "true", 4) ? "0" : "1";
+    fields[0]++;
+    fields[0][strcspn(fields[0], "\"")] = '\0';
+    for (n = 2; n < 5; n++)
+	fields[n][strcspn(fields[n], ",}")] = '\0';
+    return 5;
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1004,14 +3677,29 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValsCLPW] [-f <file>] [-t <dir>] [-j <n>]\n");
+    fprintf(stderr, "               [-T <n>] [-o <results>] [-b <baseline>]\n");
+    fprintf(stderr, "               [-F <timeline.csv>] [-N <n>] [-X <n>] [-A <alloc.so>]...\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-A <lib>   Compare mm with the allocator in a shared object (repeatable).\n");
+    fprintf(stderr, "\t-C         Replay each trace with its threads (@<thread> requests).\n");
+    fprintf(stderr, "\t-F <file>  Write the fragmentation timeline to a CSV file.\n");
+    fprintf(stderr, "\t-N <n>     Sample the timeline every <n> requests.\n");
+    fprintf(stderr, "\t-b <file>  Compare with a file saved by -o; exit 2 on regressions.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-j <n>     Evaluate up to <n> traces in parallel.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-o <file>  Write the results as JSON (or CSV if <file> ends in .csv).\n");
+    fprintf(stderr, "\t-L         Print latency percentiles of each request type.\n");
+    fprintf(stderr, "\t-P         Count hardware events (perf_event_open).\n");
+    fprintf(stderr, "\t-W         Break the heap down into payload, waste and free space.\n");
+    fprintf(stderr, "\t-s         Stream the traces instead of reading them in.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Replay the traces on 1, 2, 4... <n> threads.\n");
+    fprintf(stderr, "\t-X <n>     Time the traces scaled to 1, 10, 100... <n> copies.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
@@ -2,6 +2,11 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            The heap can also be backed by a file mapping (mem_init_file),
+ *            in which case it outlives the process and can be mapped again,
+ *            or by a POSIX shared memory object (mem_init_shm), in which
+ *            case several processes can map and use it at the same time.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,23 +15,50 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/file.h>
 
 #include "memlib.h"
 #include "config.h"
 
+#define MEM_FILE_MAGIC 0x6d656d31  /* "mem1", marks an initialized heap file */
+
+/* 
+ * A heap file (or shared memory object) starts with this header, padded
+ * to one page. The heap itself follows, so its size is saved and shared
+ * along with its contents.
+ */
+typedef struct {
+    unsigned int magic;      /* MEM_FILE_MAGIC */
+    size_t heapsize;         /* bytes between mem_start_brk and mem_brk */
+} mem_file_hdr_t;
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_file_hdr_t *mem_file_hdr = NULL; /* header if the heap is mapped */
+static size_t mem_map_size;  /* bytes mapped from the heap file */
+static int mem_fd = -1;      /* descriptor of the heap file */
+
+static int mem_map_heap(char *name, void *base);
+static void mem_sync_brk(void);
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    /* 
+     * Reserve the storage we will use to model the available VM. Pages
+     * are only backed when first touched, so a large MAX_HEAP (wide
+     * builds) costs nothing until the heap grows into it.
+     */
+    mem_start_brk = mmap(NULL, MAX_HEAP, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error: %s\n", strerror(errno));
 	exit(1);
     }
 
@@ -34,12 +66,134 @@ void mem_init(void)
     mem_brk = mem_start_brk;                  /* heap is empty initially */
 }
 
+/*
+ * mem_init_file - initialize the memory system model with a heap kept
+ *    in the file path. The heap is mapped at base, or anywhere if base
+ *    is NULL. Returns 1 if the file already held a heap (which can be
+ *    adopted with mm_attach), 0 if the heap is new and empty.
+ */
+int mem_init_file(char *path, void *base)
+{
+    if ((mem_fd = open(path, O_RDWR | O_CREAT, 0600)) < 0) {
+	fprintf(stderr, "mem_init_file: open error: %s\n", strerror(errno));
+	exit(1);
+    }
+    return mem_map_heap(path, base);
+}
+
+/*
+ * mem_init_shm - same as mem_init_file, with the POSIX shared memory
+ *    object name (see shm_open). Every process that maps the same name
+ *    sees the same heap; the mm package serializes its requests.
+ */
+int mem_init_shm(char *name, void *base)
+{
+    if ((mem_fd = shm_open(name, O_RDWR | O_CREAT, 0600)) < 0) {
+	fprintf(stderr, "mem_init_shm: shm_open error: %s\n", strerror(errno));
+	exit(1);
+    }
+    return mem_map_heap(name, base);
+}
+
+/*
+ * mem_map_heap - map the heap file open on mem_fd (named name in error
+ *    messages) and initialize its header if it is new. Every process
+ *    that maps the file holds a shared lock on it until mem_deinit (or
+ *    until it dies), which mem_sole_user looks for.
+ */
+static int mem_map_heap(char *name, void *base)
+{
+    size_t hdrsize = mem_pagesize();
+    int flags = MAP_SHARED;
+    struct stat st;
+    char *map;
+
+    /* The file always spans a header page and MAX_HEAP bytes */
+    flock(mem_fd, LOCK_SH);
+    mem_map_size = hdrsize + MAX_HEAP;
+    if (fstat(mem_fd, &st) < 0 || 
+	((size_t)st.st_size < mem_map_size && 
+	 ftruncate(mem_fd, mem_map_size) < 0)) {
+	fprintf(stderr, "mem_map_heap: cannot size %s: %s\n", 
+		name, strerror(errno));
+	exit(1);
+    }
+
+#ifdef MAP_FIXED_NOREPLACE
+    if (base != NULL)
+	flags |= MAP_FIXED_NOREPLACE;
+#endif
+    map = mmap(base ? (char *)base - hdrsize : NULL, mem_map_size, 
+	       PROT_READ | PROT_WRITE, flags, mem_fd, 0);
+    if (map == MAP_FAILED || (base != NULL && map + hdrsize != base)) {
+	fprintf(stderr, "mem_map_heap: cannot map %s at %p\n", name, base);
+	exit(1);
+    }
+
+    mem_file_hdr = (mem_file_hdr_t *)map;
+    mem_start_brk = map + hdrsize;
+    mem_max_addr = mem_start_brk + MAX_HEAP;
+    if (mem_file_hdr->magic == MEM_FILE_MAGIC) {
+	mem_brk = mem_start_brk + mem_file_hdr->heapsize;
+	return 1;
+    }
+    mem_file_hdr->magic = MEM_FILE_MAGIC;
+    mem_file_hdr->heapsize = 0;
+    mem_brk = mem_start_brk;
+    return 0;
+}
+
 /* 
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    if (mem_file_hdr != NULL) {
+	munmap(mem_file_hdr, mem_map_size);
+	close(mem_fd);
+	mem_file_hdr = NULL;
+	mem_fd = -1;
+    }
+    else
+	munmap(mem_start_brk, MAX_HEAP);
+}
+
+/*
+ * mem_shared - return true if the heap is mapped from a file or shared
+ *    memory object, i.e. other processes may be using it too
+ */
+int mem_shared(void)
+{
+    return mem_file_hdr != NULL;
+}
+
+/*
+ * mem_sole_user - return true if no other process has the heap mapped
+ *    (always for a heap in malloc'd memory)
+ */
+int mem_sole_user(void)
+{
+    int sole;
+
+    if (mem_file_hdr == NULL)
+	return 1;
+
+    /* Converting the lock drops it first, so take it back either way */
+    sole = (flock(mem_fd, LOCK_EX | LOCK_NB) == 0);
+    flock(mem_fd, LOCK_SH);
+    return sole;
+}
+
+/*
+ * mem_sync - write a file-backed heap back to its file (a snapshot)
+ */
+void mem_sync(void)
+{
+    mem_sync_brk();
+    if (mem_file_hdr != NULL && 
+	msync(mem_file_hdr, (char *)mem_brk - (char *)mem_file_hdr, 
+	      MS_SYNC) < 0)
+	fprintf(stderr, "mem_sync: msync error: %s\n", strerror(errno));
 }
 
 /*
@@ -48,6 +202,8 @@ void mem_deinit(void)
 void mem_reset_brk()
 {
     mem_brk = mem_start_brk;
+    if (mem_file_hdr != NULL)
+	mem_file_hdr->heapsize = 0;
 }
 
 /* 
@@ -55,16 +211,21 @@ void mem_reset_brk()
  *    by incr bytes and returns the start address of the new area. In
  *    this model, the heap cannot be shrunk.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(size_t incr) 
 {
-    char *old_brk = mem_brk;
+    char *old_brk;
+
+    mem_sync_brk();
+    old_brk = mem_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if (incr > (size_t)(mem_max_addr - mem_brk)) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
     mem_brk += incr;
+    if (mem_file_hdr != NULL)
+	mem_file_hdr->heapsize = mem_brk - mem_start_brk;
     return (void *)old_brk;
 }
 
@@ -81,6 +242,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
+    mem_sync_brk();
     return (void *)(mem_brk - 1);
 }
 
@@ -89,9 +251,20 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
+    mem_sync_brk();
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_sync_brk - in a mapped heap the brk in the header is the one that
+ *    counts, since another process may have moved it
+ */
+static void mem_sync_brk(void)
+{
+    if (mem_file_hdr != NULL)
+	mem_brk = mem_start_brk + mem_file_hdr->heapsize;
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
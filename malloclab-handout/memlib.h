@@ -1,8 +1,13 @@
 #include <unistd.h>
 
 void mem_init(void);               
+int mem_init_file(char *path, void *base);
+int mem_init_shm(char *name, void *base);
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+int mem_shared(void);
+int mem_sole_user(void);
+void mem_sync(void);
+void *mem_sbrk(size_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
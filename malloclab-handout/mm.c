@@ -8,6 +8,16 @@
  * malloc size is larger. Finally the realloc function was only completed partially and still has a lot of
  * room for improvement.
  *
+ * On top of the free list it offers arenas (regions): chunks taken from the heap with mm_malloc in which
+ * objects are bump-allocated and then released all together, so request-scoped data never goes through
+ * mm_free and coalesce one object at a time. Object pools do the same for objects of a single size: they
+ * are carved from slabs of the heap and recycled through a free list threaded through the objects themselves.
+ *
+ * The allocator state lives at the start of the heap and every link inside the heap is an offset, so a heap
+ * mapped from a file or from shared memory can be used again after a restart or by several processes at once.
+ * In that case every request takes the process-shared lock kept in the heap state, and so it does when the
+ * threads of one process share the heap (mm_set_threaded).
+ *
  * Github repository: https://github.com/flcapurso/MallocLab.git
  */
 #include <stdio.h>
@@ -16,6 +26,9 @@
 #include <unistd.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -37,101 +50,459 @@ team_t team = {
     " carzita@kaist.ac.kr"
 };
 
-/* single word (4) or double word (8) alignment */
+/* double word (8) alignment, or 16 with wide words, as malloc gives on 64-bit systems */
+#ifdef MM_WIDE
+#define ALIGNMENT 16
+#else
 #define ALIGNMENT 8
+#endif
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t))) // 8
 
+/*
+ * Headers, footers and links are words. 4-byte words keep the tags of small blocks compact but limit blocks
+ * and the heap to 4 GB; building with -DMM_WIDE (see the mdriver-wide target) makes them 8-byte words.
+ */
+#ifdef MM_WIDE
+typedef size_t word_t;
+#define WORDSIZE 8
+#define MAXWORD SIZE_MAX
+#else
+typedef unsigned int word_t;
+#define WORDSIZE 4
+#define MAXWORD UINT_MAX
+#endif
+
 /* ADDITIONAL MACROS */
 #define INITIALSIZE 512 //only data size (no header, footer, padding)
 #define ALLOCATED 1
 #define FREE 0
-#define HEADSIZE 4
-#define FOOTSIZE 4
-#define INITIALPADDING 4
-#define POINTERSIZE 4
-#define MINDATASIZE (ALIGN(1))
+#define HEADSIZE WORDSIZE
+#define FOOTSIZE WORDSIZE
+#define INITIALPADDING (ALIGN(sizeof(heapState_t)) + FOOTSIZE) // heap state and prologue footer before the first header
+#define POINTERSIZE WORDSIZE
+#define HEAPMAGIC (0x6d6d6830 + WORDSIZE) // "mmh4" or "mmh8", marks a heap laid out by mm_init with this word size
+#define MINDATASIZE (ALIGN(2 * POINTERSIZE)) // a free block must hold its next and prev links
 
 // Pack a size and allocated bit into a word
 #define PACK(size, alloc) ((size) | (alloc)) 
 
 // Read and write a word at address p
-#define GET(p) (*(unsigned int *)(p))
-#define PUT(p, val)  (*(unsigned int *)(p) = (val))
+#define GET(p) (*(word_t *)(p))
+#define PUT(p, val)  (*(word_t *)(p) = (val))
 
-#define GET_SIZE(p) (GET(p) & ~0x7) //extracts size byte from 4 byte header or footer
-#define GET_ALLOCATED(p) (GET(p) & 0x1) //extracts allocated byte from 4 byte header or footer
-#define SET_ALLOC(p) (*(unsigned int *)(p) |= 0x1) // set block as allocated
-#define SET_FREE(p) (*(unsigned int *)(p) &= ~0x1) // set block as free
+#define GET_SIZE(p) (GET(p) & ~0x7) //extracts size from a header or footer
+#define GET_ALLOCATED(p) (GET(p) & 0x1) //extracts allocated bit from a header or footer
+#define SET_ALLOC(p) (*(word_t *)(p) |= 0x1) // set block as allocated
+#define SET_FREE(p) (*(word_t *)(p) &= ~0x1) // set block as free
 
 #define HEADER(ptr) (ptr - HEADSIZE) //gets header address of ptr
 #define FOOTER(ptr) (ptr + GET_SIZE(HEADER(ptr))) //gets footer address of ptr
 
-#define SET_NEXT(ptr, val) (PUT(ptr,val)) //sets next pointer
-#define SET_PREV(ptr, val) (PUT((ptr + POINTERSIZE),val)) // sets prev pointer
-#define GET_NEXT(ptr) ((void *) GET(ptr)) // gets next pointer (as a pointer)
-#define GET_PREV(ptr) ((void *) GET(ptr + POINTERSIZE))// gets previous pointer (as a pointer)
+// Links are stored as offsets from the start of the heap (0 is NULL), so the heap can be mapped anywhere
+#define TO_OFFSET(ptr) ((ptr) == NULL ? 0 : (word_t)((char *)(ptr) - heapStart))
+#define TO_POINTER(offset) ((offset) == 0 ? NULL : (void *)(heapStart + (offset)))
+
+#define SET_NEXT(ptr, val) (PUT(ptr, TO_OFFSET(val))) //sets next pointer
+#define SET_PREV(ptr, val) (PUT((ptr + POINTERSIZE), TO_OFFSET(val))) // sets prev pointer
+#define GET_NEXT(ptr) (TO_POINTER(GET(ptr))) // gets next pointer (as a pointer)
+#define GET_PREV(ptr) (TO_POINTER(GET(ptr + POINTERSIZE)))// gets previous pointer (as a pointer)
+
+#define FREELIST_START (TO_POINTER(heapState->freeListStart)) // first free block (NULL if none)
+#define SET_FREELIST_START(ptr) (heapState->freeListStart = TO_OFFSET(ptr))
 
 #define NEXT(ptr) (ptr + GET_SIZE(HEADER(ptr)) + (HEADSIZE + FOOTSIZE)) // access next block
 #define PREVIOUS(ptr) (ptr - (HEADSIZE + FOOTSIZE) - GET_SIZE(ptr - (HEADSIZE + FOOTSIZE))) // access previous block
 
-void *freeListStart; // pointer to start of free list
-unsigned int maxAvailableSize; // used to keep track of maximum available free block size
+#define IS_FIRST(ptr) ((char *)(ptr) == heapStart + INITIALPADDING + HEADSIZE) // is ptr the first block of the heap
+#define IS_LAST(ptr, size) ((char *)(ptr) + (size) == (char *)mem_heap_hi() + 1 - (HEADSIZE + FOOTSIZE)) // or the last
+
+#define ARENACHUNKSIZE 4096 // data size of a regular arena chunk
+#define CHUNKLINKSIZE (ALIGN(POINTERSIZE)) // each chunk starts with a link to the previous chunk
+#define POOLSLABSIZE 4096 // target data size of a pool slab (bigger if it would hold less than POOLSLABOBJECTS)
+#define POOLSLABOBJECTS 8 // minimum number of objects in a slab
 
+// Allocator state, kept at the start of the heap so that it is saved (and mapped) together with the heap
+typedef struct {
+    word_t magic; // HEAPMAGIC
+    word_t freeListStart; // offset of the first free block
+    word_t maxAvailableSize; // used to keep track of maximum available free block size
+    word_t root; // offset of the application's root object (see mm_set_root)
+    pthread_mutex_t lock; // taken by every request when the heap is shared between processes
+} heapState_t;
+
+static char *heapStart; // address of the heap in this process
+static heapState_t *heapState; // same address, seen as the heap state
+static int heapShared; // set if other processes may use the heap (see mem_shared)
+static int heapThreaded; // set if other threads may use the heap (see mm_set_threaded)
+
+// Arena descriptor, itself stored in an mm_malloc'd block. Like every link in the heap it holds offsets.
+struct mm_arena {
+    word_t firstChunk; // oldest chunk, kept across resets
+    word_t lastChunk; // chunk currently being bump-allocated
+    word_t bump; // next free byte in lastChunk
+    word_t end; // end of lastChunk's data
+};
+
+// Pool descriptor, itself stored in an mm_malloc'd block. Slabs are chained like arena chunks.
+struct mm_pool {
+    word_t objectSize; // distance between two objects (requested size rounded up to align)
+    word_t align; // alignment of every object
+    word_t lastSlab; // most recent slab
+    word_t carve; // next never-used object in lastSlab
+    word_t carveEnd; // end of lastSlab's data
+    word_t freeObjects; // recycled objects, each holding the offset of the next one
+    word_t inUse; // objects handed out by mm_pool_get
+    word_t capacity; // objects in all slabs
+};
+
+// What mm_fragmentation_report hands to countBlock through mm_heap_walk
+typedef struct {
+    mm_frag_report_t *report;
+    size_t usefulSize; // free blocks smaller than this are counted as too small
+} fragWalk_t;
+
+static void *mallocBlock(size_t size);
+static void countBlock(void *ptr, size_t size, int allocated, void *arg);
+static void *reallocBlock(void *ptr, size_t requiredSize);
 static void *coalesce(void *ptr);
+static void lockHeap(void);
+static void unlockHeap(void);
 static void *reserveAllocSpace(void *ptr, void *prevBlock, void *nextBlock, short prevBlockAllocated, short nextBlockAllocate);
+static void initLock(void);
 static void connectFreeList(void *NXTpointer, void *PRVpointer);
+static void *newArenaChunk(mm_arena_t *arena, size_t size);
+static void *newPoolSlab(mm_pool_t *pool);
 
 /* 
  * mm_init - initialize the malloc package.
  */
 int mm_init(void)
 {
-    maxAvailableSize = UINT_MAX;
-    // Create new heap and initialise free list
-    freeListStart = mem_sbrk(ALIGN(INITIALPADDING + HEADSIZE + FOOTSIZE + INITIALSIZE));
-    // Move free pointer after the header
-    freeListStart = (void *) ((char *)freeListStart + (HEADSIZE + FOOTSIZE));
+    void *firstFree;
+
+    // Create new heap, starting with the heap state. Like every block, the first one is followed by room
+    // for the next header (see NEXT), so the heap ends a header past its footer.
+    heapStart = mem_sbrk(ALIGN(INITIALPADDING + HEADSIZE + INITIALSIZE + FOOTSIZE + HEADSIZE));
+    if (heapStart == (void *)-1) {
+        return -1;
+    }
+    heapState = (heapState_t *)heapStart;
+    // A reused heap may still hold the magic of the last one: hide it until this one is complete
+    __atomic_store_n(&heapState->magic, 0, __ATOMIC_RELAXED);
+    heapState->maxAvailableSize = MAXWORD;
+    heapState->root = 0;
+    heapShared = mem_shared();
+    initLock();
+    // Prologue footer, so that looking at the block before the first one stays inside the heap
+    PUT(heapStart + INITIALPADDING - FOOTSIZE, PACK(0, ALLOCATED));
+    // Initialise free list with one block after the prologue
+    firstFree = (void *) (heapStart + INITIALPADDING + HEADSIZE);
+    SET_FREELIST_START(firstFree);
     // Set Header
-    PUT(HEADER(freeListStart), (INITIALSIZE | FREE));
+    PUT(HEADER(firstFree), (INITIALSIZE | FREE));
     // Set Footer
-    PUT(FOOTER(freeListStart), (INITIALSIZE | FREE));
+    PUT(FOOTER(firstFree), (INITIALSIZE | FREE));
     // Set 'next' and 'prev' pointers to zero
-    SET_NEXT(freeListStart, 0);
-    SET_PREV(freeListStart, 0);
+    SET_NEXT(firstFree, 0);
+    SET_PREV(firstFree, 0);
+    // Publish the heap last, so that mm_attach in another process sees the lock and the free list set up
+    __atomic_store_n(&heapState->magic, HEAPMAGIC, __ATOMIC_RELEASE);
 
     return 0;
 }
 
+/*
+ * mm_attach - use the heap already in memlib (e.g. a file mapped again after a restart) instead of
+ *     creating a new one. Nothing is rebuilt: the free list and the root are found again through offsets.
+ *     Only the lock is, if no other process has the heap mapped: its owner may have died in another run.
+ */
+int mm_attach(void)
+{
+    heapStart = mem_heap_lo();
+    heapState = (heapState_t *)heapStart;
+    if (mem_heapsize() < INITIALPADDING || __atomic_load_n(&heapState->magic, __ATOMIC_ACQUIRE) != HEAPMAGIC) {
+        return -1;
+    }
+    heapShared = mem_shared();
+    if (mem_sole_user()) {
+        initLock();
+    }
+    return 0;
+}
+
+/*
+ * initLock - initialize the heap lock. It works across processes, and survives one of them dying while
+ *     holding it.
+ */
+static void initLock(void)
+{
+    pthread_mutexattr_t lockAttributes;
+
+    pthread_mutexattr_init(&lockAttributes);
+    pthread_mutexattr_setpshared(&lockAttributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&lockAttributes, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&heapState->lock, &lockAttributes);
+    pthread_mutexattr_destroy(&lockAttributes);
+}
+
+/*
+ * mm_set_threaded - take the heap lock in every request (threaded != 0) or only when the heap is shared
+ *     with other processes (threaded == 0). Must not be changed while another thread is using the heap.
+ */
+void mm_set_threaded(int threaded)
+{
+    heapThreaded = threaded;
+}
+
+/*
+ * mm_set_root - remember ptr (a block of this heap, or NULL) as the root of the application's data
+ */
+void mm_set_root(void *ptr)
+{
+    heapState->root = TO_OFFSET(ptr);
+}
+
+/*
+ * mm_get_root - return the root set with mm_set_root, at its address in this mapping of the heap
+ */
+void *mm_get_root(void)
+{
+    return TO_POINTER(heapState->root);
+}
+
 /* 
  * mm_malloc - Allocate a block by incrementing the brk pointer.
  *     Always allocate a block whose size is a multiple of the alignment.
  */
 void *mm_malloc(size_t size)
 {
-    unsigned int requiredDataSize = ALIGN(size);
+    void *ptr;
+
+    lockHeap();
+    ptr = mallocBlock(size);
+    unlockHeap();
+    return ptr;
+}
+
+/*
+ * mm_free - Give the block back to the free list, coalescing it with its free neighbours.
+ */
+void mm_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    lockHeap();
+    coalesce(ptr);
+    unlockHeap();
+}
+
+/*
+ * mm_realloc - Grow or shrink in place when the block and its free neighbours are big enough,
+ *     otherwise move the data to a new block.
+ */
+void *mm_realloc(void *ptr, size_t requiredSize)
+{
+    void *newptr;
+
+    lockHeap();
+    newptr = reallocBlock(ptr, requiredSize);
+    unlockHeap();
+    return newptr;
+}
+
+/*
+ * mm_memalign - Allocate a block whose address is a multiple of align (a power of two). A block with room
+ *     to spare is taken, the payload is moved up to an aligned address, and the space before and after it
+ *     is given back to the free list.
+ */
+void *mm_memalign(size_t align, size_t size)
+{
+    char *ptr;
+    char *aligned;
+    char *tail;
+    word_t blockSize;
+    word_t leadSize;
+
+    if ((align & (align - 1)) != 0) {
+        return NULL;
+    }
+    if (align <= ALIGNMENT) {
+        return mm_malloc(size);
+    }
+    if (size > MAXWORD - 2 * (ALIGNMENT + HEADSIZE + FOOTSIZE) - MINDATASIZE - align) {
+        return NULL;
+    }
+    size = ALIGN(size);
+    if (size < MINDATASIZE) {
+        size = MINDATASIZE;
+    }
+
+    lockHeap();
+    ptr = mallocBlock(size + align + (HEADSIZE + FOOTSIZE) + MINDATASIZE);
+    if (ptr == NULL) {
+        unlockHeap();
+        return NULL;
+    }
+    // the space in front of the aligned payload must be able to hold a free block
+    aligned = (char *)(((size_t)ptr + (HEADSIZE + FOOTSIZE) + MINDATASIZE + (align - 1)) & ~(size_t)(align - 1));
+    leadSize = aligned - ptr - (HEADSIZE + FOOTSIZE);
+    blockSize = GET_SIZE(HEADER(ptr)) - leadSize - (HEADSIZE + FOOTSIZE);
+    PUT(HEADER(ptr), PACK(leadSize, ALLOCATED));
+    PUT(FOOTER(ptr), PACK(leadSize, ALLOCATED));
+    PUT(HEADER(aligned), PACK(blockSize, ALLOCATED));
+    PUT(FOOTER(aligned), PACK(blockSize, ALLOCATED));
+    coalesce(ptr);
+
+    // split off the rest if it is big enough to be a block of its own
+    if (blockSize >= size + (HEADSIZE + FOOTSIZE) + MINDATASIZE) {
+        tail = aligned + size + (HEADSIZE + FOOTSIZE);
+        PUT(HEADER(aligned), PACK(size, ALLOCATED));
+        PUT(FOOTER(aligned), PACK(size, ALLOCATED));
+        PUT(HEADER(tail), PACK(blockSize - size - (HEADSIZE + FOOTSIZE), ALLOCATED));
+        PUT(FOOTER(tail), PACK(blockSize - size - (HEADSIZE + FOOTSIZE), ALLOCATED));
+        coalesce(tail);
+    }
+    unlockHeap();
+    return aligned;
+}
+
+/*
+ * mm_usable_size - Return the payload size of a block from mm_malloc, mm_realloc or mm_memalign, which can
+ *     be more than was asked for.
+ */
+size_t mm_usable_size(void *ptr)
+{
+    return ptr == NULL ? 0 : GET_SIZE(HEADER((char *)ptr));
+}
+
+/*
+ * mm_free_stats - Count the blocks of the free list and find the largest one (its data size), for watching
+ *     fragmentation. Walks the whole list, so it costs as much as a malloc that finds no fit.
+ */
+void mm_free_stats(size_t *freeBlocks, size_t *largestFree)
+{
+    void *nextFree;
+    size_t count = 0, largest = 0;
+
+    lockHeap();
+    for (nextFree = FREELIST_START; nextFree != NULL; nextFree = GET_NEXT(nextFree)) {
+        count++;
+        if (GET_SIZE(HEADER(nextFree)) > largest) {
+            largest = GET_SIZE(HEADER(nextFree));
+        }
+    }
+    unlockHeap();
+    *freeBlocks = count;
+    *largestFree = largest;
+}
+
+/*
+ * mm_round_size - The data size of the block mm_malloc looks for to hold size bytes: rounded up to the
+ *     alignment, and to the room a free block needs for its links.
+ */
+size_t mm_round_size(size_t size)
+{
+    return ALIGN(size) < MINDATASIZE ? MINDATASIZE : ALIGN(size);
+}
+
+/*
+ * mm_heap_walk - Call visit on every block of the heap, from the first to the last, with its data size and
+ *     whether it is allocated. The heap is locked meanwhile, so visit must not call into mm.
+ */
+void mm_heap_walk(void (*visit)(void *ptr, size_t size, int allocated, void *arg), void *arg)
+{
+    char *ptr;
+    char *heapEnd;
+
+    lockHeap();
+    // every block is followed by the next one's header, the last one by the end of the heap
+    heapEnd = (char *)mem_heap_hi() + 1;
+    for (ptr = heapStart + INITIALPADDING + HEADSIZE; ptr < heapEnd; ptr = NEXT(ptr)) {
+        visit(ptr, GET_SIZE(HEADER(ptr)), GET_ALLOCATED(HEADER(ptr)), arg);
+    }
+    unlockHeap();
+}
+
+/*
+ * mm_fragmentation_report - Sort the bytes of the heap into allocator state, boundary tags, allocated data
+ *     and free data, the last also counted apart for free blocks too small to hold usefulSize bytes.
+ */
+void mm_fragmentation_report(size_t usefulSize, mm_frag_report_t *report)
+{
+    fragWalk_t walk;
+
+    memset(report, 0, sizeof(*report));
+    walk.report = report;
+    walk.usefulSize = usefulSize;
+    mm_heap_walk(countBlock, &walk);
+    report->heapBytes = mem_heapsize();
+    report->stateBytes = report->heapBytes - report->tagBytes - report->allocatedBytes - report->freeBytes;
+}
+
+/*
+ * Function to add one block to a fragmentation report, for mm_heap_walk.
+ */
+static void countBlock(void *ptr, size_t size, int allocated, void *arg)
+{
+    fragWalk_t *walk = (fragWalk_t *)arg;
+    mm_frag_report_t *report = walk->report;
+
+    report->tagBytes += HEADSIZE + FOOTSIZE;
+    if (allocated) {
+        report->allocatedBlocks++;
+        report->allocatedBytes += size;
+        return;
+    }
+    report->freeBlocks++;
+    report->freeBytes += size;
+    if (size < walk->usefulSize) {
+        report->smallFreeBlocks++;
+        report->smallFreeBytes += size;
+    }
+    if (size > report->largestFree) {
+        report->largestFree = size;
+    }
+}
+
+/*
+ * Function to find the best fitting free block for size bytes (or to extend the heap), with the heap locked.
+ */
+static void *mallocBlock(size_t size)
+{
+    // sizes that do not fit in a header are refused (see MM_WIDE)
+    if (size > MAXWORD - ALIGNMENT - (HEADSIZE + FOOTSIZE)) {
+        return NULL;
+    }
+    word_t requiredDataSize = ALIGN(size);
+
+    // the block must be able to hold the free list links once it is freed
+    if (requiredDataSize < MINDATASIZE) {
+        requiredDataSize = MINDATASIZE;
+    }
     // Get First element in free space (if there is any free space)
-    if (freeListStart != (void *) -1) {
-        void *nextFree = freeListStart; // pointer to first free space, used to itinerate between the next ones
+    if (FREELIST_START != NULL) {
+        void *nextFree = FREELIST_START; // pointer to first free space, used to itinerate between the next ones
         short matchFound = 0; // has match been found
         short exactMatch = 0; // has a EXACT match been found
-        unsigned int closestSize = UINT_MAX;//save closest size
-        void *bestFitPointer; // save pointer to the saved space
-        unsigned int currentSize = 0; // holds next free space size to compare with saved one
+        word_t closestSize = MAXWORD;//save closest size
+        void *bestFitPointer = NULL; // save pointer to the saved space
+        word_t currentSize = 0; // holds next free space size to compare with saved one
         int numberFree = 0; // just tprint how many free spaces have been found
 
         // Loop to check all free spaces (stops if pointer has not been assigned(which means end of list) or exact match found)
-        if (maxAvailableSize >= requiredDataSize) {
-            while ( ((int)nextFree != 0) && (exactMatch == 0)) {
+        if (heapState->maxAvailableSize >= requiredDataSize) {
+            while ( (nextFree != NULL) && (exactMatch == 0)) {
                 numberFree++;
                 // get size of the next free space
                 currentSize = GET_SIZE(HEADER(nextFree));
                 
-                if (maxAvailableSize < currentSize) {
-                    maxAvailableSize = currentSize;
+                if (heapState->maxAvailableSize < currentSize) {
+                    heapState->maxAvailableSize = currentSize;
                 }
                 // see if it matches exactly
                 if (currentSize == requiredDataSize) {
@@ -156,7 +527,7 @@ void *mm_malloc(size_t size)
 
             // +1 since mem_heap_hi() returns LAST byte, not end of heap
             endHeap = (void *) ((char*)endHeap + 1);
-            unsigned int prevSize = 0;
+            word_t prevSize = 0;
             short prevAlloc = GET_ALLOCATED(endHeap - (HEADSIZE + FOOTSIZE));
 
             // if last block is free, expand only by required
@@ -173,32 +544,32 @@ void *mm_malloc(size_t size)
                     void *prevPRVpointer = GET_PREV(newAllocated);
 
                     // if last block is first in the free list
-                    if ((int)prevPRVpointer == 0) {
-                        // and if also last, set 'freeListStart' to -1
-                        if ((int)prevNXTpointer == 0) {
-                            freeListStart = (void *)(-1);
+                    if (prevPRVpointer == NULL) {
+                        // and if also last, empty the free list
+                        if (prevNXTpointer == NULL) {
+                            SET_FREELIST_START(NULL);
                         }
                         else{
-                            freeListStart = prevNXTpointer;
+                            SET_FREELIST_START(prevNXTpointer);
                             SET_PREV(prevNXTpointer, 0);
                         }
                     }
                     // if last block is last in the free list
-                    else if ((int)prevNXTpointer == 0){
+                    else if (prevNXTpointer == NULL){
                         SET_NEXT(prevPRVpointer, 0);
                     }
                     // if in middle of list
                     else {
-                        SET_NEXT(prevPRVpointer, ((unsigned int) prevNXTpointer));
-                        SET_PREV(prevNXTpointer, ((unsigned int) prevPRVpointer));
+                        SET_NEXT(prevPRVpointer, prevNXTpointer);
+                        SET_PREV(prevNXTpointer, prevPRVpointer);
                     }
                     // update header and footer
                     PUT(HEADER(newAllocated),((requiredDataSize) | ALLOCATED));
                     PUT((newAllocated + requiredDataSize),((requiredDataSize) | ALLOCATED));
 
                     // Reset maxAvailable size if it was allocated
-                    if (prevSize == maxAvailableSize) {
-                        maxAvailableSize = UINT_MAX;
+                    if (prevSize == heapState->maxAvailableSize) {
+                        heapState->maxAvailableSize = MAXWORD;
                     }
                     return newAllocated;
                 }
@@ -227,48 +598,48 @@ void *mm_malloc(size_t size)
             // if exact match or negligible additional free space, simply assign it
             if ( (exactMatch == 1) || ((closestSize - requiredDataSize) < ((HEADSIZE + FOOTSIZE) + MINDATASIZE)) ) {
                 // if current block is first in the free list
-                if ((int)oldPRVpointer == 0) {
-                    // and if also last, set 'freeListStart' to -1
-                    if ((int)oldNXTpointer == 0){
-                        freeListStart = (void *) -1;
+                if (oldPRVpointer == NULL) {
+                    // and if also last, empty the free list
+                    if (oldNXTpointer == NULL){
+                        SET_FREELIST_START(NULL);
                     }
                     else {
-                        freeListStart = oldNXTpointer;
+                        SET_FREELIST_START(oldNXTpointer);
                         SET_PREV(oldNXTpointer,0);
                     }
                 }
                 // if current block is last in the free list
-                else if ((int)oldNXTpointer == 0){
+                else if (oldNXTpointer == NULL){
                     SET_NEXT((oldPRVpointer), 0);
                 }
                 // if in middle of list
                 else {
-                    SET_NEXT(oldPRVpointer, (unsigned int)oldNXTpointer);
-                    SET_PREV(oldNXTpointer, (unsigned int)oldPRVpointer);
+                    SET_NEXT(oldPRVpointer, oldNXTpointer);
+                    SET_PREV(oldNXTpointer, oldPRVpointer);
                 }
                 //allocate memory
                 SET_ALLOC(HEADER(bestFitPointer));
-                SET_ALLOC(bestFitPointer + requiredDataSize);
+                SET_ALLOC(FOOTER(bestFitPointer));
             }
             // if additional space remains, store it as free space
             else {
                 void *newFree = (void *) ((char *)bestFitPointer + requiredDataSize + (HEADSIZE + FOOTSIZE));
-                unsigned int freeSize = (closestSize - requiredDataSize - (HEADSIZE + FOOTSIZE));
+                word_t freeSize = (closestSize - requiredDataSize - (HEADSIZE + FOOTSIZE));
                 PUT(HEADER(newFree), (freeSize | FREE));
                 PUT(FOOTER(newFree), (freeSize | FREE));
-                SET_NEXT(newFree, (unsigned int)oldNXTpointer);
-                SET_PREV(newFree, (unsigned int)oldPRVpointer);
+                SET_NEXT(newFree, oldNXTpointer);
+                SET_PREV(newFree, oldPRVpointer);
 
                 // if at start of list
-                if ((int)oldPRVpointer == 0){
-                    freeListStart = newFree;
+                if (oldPRVpointer == NULL){
+                    SET_FREELIST_START(newFree);
                 }
                 else{
-                    SET_NEXT(oldPRVpointer, (unsigned int)newFree);
+                    SET_NEXT(oldPRVpointer, newFree);
                 }
                 // if at end of list
-                if ((int)oldNXTpointer != 0) {
-                    SET_PREV(oldNXTpointer, (unsigned int)newFree);
+                if (oldNXTpointer != NULL) {
+                    SET_PREV(oldNXTpointer, newFree);
                 }
 
                 //allocate memory
@@ -276,8 +647,8 @@ void *mm_malloc(size_t size)
                 PUT((bestFitPointer + requiredDataSize), (requiredDataSize | ALLOCATED));
             }
             // Reset maxAvailable size if it was allocated
-            if (closestSize == maxAvailableSize) {
-                maxAvailableSize = UINT_MAX;
+            if (closestSize == heapState->maxAvailableSize) {
+                heapState->maxAvailableSize = MAXWORD;
             }
             return bestFitPointer;
         }
@@ -298,16 +669,11 @@ void *mm_malloc(size_t size)
     }
 }
 /*
- * mm_free - Freeing a block does nothing.
+ * Function to free a block, merging it with the free blocks around it.
  */
-void mm_free(void *ptr)
-{
-    coalesce(ptr);
-}
-
 static void *coalesce (void *ptr) {
 
-    unsigned int size = GET_SIZE(HEADER(ptr));
+    word_t size = GET_SIZE(HEADER(ptr));
 
     void *prevBlock = PREVIOUS(ptr);
     void *nextBlock = NEXT(ptr);
@@ -315,11 +681,11 @@ static void *coalesce (void *ptr) {
     short nextBlockAllocated = GET_ALLOCATED(HEADER(nextBlock));
 
     // if at start
-    if ( ((int)mem_heap_lo() + INITIALPADDING + HEADSIZE) == ((int)ptr) ){
+    if (IS_FIRST(ptr)) {
         prevBlockAllocated = 1;
     }
     // if at end. (did not use "else if" since heap can be composed of a single free block, ie. is at beginning and end)
-    if ( ((int)mem_heap_hi() + 1 - (HEADSIZE + FOOTSIZE)) == ((int)ptr + size) ){
+    if (IS_LAST(ptr, size)) {
         nextBlockAllocated = 1;
     }
 
@@ -330,20 +696,20 @@ static void *coalesce (void *ptr) {
         PUT(FOOTER(ptr), PACK(size, FREE));
 
         //Set pointers
-        if (freeListStart != (void *) -1) {
-            void* oldFirstFree = freeListStart;
-            SET_PREV(oldFirstFree, (unsigned int)ptr);
-            SET_NEXT(ptr, (unsigned int)oldFirstFree);
+        if (FREELIST_START != NULL) {
+            void* oldFirstFree = FREELIST_START;
+            SET_PREV(oldFirstFree, ptr);
+            SET_NEXT(ptr, oldFirstFree);
         }
         else {
             SET_NEXT(ptr, 0);
         }
-        freeListStart = ptr;
+        SET_FREELIST_START(ptr);
         SET_PREV(ptr, 0);
 
         // update maxAvailableSize if size is new max
-        if (size > maxAvailableSize) {
-            maxAvailableSize = size;
+        if (size > heapState->maxAvailableSize) {
+            heapState->maxAvailableSize = size;
         }
         return ptr;
     }
@@ -358,21 +724,21 @@ static void *coalesce (void *ptr) {
         // Set pointers
         void *NXTpointer = GET_NEXT(nextBlock);
         void *PRVpointer = GET_PREV(nextBlock);
-        SET_NEXT(ptr, (int)NXTpointer);
-        SET_PREV(ptr, (int)PRVpointer);
-        if ((int)PRVpointer == 0){
-            freeListStart = ptr;
+        SET_NEXT(ptr, NXTpointer);
+        SET_PREV(ptr, PRVpointer);
+        if (PRVpointer == NULL){
+            SET_FREELIST_START(ptr);
         }
         else {
-            SET_NEXT(PRVpointer, (int)ptr);
+            SET_NEXT(PRVpointer, ptr);
         }
-        if ((int)NXTpointer != 0) {
-            SET_PREV(NXTpointer, (int)ptr);
+        if (NXTpointer != NULL) {
+            SET_PREV(NXTpointer, ptr);
         }
 
         // update maxAvailableSize if size is new max
-        if (size > maxAvailableSize) {
-            maxAvailableSize = size;
+        if (size > heapState->maxAvailableSize) {
+            heapState->maxAvailableSize = size;
         }
         return ptr;
     }
@@ -386,8 +752,8 @@ static void *coalesce (void *ptr) {
         //No need to change pointers
 
         // update maxAvailableSize if size is new max
-        if (size > maxAvailableSize) {
-            maxAvailableSize = size;
+        if (size > heapState->maxAvailableSize) {
+            heapState->maxAvailableSize = size;
         }
         return (prevBlock);
     }
@@ -402,45 +768,51 @@ static void *coalesce (void *ptr) {
         // Set Pointers
         void *nextNXTpointer = GET_NEXT(nextBlock);
         void *nextPRVpointer = GET_PREV(nextBlock);
-        if ((int)nextPRVpointer == 0){
-            freeListStart = nextNXTpointer;
+        if (nextPRVpointer == NULL){
+            SET_FREELIST_START(nextNXTpointer);
             SET_PREV(nextNXTpointer, 0);
         }
-        else if ((int)nextNXTpointer == 0) {
+        else if (nextNXTpointer == NULL) {
             SET_NEXT(nextPRVpointer, 0);
         }
         else{
-            SET_NEXT(nextPRVpointer, (int)nextNXTpointer);
-            SET_PREV(nextNXTpointer, (int)nextPRVpointer);
+            SET_NEXT(nextPRVpointer, nextNXTpointer);
+            SET_PREV(nextNXTpointer, nextPRVpointer);
         }
 
         // update maxAvailableSize if size is new max
-        if (size > maxAvailableSize) {
-            maxAvailableSize = size;
+        if (size > heapState->maxAvailableSize) {
+            heapState->maxAvailableSize = size;
         }
         return (prevBlock);
     }
 }
 
 /*
- * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
+ * Function to implement mm_realloc with the heap locked, falling back on mallocBlock and coalesce
  */
-void *mm_realloc(void *ptr, size_t requiredSize)
+static void *reallocBlock(void *ptr, size_t requiredSize)
 {
+    if (requiredSize > MAXWORD - ALIGNMENT - (HEADSIZE + FOOTSIZE)) {
+        return NULL;
+    }
     requiredSize = ALIGN(requiredSize);
+    if (requiredSize > 0 && requiredSize < MINDATASIZE) {
+        requiredSize = MINDATASIZE;
+    }
     // if PTR is NULL the call is equivalent to mm_malloc(requiredSize)
     if (ptr == NULL) {
-        return mm_malloc(requiredSize);
+        return mallocBlock(requiredSize);
     }
 
     // if requiredSize is 0 the call is equivalent to mm_free(ptr)
     if(requiredSize == 0) {
-        mm_free(ptr);
+        coalesce(ptr);
         return NULL;
     }
 
-    unsigned int currentSize = GET_SIZE(HEADER(ptr));
-    unsigned int availableSize; // used to store the total available size around block (including block)
+    word_t currentSize = GET_SIZE(HEADER(ptr));
+    word_t availableSize; // used to store the total available size around block (including block)
 
     void *prevBlock = PREVIOUS(ptr);
     void *nextBlock = NEXT(ptr);
@@ -448,11 +820,11 @@ void *mm_realloc(void *ptr, size_t requiredSize)
     short nextBlockAllocated = GET_ALLOCATED(HEADER(nextBlock));
 
     // if at start of heap
-    if ( ((int)mem_heap_lo() + INITIALPADDING + HEADSIZE) == ((int)ptr) ){
+    if (IS_FIRST(ptr)) {
         prevBlockAllocated = 1;
     }
     // if at end of heap
-    if ( ((int)mem_heap_hi() + 1 - (HEADSIZE + FOOTSIZE)) == ((int)ptr + currentSize) ){
+    if (IS_LAST(ptr, currentSize)) {
         nextBlockAllocated = 1;
     }
 
@@ -467,7 +839,7 @@ void *mm_realloc(void *ptr, size_t requiredSize)
         availableSize = currentSize + GET_SIZE(HEADER(prevBlock)) + (HEADSIZE + FOOTSIZE);
     }
     else {
-        availableSize = currentSize + GET_SIZE(HEADER(nextBlock)) + GET_SIZE(HEADER(prevBlock)) + (HEADSIZE + FOOTSIZE);
+        availableSize = currentSize + GET_SIZE(HEADER(nextBlock)) + GET_SIZE(HEADER(prevBlock)) + 2*(HEADSIZE + FOOTSIZE);
     }
 
     // If availableSize is enough, no heap extension is required
@@ -475,24 +847,24 @@ void *mm_realloc(void *ptr, size_t requiredSize)
         // Coalesce blocks and return pointer to start
         void *newptr = reserveAllocSpace(ptr, prevBlock, nextBlock, prevBlockAllocated, nextBlockAllocated);
 
-        // Only move data if required (when prev block is free)
+        // Only move data if required (when prev block is free). The old and new payloads overlap.
         if (prevBlockAllocated) {
             return newptr;
         }
         else {
             if (requiredSize > currentSize){
-                memcpy(newptr, ptr, currentSize);
+                memmove(newptr, ptr, currentSize);
             }
             else {
-                memcpy(newptr, ptr, requiredSize);
+                memmove(newptr, ptr, requiredSize);
             }
         }
 
         // if additional space remains, split and free
-        if ( availableSize > (requiredSize + MINDATASIZE)) {
+        if ( availableSize >= (requiredSize + (HEADSIZE + FOOTSIZE) + MINDATASIZE)) {
             // Calculate size and pointer of free space
             void *newFree = (void *) ((char *)newptr + requiredSize + (HEADSIZE + FOOTSIZE));
-            unsigned int freeSize = (availableSize - requiredSize - (HEADSIZE + FOOTSIZE));
+            word_t freeSize = (availableSize - requiredSize - (HEADSIZE + FOOTSIZE));
             // Set header and footer of new free space
             PUT(HEADER(newFree), (freeSize | FREE));
             PUT(FOOTER(newFree), (freeSize | FREE));
@@ -501,21 +873,21 @@ void *mm_realloc(void *ptr, size_t requiredSize)
             PUT(FOOTER(newptr), (requiredSize | ALLOCATED));
 
             // Set pointers
-            if (freeListStart == (void *)-1) {
-                freeListStart = newFree;
+            if (FREELIST_START == NULL) {
+                SET_FREELIST_START(newFree);
                 SET_NEXT(newFree, 0);
             }
             else {
-                SET_NEXT(newFree, (unsigned int)freeListStart);
-                SET_PREV(freeListStart, (unsigned int)newFree);
-                freeListStart = newFree;
+                SET_NEXT(newFree, FREELIST_START);
+                SET_PREV(FREELIST_START, newFree);
+                SET_FREELIST_START(newFree);
             }
 
             SET_PREV(newFree, 0);
 
             // Reassign maxAvailableSize if new free space is new max
-            if (freeSize >= maxAvailableSize) {
-                maxAvailableSize = freeSize;
+            if (freeSize >= heapState->maxAvailableSize) {
+                heapState->maxAvailableSize = freeSize;
             }
         }
         return newptr;
@@ -523,15 +895,16 @@ void *mm_realloc(void *ptr, size_t requiredSize)
     // If available size is not enough, call malloc and then free
     else {
         void *newptr;
-        newptr = mm_malloc(requiredSize);
+        newptr = mallocBlock(requiredSize);
 
         // The original block is left untouched if realloc fails
         if(!newptr) {
             return 0;
         }
 
-        memcpy(newptr, ptr, requiredSize);
-        mm_free(ptr);
+        // the block only grows here, so all of the old data is copied
+        memcpy(newptr, ptr, currentSize);
+        coalesce(ptr);
         return newptr;
     }
 }
@@ -541,14 +914,18 @@ void *mm_realloc(void *ptr, size_t requiredSize)
 static void *reserveAllocSpace (void *ptr, void *prevBlock, void *nextBlock, short prevBlockAllocated, short nextBlockAllocated) {
 
 
-    unsigned int size = GET_SIZE(HEADER(ptr));
-    unsigned int extraSize;
+    word_t size = GET_SIZE(HEADER(ptr));
+    word_t extraSize;
 
+    // both neighbours are allocated, the block stays as it is
+    if (prevBlockAllocated && nextBlockAllocated) {
+        return ptr;
+    }
     // prevBlock is allocated and nextBlock is free
     if(prevBlockAllocated && !nextBlockAllocated) {
         extraSize = GET_SIZE(HEADER(nextBlock));
-        if (extraSize == maxAvailableSize) {
-            maxAvailableSize = UINT_MAX;
+        if (extraSize == heapState->maxAvailableSize) {
+            heapState->maxAvailableSize = MAXWORD;
         }
         size += ( (HEADSIZE + FOOTSIZE) + extraSize );
         PUT(HEADER(ptr), PACK(size, ALLOCATED));
@@ -561,8 +938,8 @@ static void *reserveAllocSpace (void *ptr, void *prevBlock, void *nextBlock, sho
     // prevBlock is free and nextBlock is allocated
     else if (!prevBlockAllocated && nextBlockAllocated) {
         extraSize = GET_SIZE(HEADER(prevBlock));
-        if (extraSize == maxAvailableSize) {
-            maxAvailableSize = UINT_MAX;
+        if (extraSize == heapState->maxAvailableSize) {
+            heapState->maxAvailableSize = MAXWORD;
         }
         size += ( (HEADSIZE + FOOTSIZE) + extraSize );
         PUT(HEADER(prevBlock), PACK(size, ALLOCATED));
@@ -575,13 +952,13 @@ static void *reserveAllocSpace (void *ptr, void *prevBlock, void *nextBlock, sho
     // both are free
     else {
         extraSize = GET_SIZE(HEADER(prevBlock));
-        if (extraSize == maxAvailableSize) {
-            maxAvailableSize = UINT_MAX;
+        if (extraSize == heapState->maxAvailableSize) {
+            heapState->maxAvailableSize = MAXWORD;
         }
         size += 2*(HEADSIZE + FOOTSIZE) + extraSize;
         extraSize = GET_SIZE(HEADER(nextBlock));
-        if (extraSize == maxAvailableSize) {
-            maxAvailableSize = UINT_MAX;
+        if (extraSize == heapState->maxAvailableSize) {
+            heapState->maxAvailableSize = MAXWORD;
         }
         size += extraSize;
         PUT(HEADER(prevBlock), PACK(size, ALLOCATED));
@@ -596,24 +973,257 @@ static void *reserveAllocSpace (void *ptr, void *prevBlock, void *nextBlock, sho
         return (prevBlock);
     }
 }
+/*
+ * Functions to serialize requests on a shared heap. A process that died holding the lock leaves it to the
+ * next one, which carries on with the heap as it was left.
+ */
+static void lockHeap(void)
+{
+    if ((heapShared || heapThreaded) && pthread_mutex_lock(&heapState->lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&heapState->lock);
+    }
+}
+
+static void unlockHeap(void)
+{
+    if (heapShared || heapThreaded) {
+        pthread_mutex_unlock(&heapState->lock);
+    }
+}
+
  /*
   * Function to connect two pieces of the free list that where connected by a now allocated block.
   */
 static void connectFreeList(void *NXTpointer, void *PRVpointer) {
-        if ((int)PRVpointer == 0){
-            if ((int)NXTpointer == 0) {
-                freeListStart = (void *) -1;
+        if (PRVpointer == NULL){
+            if (NXTpointer == NULL) {
+                SET_FREELIST_START(NULL);
             }
             else {
-                freeListStart = NXTpointer;
+                SET_FREELIST_START(NXTpointer);
                 SET_PREV(NXTpointer, 0);
             }
         }
-        else if ((int)NXTpointer == 0) {
+        else if (NXTpointer == NULL) {
             SET_NEXT(PRVpointer, 0);
         }
         else {
-            SET_NEXT(PRVpointer, (int)NXTpointer);
-            SET_PREV(NXTpointer, (int)PRVpointer);
+            SET_NEXT(PRVpointer, NXTpointer);
+            SET_PREV(NXTpointer, PRVpointer);
+        }
+}
+
+/*
+ * mm_arena_create - create an empty arena. The descriptor and the first chunk are normal heap blocks.
+ */
+mm_arena_t *mm_arena_create(void)
+{
+    mm_arena_t *arena = mm_malloc(sizeof(mm_arena_t));
+
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->lastChunk = 0;
+    if (newArenaChunk(arena, ARENACHUNKSIZE) == NULL) {
+        mm_free(arena);
+        return NULL;
+    }
+    arena->firstChunk = arena->lastChunk;
+    return arena;
+}
+
+/*
+ * mm_arena_alloc - bump-allocate size bytes from the arena, taking a new chunk when the current one is full.
+ *     Requests larger than a chunk get a chunk of their own.
+ */
+void *mm_arena_alloc(mm_arena_t *arena, size_t size)
+{
+    size_t requiredDataSize = ALIGN(size);
+    void *ptr;
+
+    if (requiredDataSize > arena->end - arena->bump) {
+        if (requiredDataSize + CHUNKLINKSIZE > ARENACHUNKSIZE) {
+            ptr = newArenaChunk(arena, requiredDataSize + CHUNKLINKSIZE);
+        }
+        else {
+            ptr = newArenaChunk(arena, ARENACHUNKSIZE);
+        }
+        if (ptr == NULL) {
+            return NULL;
         }
-}
\ No newline at end of file
+    }
+    ptr = heapStart + arena->bump;
+    arena->bump += requiredDataSize;
+    return ptr;
+}
+
+/*
+ * mm_arena_reset - release every object of the arena at once. All chunks but the first go back to the
+ *     free list as whole blocks, so the cost depends on the number of chunks and not of objects.
+ */
+void mm_arena_reset(mm_arena_t *arena)
+{
+    char *chunk = TO_POINTER(arena->lastChunk);
+    char *firstChunk = TO_POINTER(arena->firstChunk);
+    char *prevChunk;
+
+    while (chunk != firstChunk) {
+        prevChunk = TO_POINTER(GET(chunk));
+        mm_free(chunk);
+        chunk = prevChunk;
+    }
+    arena->lastChunk = arena->firstChunk;
+    arena->bump = arena->firstChunk + CHUNKLINKSIZE;
+    arena->end = arena->firstChunk + GET_SIZE(HEADER(firstChunk));
+}
+
+/*
+ * mm_arena_destroy - release the arena's objects, chunks and descriptor
+ */
+void mm_arena_destroy(mm_arena_t *arena)
+{
+    mm_arena_reset(arena);
+    mm_free(TO_POINTER(arena->firstChunk));
+    mm_free(arena);
+}
+
+/*
+ * Function to take a new chunk of (at least) size bytes from the heap and make it the arena's current chunk.
+ */
+static void *newArenaChunk(mm_arena_t *arena, size_t size)
+{
+    char *chunk = mm_malloc(size);
+
+    if (chunk == NULL) {
+        return NULL;
+    }
+    PUT(chunk, arena->lastChunk);
+    arena->lastChunk = TO_OFFSET(chunk);
+    arena->bump = arena->lastChunk + CHUNKLINKSIZE;
+    arena->end = arena->lastChunk + GET_SIZE(HEADER(chunk));
+    return chunk;
+}
+
+/*
+ * mm_pool_create - create a pool of objects of the given size. align must be a power of two; objects are
+ *     always at least ALIGNMENT aligned and large enough to hold the free list link.
+ */
+mm_pool_t *mm_pool_create(size_t size, size_t align)
+{
+    mm_pool_t *pool;
+
+    if ((align & (align - 1)) != 0) {
+        return NULL;
+    }
+    pool = mm_malloc(sizeof(mm_pool_t));
+    if (pool == NULL) {
+        return NULL;
+    }
+    if (align < ALIGNMENT) {
+        align = ALIGNMENT;
+    }
+    if (size < POINTERSIZE) {
+        size = POINTERSIZE;
+    }
+    pool->objectSize = (size + (align - 1)) & ~(align - 1);
+    pool->align = align;
+    pool->lastSlab = 0;
+    pool->carve = 0;
+    pool->carveEnd = 0;
+    pool->freeObjects = 0;
+    pool->inUse = 0;
+    pool->capacity = 0;
+    return pool;
+}
+
+/*
+ * mm_pool_get - take an object from the pool: a recycled one if there is any, otherwise the next unused
+ *     object of the last slab, otherwise a new slab is carved from the heap.
+ */
+void *mm_pool_get(mm_pool_t *pool)
+{
+    void *ptr = TO_POINTER(pool->freeObjects);
+
+    if (ptr != NULL) {
+        pool->freeObjects = GET(ptr);
+    }
+    else {
+        if (pool->carveEnd - pool->carve < pool->objectSize) {
+            if (newPoolSlab(pool) == NULL) {
+                return NULL;
+            }
+        }
+        ptr = heapStart + pool->carve;
+        pool->carve += pool->objectSize;
+    }
+    pool->inUse++;
+    return ptr;
+}
+
+/*
+ * mm_pool_put - give an object back to the pool it came from
+ */
+void mm_pool_put(mm_pool_t *pool, void *ptr)
+{
+    PUT(ptr, pool->freeObjects);
+    pool->freeObjects = TO_OFFSET(ptr);
+    pool->inUse--;
+}
+
+/*
+ * mm_pool_occupancy - report how many objects are in use and how many the pool's slabs can hold
+ */
+void mm_pool_occupancy(mm_pool_t *pool, size_t *inUse, size_t *capacity)
+{
+    *inUse = pool->inUse;
+    *capacity = pool->capacity;
+}
+
+/*
+ * mm_pool_destroy - give all the slabs and the descriptor back to the free list
+ */
+void mm_pool_destroy(mm_pool_t *pool)
+{
+    char *slab = TO_POINTER(pool->lastSlab);
+    char *prevSlab;
+
+    while (slab != NULL) {
+        prevSlab = TO_POINTER(GET(slab));
+        mm_free(slab);
+        slab = prevSlab;
+    }
+    mm_free(pool);
+}
+
+/*
+ * Function to take a new slab from the heap and start carving objects from it.
+ */
+static void *newPoolSlab(mm_pool_t *pool)
+{
+    word_t objects = (POOLSLABSIZE - CHUNKLINKSIZE) / pool->objectSize;
+    word_t slabSize;
+    word_t firstObject;
+    char *slab;
+
+    if (objects < POOLSLABOBJECTS) {
+        objects = POOLSLABOBJECTS;
+    }
+    // heap payloads are only ALIGNMENT aligned, larger alignments need room to slide the first object
+    slabSize = CHUNKLINKSIZE + objects * pool->objectSize;
+    if (pool->align > ALIGNMENT) {
+        slabSize += pool->align - ALIGNMENT;
+    }
+    slab = mm_malloc(slabSize);
+    if (slab == NULL) {
+        return NULL;
+    }
+    PUT(slab, pool->lastSlab);
+    pool->lastSlab = TO_OFFSET(slab);
+
+    // first object goes after the link, at the pool alignment (of its address, not of its offset)
+    firstObject = TO_OFFSET((char *)(((size_t)slab + CHUNKLINKSIZE + (pool->align - 1)) & ~(size_t)(pool->align - 1)));
+    pool->carve = firstObject;
+    pool->carveEnd = pool->lastSlab + GET_SIZE(HEADER(slab));
+    pool->capacity += (pool->carveEnd - firstObject) / pool->objectSize;
+    return slab;
+}
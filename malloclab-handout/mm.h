@@ -1,9 +1,80 @@
+#ifndef __MM_H_
+#define __MM_H_
+
 #include <stdio.h>
 
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern size_t mm_usable_size(void *ptr);
+
+/* Free list statistics: number of free blocks and size of the largest */
+extern void mm_free_stats(size_t *freeBlocks, size_t *largestFree);
+
+/*
+ * Heap introspection: mm_heap_walk calls visit on every block of the
+ * heap in address order, with its data size, and mm_fragmentation_report
+ * sorts the bytes of the heap by what holds them. mm_round_size is the
+ * data size mm_malloc gives a request before any unsplit remainder.
+ */
+typedef struct {
+    size_t heapBytes;        /* the whole heap */
+    size_t stateBytes;       /* allocator state, prologue, end of heap */
+    size_t tagBytes;         /* headers and footers of the blocks */
+    size_t allocatedBlocks, allocatedBytes;  /* data of allocated blocks */
+    size_t freeBlocks, freeBytes;            /* data of free blocks ... */
+    size_t smallFreeBlocks, smallFreeBytes;  /* ... smaller than usefulSize */
+    size_t largestFree;      /* data of the largest free block */
+} mm_frag_report_t;
+
+extern size_t mm_round_size(size_t size);
+extern void mm_heap_walk(void (*visit)(void *ptr, size_t size, int allocated,
+				       void *arg), void *arg);
+extern void mm_fragmentation_report(size_t usefulSize,
+				    mm_frag_report_t *report);
+
+/*
+ * Threads: requests are serialized by the heap lock once mm_set_threaded
+ * is on (a shared heap always takes it).
+ */
+extern void mm_set_threaded(int threaded);
+
+/*
+ * Persistent heaps: all links inside the heap are offsets, so a heap
+ * saved in a file (see mem_init_file) can be mapped again at any
+ * address. mm_attach adopts such a heap instead of mm_init, and the
+ * root slot gives the application a way back to its data.
+ */
+extern int mm_attach(void);
+extern void mm_set_root(void *ptr);
+extern void *mm_get_root(void);
+
+/*
+ * Region (arena) allocator: objects are bump-allocated from chunks of
+ * the mm heap and released all together by mm_arena_reset or
+ * mm_arena_destroy. There is no per-object free.
+ */
+typedef struct mm_arena mm_arena_t;
+
+extern mm_arena_t *mm_arena_create(void);
+extern void *mm_arena_alloc(mm_arena_t *arena, size_t size);
+extern void mm_arena_reset(mm_arena_t *arena);
+extern void mm_arena_destroy(mm_arena_t *arena);
+
+/*
+ * Fixed-size object pools: objects of one size are carved from slabs of
+ * the mm heap and recycled through an intrusive free list, with no
+ * per-object header or footer.
+ */
+typedef struct mm_pool mm_pool_t;
+
+extern mm_pool_t *mm_pool_create(size_t size, size_t align);
+extern void *mm_pool_get(mm_pool_t *pool);
+extern void mm_pool_put(mm_pool_t *pool, void *ptr);
+extern void mm_pool_occupancy(mm_pool_t *pool, size_t *inUse, size_t *capacity);
+extern void mm_pool_destroy(mm_pool_t *pool);
 
 
 /* 
@@ -21,3 +92,4 @@ typedef struct {
 
 extern team_t team;
 
+#endif /* __MM_H_ */
@@ -0,0 +1,355 @@
+/*
+ * mmalloc.c - Run real programs on the mm.c allocator
+ *
+ *     unix> LD_PRELOAD=./mmalloc.so prog args...
+ *     unix> LD_PRELOAD=./mmalloc.so MMALLOC_STATS=1 prog args...
+ *
+ * The library replaces the malloc family of the C library with mm.c,
+ * built wide (-DMM_WIDE: 16-byte alignment, no 4 GB limit), on a memlib
+ * heap that is an ordinary anonymous mapping reserved up front and
+ * backed by the kernel as the heap grows into it. Like the simulated
+ * heap it never shrinks, so the resident size of a program is its peak
+ * heap size. MMALLOC_STATS prints the request counts and the heap size
+ * when the program exits.
+ *
+ * Requests are serialized by one lock. The library does not look up
+ * the functions it replaces (no dlsym), so the only way back into it
+ * from its own code is stdio in memlib's error paths; a thread that
+ * calls malloc from inside the library is served from a small static
+ * buffer instead of taking the lock again. A fork holds the lock so
+ * that the child gets a consistent copy of the heap.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+#define BOOTSIZE    65536     /* bytes for requests made from inside */
+#define BOOTALIGN      16
+
+#define TLS __attribute__((tls_model("initial-exec"))) __thread
+#define EXPORT __attribute__((visibility("default")))
+
+/* Heap state */
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static int heap_ready;        /* set once mem_init and mm_init are done */
+static char *heap_lo;         /* the reserved range of the heap */
+static char *heap_end;
+
+/* Requests made from inside the library; each starts with its size */
+static char bootbuf[BOOTSIZE] __attribute__((aligned(BOOTALIGN)));
+static size_t bootused;
+
+/* Counts for MMALLOC_STATS (taken with the lock held) */
+static int print_stats;
+static unsigned long num_mallocs, num_frees, num_reallocs, num_foreign;
+
+static TLS int inside;        /* set while this thread holds heap_lock */
+
+static void lock_heap(void);
+static void unlock_heap(void);
+static void *boot_alloc(size_t size);
+static int in_boot(void *ptr);
+static int in_heap(void *ptr);
+static void *aligned(size_t align, size_t size);
+static void fork_prepare(void);
+static void fork_parent(void);
+static void fork_child(void);
+
+/*****************
+ * The replaced functions
+ *****************/
+
+EXPORT void *malloc(size_t size)
+{
+    void *p;
+
+    if (inside)
+	return boot_alloc(size);
+    lock_heap();
+    p = mm_malloc(size);
+    num_mallocs++;
+    unlock_heap();
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+EXPORT void free(void *ptr)
+{
+    if (ptr == NULL || in_boot(ptr))
+	return;
+    lock_heap();
+    if (in_heap(ptr)) {
+	mm_free(ptr);
+	num_frees++;
+    }
+    else
+	num_foreign++;        /* not ours: leave it alone */
+    unlock_heap();
+}
+
+EXPORT void *calloc(size_t n, size_t size)
+{
+    void *p;
+
+    if (__builtin_mul_overflow(n, size, &size)) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    /*
+     * Blocks are reused, so they must be cleared. (Not with malloc: the
+     * compiler would turn malloc and memset back into a call to calloc.)
+     */
+    if (inside)
+	p = boot_alloc(size);
+    else {
+	lock_heap();
+	p = mm_malloc(size);
+	num_mallocs++;
+	unlock_heap();
+    }
+    if (p == NULL) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    memset(p, 0, size);
+    return p;
+}
+
+EXPORT void *realloc(void *ptr, size_t size)
+{
+    size_t old;
+    void *p;
+
+    if (ptr == NULL)
+	return malloc(size);
+    if (in_boot(ptr)) {
+	/* Move it to the heap */
+	old = *((size_t *)ptr - 2);
+	if ((p = malloc(size)) != NULL)
+	    memcpy(p, ptr, old < size ? old : size);
+	return p;
+    }
+    if (inside)
+	return NULL;
+    lock_heap();
+    if (!in_heap(ptr)) {
+	num_foreign++;
+	unlock_heap();
+	errno = ENOMEM;
+	return NULL;
+    }
+    p = mm_realloc(ptr, size);
+    num_reallocs++;
+    unlock_heap();
+    if (p == NULL && size > 0)
+	errno = ENOMEM;
+    return p;
+}
+
+EXPORT void *reallocarray(void *ptr, size_t n, size_t size)
+{
+    if (__builtin_mul_overflow(n, size, &size)) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    return realloc(ptr, size);
+}
+
+EXPORT int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (align < sizeof(void *) || (align & (align - 1)) != 0)
+	return EINVAL;
+    if ((p = aligned(align, size)) == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+EXPORT void *aligned_alloc(size_t align, size_t size)
+{
+    if ((align & (align - 1)) != 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+    return aligned(align, size);
+}
+
+EXPORT void *memalign(size_t align, size_t size)
+{
+    return aligned_alloc(align, size);
+}
+
+EXPORT void *valloc(size_t size)
+{
+    return aligned(mem_pagesize(), size);
+}
+
+EXPORT void *pvalloc(size_t size)
+{
+    size_t page = mem_pagesize();
+
+    return aligned(page, (size + page - 1) & ~(page - 1));
+}
+
+EXPORT size_t malloc_usable_size(void *ptr)
+{
+    size_t size;
+
+    if (ptr == NULL)
+	return 0;
+    if (in_boot(ptr))
+	return *((size_t *)ptr - 2);
+    lock_heap();
+    size = in_heap(ptr) ? mm_usable_size(ptr) : 0;
+    unlock_heap();
+    return size;
+}
+
+/*****************
+ * Helper functions
+ *****************/
+
+/*
+ * lock_heap - take the heap lock, creating the heap on first use (which
+ *     may be before the constructor runs: the dynamic linker and libc
+ *     allocate while they start up)
+ */
+static void lock_heap(void)
+{
+    pthread_mutex_lock(&heap_lock);
+    inside = 1;
+    if (!heap_ready) {
+	mem_init();
+	if (mm_init() < 0) {
+	    fprintf(stderr, "mmalloc: mm_init failed\n");
+	    abort();
+	}
+	heap_lo = mem_heap_lo();
+	heap_end = heap_lo + MAX_HEAP;
+	heap_ready = 1;
+    }
+}
+
+static void unlock_heap(void)
+{
+    inside = 0;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+/*
+ * boot_alloc - serve a request made from inside the library. Blocks are
+ *     never freed; each is preceded by its size, for realloc.
+ */
+static void *boot_alloc(size_t size)
+{
+    size_t need;
+    char *p;
+
+    need = BOOTALIGN + ((size + BOOTALIGN - 1) & ~(size_t)(BOOTALIGN - 1));
+    if (size > BOOTSIZE ||
+	(p = __atomic_fetch_add(&bootused, need, __ATOMIC_RELAXED) + bootbuf) +
+	need > bootbuf + BOOTSIZE) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    *(size_t *)p = size;
+    return p + BOOTALIGN;
+}
+
+static int in_boot(void *ptr)
+{
+    return (char *)ptr >= bootbuf && (char *)ptr < bootbuf + BOOTSIZE;
+}
+
+/*
+ * in_heap - is ptr in the heap (with the lock held)? Anything else was
+ *     allocated before the library was loaded, and is never ours to free.
+ */
+static int in_heap(void *ptr)
+{
+    return (char *)ptr >= heap_lo && (char *)ptr < heap_end;
+}
+
+/*
+ * aligned - allocate size bytes at a multiple of align (a power of two)
+ */
+static void *aligned(size_t align, size_t size)
+{
+    void *p;
+
+    if (inside)
+	return align <= BOOTALIGN ? boot_alloc(size) : NULL;
+    lock_heap();
+    p = mm_memalign(align, size);
+    num_mallocs++;
+    unlock_heap();
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+/*
+ * fork_prepare, fork_parent, fork_child - hold the lock across fork, so
+ *     that no other thread is halfway through a request when the heap is
+ *     copied. The child has only the forking thread, and carries on with
+ *     its copy of the heap.
+ */
+static void fork_prepare(void)
+{
+    lock_heap();
+}
+
+static void fork_parent(void)
+{
+    unlock_heap();
+}
+
+static void fork_child(void)
+{
+    inside = 0;
+    pthread_mutex_init(&heap_lock, NULL);
+}
+
+/*
+ * mmalloc_init - set up fork handling and read the options
+ */
+static void __attribute__((constructor)) mmalloc_init(void)
+{
+    char *stats = getenv("MMALLOC_STATS");
+
+    print_stats = stats != NULL && *stats != '\0' && *stats != '0';
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+/*
+ * mmalloc_fini - print the statistics
+ */
+static void __attribute__((destructor)) mmalloc_fini(void)
+{
+    unsigned long counts[4];
+    size_t heapsize;
+
+    if (!print_stats)
+	return;
+    lock_heap();
+    counts[0] = num_mallocs;
+    counts[1] = num_frees;
+    counts[2] = num_reallocs;
+    counts[3] = num_foreign;
+    heapsize = mem_heapsize();
+    unlock_heap();
+    fprintf(stderr, "mmalloc[%d]: %lu mallocs, %lu frees, %lu reallocs, "
+	    "%lu foreign, heap %.1f MB\n", (int)getpid(), counts[0],
+	    counts[1], counts[2], counts[3], heapsize / 1048576.0);
+}
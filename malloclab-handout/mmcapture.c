@@ -0,0 +1,726 @@
+/*
+ * mmcapture.c - Record the allocation requests of a real program
+ *
+ *     unix> LD_PRELOAD=./mmcapture.so MMCAPTURE=prog.bin prog args...
+ *     unix> mdriver -V -f prog.bin
+ *
+ * The library interposes malloc, calloc, realloc, free and the aligned
+ * allocation functions, and writes every request of the program to a
+ * binary tracefile (see trace.h) when it exits. MMCAPTURE names the
+ * file, with %p replaced by the process id (default mmcapture.%p.bin);
+ * programs started by the program are captured to their own file if
+ * the name has a %p. tracez -d turns a trace into a .rep.
+ *
+ * Each block gets the next id when it is allocated; a sharded hash
+ * table maps its address to its id for realloc and free. Requests are
+ * stamped with a global sequence number and appended to a buffer of
+ * the calling thread, so threads do not contend on the hot path. Full
+ * buffers are handed to a writer thread that appends them to a raw
+ * file next to the trace. At exit the raw records are put back in
+ * sequence order and written out as the trace. Each request keeps the
+ * id of its thread (in the order the threads first allocated, the
+ * 256th and later ones sharing the last id), for mdriver -C.
+ *
+ * Frees of blocks the library has not seen (allocated before it was
+ * loaded) are ignored, and so are the requests of forked children.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+#define CAPBUFSIZE   4096     /* records per thread buffer */
+#define CAPSHARDS     256     /* shards of the address table */
+#define BOOTSIZE    65536     /* bytes served while resolving libc */
+
+#define TLS __attribute__((tls_model("initial-exec"))) __thread
+
+/* A request and its place in the global order */
+typedef struct {
+    uint64_t seq;
+    traceop_t op;
+} caprec_t;
+
+/* A buffer of records, owned by one thread until it is full */
+typedef struct capbuf {
+    caprec_t recs[CAPBUFSIZE];
+    int count;
+    struct capbuf *next;      /* in the writer queue or the free list */
+} capbuf_t;
+
+/* Capture state of a thread */
+typedef struct capthread {
+    capbuf_t *buf;            /* buffer being filled (NULL if none) */
+    int busy;                 /* set while a record is being added */
+    uint8_t id;               /* thread id in the trace */
+    struct capthread *next;   /* all threads that recorded something */
+} capthread_t;
+
+/* One shard of the address -> id table (open addressing) */
+typedef struct {
+    pthread_mutex_t lock;
+    uintptr_t *keys;          /* addresses (0: empty slot) */
+    uint32_t *ids;
+    size_t capacity, count;
+} capshard_t;
+
+/* The functions of the next library (libc) */
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+
+/* Bump allocator used while dlsym resolves the functions above */
+static char bootbuf[BOOTSIZE];
+static size_t bootused;
+static int resolving;
+
+/* Capture state */
+static int capturing;         /* set once the library is initialized */
+static int stopped;           /* set at exit, or in a forked child */
+static pid_t owner;           /* the captured process */
+static uint32_t next_id;      /* next block id */
+static uint64_t next_seq;     /* next sequence number */
+static int next_thread;       /* next thread id */
+static char out_path[4096];   /* the trace... */
+static char raw_path[4200];   /* ... and the raw records behind it */
+static int raw_fd = -1;
+static capshard_t shards[CAPSHARDS];
+
+/* Threads, and the buffers between them and the writer */
+static pthread_mutex_t cap_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cap_cond = PTHREAD_COND_INITIALIZER;
+static capthread_t *threads;  /* every capthread_t (never freed) */
+static capbuf_t *full_head, *full_tail; /* buffers to write */
+static capbuf_t *free_bufs;   /* written buffers, for reuse */
+static int writer_done;       /* asks the writer to finish */
+static pthread_t writer;
+static pthread_key_t thread_key;
+
+static TLS capthread_t *self; /* this thread's capture state */
+static TLS int inside;        /* set while in the library's own code */
+
+static void resolve(void);
+static void record(int type, uint32_t id, uint64_t size, uint64_t seq);
+static void new_block(void *ptr, size_t size);
+static int forget_block(void *ptr, uint32_t *id);
+static void put_id(void *ptr, uint32_t id);
+static capbuf_t *get_buffer(void);
+static void queue_buffer(capbuf_t *buf);
+static void *write_buffers(void *arg);
+static void thread_exit(void *arg);
+static void child_after_fork(void);
+static void write_trace(void);
+static void write_all(int fd, const void *data, size_t len);
+
+/*****************
+ * The interposed functions
+ *****************/
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (real_malloc == NULL)
+	resolve();
+    if (resolving)
+	return calloc(1, size);
+    if (!capturing || inside)
+	return real_malloc(size);
+    inside = 1;
+    if ((p = real_malloc(size)) != NULL)
+	new_block(p, size);
+    inside = 0;
+    return p;
+}
+
+void *calloc(size_t n, size_t size)
+{
+    void *p;
+
+    /* dlsym may call calloc before the real one is known */
+    if (resolving) {
+	size = (n * size + 15) & ~(size_t)15;
+	if (bootused + size > BOOTSIZE)
+	    return NULL;
+	p = bootbuf + bootused;
+	bootused += size;
+	return p;
+    }
+    if (real_calloc == NULL)
+	resolve();
+    if (!capturing || inside)
+	return real_calloc(n, size);
+    inside = 1;
+    if ((p = real_calloc(n, size)) != NULL)
+	new_block(p, n * size);
+    inside = 0;
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    uint32_t id;
+    uint64_t seq;
+    void *p;
+
+    if (ptr == NULL)
+	return malloc(size);
+    if (real_realloc == NULL)
+	resolve();
+    if ((char *)ptr >= bootbuf && (char *)ptr < bootbuf + BOOTSIZE) {
+	if ((p = malloc(size)) != NULL)
+	    memcpy(p, ptr, bootbuf + BOOTSIZE - (char *)ptr < (long)size ?
+		   (size_t)(bootbuf + BOOTSIZE - (char *)ptr) : size);
+	return p;
+    }
+    if (!capturing || inside)
+	return real_realloc(ptr, size);
+
+    inside = 1;
+    if (!forget_block(ptr, &id)) {
+	/* A block we have not seen: record the result as a new block */
+	if ((p = real_realloc(ptr, size)) != NULL)
+	    new_block(p, size);
+    }
+    else if (size == 0) {
+	/* Frees the block (glibc) */
+	record(FREE, id, 0, __atomic_fetch_add(&next_seq, 1, __ATOMIC_SEQ_CST));
+	p = real_realloc(ptr, size);
+    }
+    else {
+	/* Ordered before any request for the address ptr frees */
+	seq = __atomic_fetch_add(&next_seq, 1, __ATOMIC_SEQ_CST);
+	if ((p = real_realloc(ptr, size)) != NULL) {
+	    put_id(p, id);
+	    record(REALLOC, id, size, seq);
+	}
+	else
+	    put_id(ptr, id);   /* the block is left as it was */
+    }
+    inside = 0;
+    return p;
+}
+
+void free(void *ptr)
+{
+    uint32_t id;
+
+    if (ptr == NULL ||
+	((char *)ptr >= bootbuf && (char *)ptr < bootbuf + BOOTSIZE))
+	return;
+    if (real_free == NULL)
+	resolve();
+    if (capturing && !inside) {
+	inside = 1;
+	if (forget_block(ptr, &id))
+	    record(FREE, id, 0,
+		   __atomic_fetch_add(&next_seq, 1, __ATOMIC_SEQ_CST));
+	inside = 0;
+    }
+    real_free(ptr);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    int err;
+
+    if (real_posix_memalign == NULL)
+	resolve();
+    if (!capturing || inside)
+	return real_posix_memalign(ptr, alignment, size);
+    inside = 1;
+    if ((err = real_posix_memalign(ptr, alignment, size)) == 0)
+	new_block(*ptr, size);
+    inside = 0;
+    return err;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (real_aligned_alloc == NULL)
+	resolve();
+    if (!capturing || inside)
+	return real_aligned_alloc(alignment, size);
+    inside = 1;
+    if ((p = real_aligned_alloc(alignment, size)) != NULL)
+	new_block(p, size);
+    inside = 0;
+    return p;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (real_memalign == NULL)
+	resolve();
+    if (!capturing || inside)
+	return real_memalign(alignment, size);
+    inside = 1;
+    if ((p = real_memalign(alignment, size)) != NULL)
+	new_block(p, size);
+    inside = 0;
+    return p;
+}
+
+/*****************
+ * Start and end of the capture
+ *****************/
+
+/*
+ * capture_init - open the raw file and start the writer. Runs when the
+ *     library is loaded.
+ */
+static void __attribute__((constructor)) capture_init(void)
+{
+    char *path = getenv("MMCAPTURE");
+    char *p;
+    size_t len;
+    int i;
+
+    resolve();
+    inside = 1;
+    owner = getpid();
+    if (path == NULL || *path == '\0')
+	path = "mmcapture.%p.bin";
+    for (p = path, len = 0; *p && len < sizeof(out_path) - 16; p++)
+	if (p[0] == '%' && p[1] == 'p') {
+	    len += sprintf(out_path + len, "%d", (int)owner);
+	    p++;
+	}
+	else
+	    out_path[len++] = *p;
+    out_path[len] = '\0';
+    snprintf(raw_path, sizeof(raw_path), "%s.%d.raw", out_path, (int)owner);
+    if ((raw_fd = open(raw_path, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0) {
+	fprintf(stderr, "mmcapture: cannot create %s: %s\n", raw_path,
+		strerror(errno));
+	inside = 0;
+	return;
+    }
+
+    for (i = 0; i < CAPSHARDS; i++)
+	pthread_mutex_init(&shards[i].lock, NULL);
+    pthread_key_create(&thread_key, thread_exit);
+    pthread_atfork(NULL, NULL, child_after_fork);
+    if (pthread_create(&writer, NULL, write_buffers, NULL) != 0) {
+	fprintf(stderr, "mmcapture: cannot start the writer thread\n");
+	close(raw_fd);
+	unlink(raw_path);
+	inside = 0;
+	return;
+    }
+    capturing = 1;
+    inside = 0;
+}
+
+/*
+ * capture_fini - stop recording, flush every buffer and write the
+ *     trace. Runs when the program exits.
+ */
+static void __attribute__((destructor)) capture_fini(void)
+{
+    capthread_t *t, *all;
+
+    if (!capturing || getpid() != owner)
+	return;
+    inside = 1;
+
+    /*
+     * No new records; wait for the ones being added. A thread that is
+     * busy may need cap_lock to get or queue a buffer, so it is not held
+     * while waiting. Threads are only ever added at the head of the
+     * list, and those added after stopped is set never record.
+     */
+    __atomic_store_n(&stopped, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&cap_lock);
+    all = threads;
+    pthread_mutex_unlock(&cap_lock);
+    for (t = all; t != NULL; t = t->next)
+	while (__atomic_load_n(&t->busy, __ATOMIC_SEQ_CST))
+	    sched_yield();
+
+    /* Queue what is left in their buffers */
+    pthread_mutex_lock(&cap_lock);
+    for (t = all; t != NULL; t = t->next) {
+	if (t->buf != NULL && t->buf->count > 0) {
+	    t->buf->next = NULL;
+	    if (full_tail != NULL)
+		full_tail->next = t->buf;
+	    else
+		full_head = t->buf;
+	    full_tail = t->buf;
+	    t->buf = NULL;
+	}
+    }
+    writer_done = 1;
+    pthread_cond_broadcast(&cap_cond);
+    pthread_mutex_unlock(&cap_lock);
+    pthread_join(writer, NULL);
+    capturing = 0;
+
+    write_trace();
+    inside = 0;
+}
+
+/*
+ * child_after_fork - a forked child does not record (the writer thread
+ *     is not running in it)
+ */
+static void child_after_fork(void)
+{
+    stopped = 1;
+    capturing = 0;
+}
+
+/*
+ * resolve - look up the functions of libc that the library wraps
+ */
+static void resolve(void)
+{
+    resolving = 1;
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    resolving = 0;
+    if (real_malloc == NULL || real_calloc == NULL ||
+	real_realloc == NULL || real_free == NULL) {
+	fprintf(stderr, "mmcapture: cannot find the libc allocator\n");
+	_exit(1);
+    }
+}
+
+/*****************
+ * Recording
+ *****************/
+
+/*
+ * new_block - give the new block at ptr an id and record its allocation
+ */
+static void new_block(void *ptr, size_t size)
+{
+    uint32_t id = __atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED);
+
+    put_id(ptr, id);
+    record(ALLOC, id, size,
+	   __atomic_fetch_add(&next_seq, 1, __ATOMIC_SEQ_CST));
+}
+
+/*
+ * record - add a request to the calling thread's buffer
+ */
+static void record(int type, uint32_t id, uint64_t size, uint64_t seq)
+{
+    caprec_t *rec;
+
+    if (self == NULL) {
+	if ((self = real_calloc(1, sizeof(capthread_t))) == NULL)
+	    return;
+	pthread_setspecific(thread_key, self);
+	pthread_mutex_lock(&cap_lock);
+	self->id = next_thread < TRACE_THREADS ? next_thread++ : 
+	    TRACE_THREADS - 1;
+	self->next = threads;
+	threads = self;
+	pthread_mutex_unlock(&cap_lock);
+    }
+
+    /* capture_fini waits for busy to clear once it has set stopped */
+    __atomic_store_n(&self->busy, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&stopped, __ATOMIC_SEQ_CST)) {
+	__atomic_store_n(&self->busy, 0, __ATOMIC_RELEASE);
+	return;
+    }
+    if (self->buf == NULL && (self->buf = get_buffer()) == NULL) {
+	__atomic_store_n(&self->busy, 0, __ATOMIC_RELEASE);
+	return;
+    }
+    rec = &self->buf->recs[self->buf->count++];
+    memset(rec, 0, sizeof(*rec));
+    rec->seq = seq;
+    rec->op.type = type;
+    rec->op.index = id;
+    rec->op.size = size;
+    rec->op.thread = self->id;
+    if (self->buf->count == CAPBUFSIZE) {
+	queue_buffer(self->buf);
+	self->buf = NULL;
+    }
+    __atomic_store_n(&self->busy, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * thread_exit - hand the buffer of an exiting thread to the writer
+ */
+static void thread_exit(void *arg)
+{
+    capthread_t *t = (capthread_t *)arg;
+
+    __atomic_store_n(&t->busy, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&stopped, __ATOMIC_SEQ_CST) && t->buf != NULL) {
+	queue_buffer(t->buf);
+	t->buf = NULL;
+    }
+    __atomic_store_n(&t->busy, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * get_buffer - return an empty buffer, reusing written ones
+ */
+static capbuf_t *get_buffer(void)
+{
+    capbuf_t *buf;
+
+    pthread_mutex_lock(&cap_lock);
+    if ((buf = free_bufs) != NULL)
+	free_bufs = buf->next;
+    pthread_mutex_unlock(&cap_lock);
+    if (buf == NULL && (buf = real_malloc(sizeof(capbuf_t))) == NULL)
+	return NULL;
+    buf->count = 0;
+    return buf;
+}
+
+/*
+ * queue_buffer - hand a buffer to the writer
+ */
+static void queue_buffer(capbuf_t *buf)
+{
+    pthread_mutex_lock(&cap_lock);
+    buf->next = NULL;
+    if (full_tail != NULL)
+	full_tail->next = buf;
+    else
+	full_head = buf;
+    full_tail = buf;
+    pthread_cond_signal(&cap_cond);
+    pthread_mutex_unlock(&cap_lock);
+}
+
+/*
+ * write_buffers - body of the writer thread: append queued buffers to
+ *     the raw file until capture_fini says the queue is complete
+ */
+static void *write_buffers(void *arg)
+{
+    capbuf_t *buf;
+
+    inside = 1;
+    pthread_mutex_lock(&cap_lock);
+    for (;;) {
+	while (full_head == NULL && !writer_done)
+	    pthread_cond_wait(&cap_cond, &cap_lock);
+	if ((buf = full_head) == NULL)
+	    break;
+	if ((full_head = buf->next) == NULL)
+	    full_tail = NULL;
+	pthread_mutex_unlock(&cap_lock);
+
+	write_all(raw_fd, buf->recs, buf->count * sizeof(caprec_t));
+
+	pthread_mutex_lock(&cap_lock);
+	buf->next = free_bufs;
+	free_bufs = buf;
+    }
+    pthread_mutex_unlock(&cap_lock);
+    return NULL;
+}
+
+/*
+ * write_trace - put the raw records in sequence order and write them to
+ *     the trace. Sequence numbers are dense (a few are lost to failed
+ *     reallocs), so each record goes straight to its place.
+ */
+static void write_trace(void)
+{
+    trace_bin_hdr_t hdr;
+    caprec_t *recs = NULL;
+    traceop_t *ops = NULL;
+    struct stat st;
+    size_t i, n, num_seqs, num_ops = 0;
+    int fd;
+
+    if (fstat(raw_fd, &st) < 0) {
+	fprintf(stderr, "mmcapture: cannot read %s\n", raw_path);
+	return;
+    }
+    n = st.st_size / sizeof(caprec_t);
+    num_seqs = next_seq;
+    if (n > 0 &&
+	((recs = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, 
+		      raw_fd, 0)) == MAP_FAILED ||
+	 (ops = mmap(NULL, num_seqs * sizeof(traceop_t), 
+		     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, 
+		     -1, 0)) == MAP_FAILED)) {
+	fprintf(stderr, "mmcapture: cannot map %s\n", raw_path);
+	return;
+    }
+
+    /* Scatter by sequence number, marking the places filled (arena) */
+    for (i = 0; i < n; i++)
+	if (recs[i].seq < num_seqs) {
+	    ops[recs[i].seq] = recs[i].op;
+	    ops[recs[i].seq].arena = 1;
+	}
+    for (i = 0; i < num_seqs && n > 0; i++)
+	if (ops[i].arena) {
+	    ops[num_ops] = ops[i];
+	    ops[num_ops++].arena = 0;
+	}
+
+    if ((fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+	fprintf(stderr, "mmcapture: cannot create %s: %s\n", out_path,
+		strerror(errno));
+	return;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = TRACE_BIN_MAGIC;
+    hdr.recsize = sizeof(traceop_t);
+    hdr.num_ids = next_id;
+    hdr.num_ops = num_ops;
+    hdr.weight = 1;
+    write_all(fd, &hdr, sizeof(hdr));
+    write_all(fd, ops, num_ops * sizeof(traceop_t));
+    close(fd);
+
+    if (n > 0) {
+	munmap(recs, st.st_size);
+	munmap(ops, num_seqs * sizeof(traceop_t));
+    }
+    close(raw_fd);
+    unlink(raw_path);
+}
+
+/*
+ * write_all - write len bytes, retrying short writes
+ */
+static void write_all(int fd, const void *data, size_t len)
+{
+    const char *p = (const char *)data;
+    ssize_t n;
+
+    while (len > 0) {
+	if ((n = write(fd, p, len)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    fprintf(stderr, "mmcapture: write error: %s\n", strerror(errno));
+	    return;
+	}
+	p += n;
+	len -= n;
+    }
+}
+
+/*****************
+ * The address -> id table
+ *****************/
+
+#define SHARD(ptr) (&shards[((uintptr_t)(ptr) >> 4) % CAPSHARDS])
+#define HASH(key, cap) ((size_t)(((key) >> 4) * 0x9e3779b97f4a7c15ULL >> 8) \
+			& ((cap) - 1))
+
+/*
+ * put_id - map the address ptr to id
+ */
+static void put_id(void *ptr, uint32_t id)
+{
+    capshard_t *s = SHARD(ptr);
+    uintptr_t key = (uintptr_t)ptr;
+    uintptr_t *keys;
+    uint32_t *ids;
+    size_t i, j, cap;
+
+    pthread_mutex_lock(&s->lock);
+
+    /* Keep the load factor at most 1/2 */
+    if (2 * (s->count + 1) > s->capacity) {
+	cap = s->capacity ? 2 * s->capacity : 1024;
+	keys = real_calloc(cap, sizeof(uintptr_t));
+	ids = real_malloc(cap * sizeof(uint32_t));
+	if (keys == NULL || ids == NULL) {
+	    pthread_mutex_unlock(&s->lock);
+	    return;
+	}
+	for (i = 0; i < s->capacity; i++) {
+	    if (s->keys[i] == 0)
+		continue;
+	    for (j = HASH(s->keys[i], cap); keys[j] != 0; j = (j + 1) & (cap - 1))
+		;
+	    keys[j] = s->keys[i];
+	    ids[j] = s->ids[i];
+	}
+	real_free(s->keys);
+	real_free(s->ids);
+	s->keys = keys;
+	s->ids = ids;
+	s->capacity = cap;
+    }
+
+    for (i = HASH(key, s->capacity); s->keys[i] != 0 && s->keys[i] != key;
+	 i = (i + 1) & (s->capacity - 1))
+	;
+    if (s->keys[i] == 0)
+	s->count++;
+    s->keys[i] = key;
+    s->ids[i] = id;
+    pthread_mutex_unlock(&s->lock);
+}
+
+/*
+ * forget_block - remove the address ptr from the table. Returns 1 and
+ *     sets *id if it was there.
+ */
+static int forget_block(void *ptr, uint32_t *id)
+{
+    capshard_t *s = SHARD(ptr);
+    uintptr_t key = (uintptr_t)ptr;
+    size_t i, j, home, mask;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->capacity == 0) {
+	pthread_mutex_unlock(&s->lock);
+	return 0;
+    }
+    mask = s->capacity - 1;
+    for (i = HASH(key, s->capacity); s->keys[i] != key; i = (i + 1) & mask)
+	if (s->keys[i] == 0) {
+	    pthread_mutex_unlock(&s->lock);
+	    return 0;
+	}
+    *id = s->ids[i];
+
+    /* Shift the rest of the probe run back over the hole */
+    for (j = (i + 1) & mask; s->keys[j] != 0; j = (j + 1) & mask) {
+	home = HASH(s->keys[j], s->capacity);
+	if (((j - home) & mask) >= ((j - i) & mask)) {
+	    s->keys[i] = s->keys[j];
+	    s->ids[i] = s->ids[j];
+	    i = j;
+	}
+    }
+    s->keys[i] = 0;
+    s->count--;
+    pthread_mutex_unlock(&s->lock);
+    return 1;
+}
@@ -0,0 +1,99 @@
+/*
+ * model.c - Random distributions of sizes and lifetimes
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "model.h"
+
+/*
+ * model_sample - draw a value from a model
+ */
+uint64_t model_sample(model_t *m, uint64_t *rng)
+{
+    double u = model_uniform(rng);
+    double lo, hi, a, x;
+
+    switch (m->kind) {
+    case FIXED: /* one of the classes */
+	return m->classes[(int)(u * m->num_classes)];
+    case UNIFORM: /* between arg[0] and arg[1] */
+	return m->arg[0] + u * (m->arg[1] - m->arg[0] + 1);
+    case EXP: /* exponential with mean arg[0] */
+	return -m->arg[0] * log(1.0 - u);
+    case POWER: /* bounded power law: arg[0] to arg[1], exponent arg[2] */
+	lo = pow(m->arg[0], -m->arg[2]);
+	hi = pow(m->arg[1], -m->arg[2]);
+	return pow(lo - u * (lo - hi), -1.0 / m->arg[2]);
+    case BIMODAL: /* arg[0] or, with probability arg[2], arg[1], +-25% */
+	x = (model_uniform(rng) < m->arg[2]) ? m->arg[1] : m->arg[0];
+	a = x * (0.75 + 0.5 * u);
+	return (a < 1) ? 1 : a;
+    }
+    return 0;
+}
+
+/*
+ * model_uniform - next random number in [0, 1) (splitmix64)
+ */
+double model_uniform(uint64_t *rng)
+{
+    uint64_t z = (*rng += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * parse_model - parse a model (see model.h). Returns 0, or -1 if spec
+ *     is not a valid model.
+ */
+int parse_model(char *spec, model_t *m)
+{
+    char *args = strchr(spec, ':');
+    char *p;
+    int n = 0;
+
+    memset(m, 0, sizeof(*m));
+    if (args == NULL)
+	return -1;
+    args++;
+    if (!strncmp(spec, "fixed:", 6)) {
+	m->kind = FIXED;
+	for (p = args; *p && m->num_classes < MAXCLASSES; p++) {
+	    m->classes[m->num_classes++] = strtoull(p, &p, 0);
+	    if (*p != ',')
+		break;
+	}
+	if (m->num_classes == 0 || *p != '\0')
+	    return -1;
+	return 0;
+    }
+    if (!strncmp(spec, "uniform:", 8))
+	m->kind = UNIFORM, n = 2;
+    else if (!strncmp(spec, "exp:", 4))
+	m->kind = EXP, n = 1;
+    else if (!strncmp(spec, "power:", 6))
+	m->kind = POWER, n = 3;
+    else if (!strncmp(spec, "bimodal:", 8))
+	m->kind = BIMODAL, n = 3;
+    else
+	return -1;
+    if (sscanf(args, "%lf,%lf,%lf", &m->arg[0], &m->arg[1], &m->arg[2]) != n)
+	return -1;
+    if ((m->kind == UNIFORM || m->kind == POWER) &&
+	(m->arg[0] < 0 || m->arg[1] < m->arg[0]))
+	return -1;
+    if (m->kind == POWER && (m->arg[0] < 1 || m->arg[2] <= 0))
+	return -1;
+    if (m->kind == EXP && !(m->arg[0] > 0))
+	return -1;
+    if (m->kind == BIMODAL && (!(m->arg[0] > 0) || !(m->arg[1] > 0) ||
+			       !(m->arg[2] >= 0 && m->arg[2] <= 1)))
+	return -1;
+    return 0;
+}
@@ -0,0 +1,32 @@
+/*
+ * model.h - Random distributions of sizes and lifetimes, for the
+ *           programs that generate workloads (tracegen, pcbench)
+ *
+ * A model is written as:
+ *     fixed:<v>,<v>,...        one of the values, equally likely
+ *     uniform:<lo>,<hi>        uniform between lo and hi
+ *     exp:<mean>               exponential
+ *     power:<lo>,<hi>,<alpha>  bounded power law (Pareto)
+ *     bimodal:<a>,<b>,<p>      a, or b with probability p (+-25%)
+ * Values are drawn with a splitmix64 generator whose state belongs to
+ * the caller, so a seed always gives the same sequence.
+ */
+#ifndef __MODEL_H_
+#define __MODEL_H_
+
+#include <stdint.h>
+
+#define MAXCLASSES  64    /* max number of values of a fixed model */
+
+typedef struct {
+    enum {FIXED, UNIFORM, EXP, POWER, BIMODAL} kind;
+    double arg[3];                    /* parameters of the distribution */
+    uint64_t classes[MAXCLASSES];     /* values of a FIXED model */
+    int num_classes;
+} model_t;
+
+int parse_model(char *spec, model_t *m);
+uint64_t model_sample(model_t *m, uint64_t *rng);
+double model_uniform(uint64_t *rng);
+
+#endif /* __MODEL_H_ */
@@ -0,0 +1,241 @@
+/*
+ * mpbench.c - Multi-process benchmark of a shared mm heap
+ *
+ * The heap lives in a POSIX shared memory object (mem_init_shm). For
+ * 1, 2, 4, ... worker processes, every worker replays the same tracefile
+ * against that one heap at the same time, and the aggregate throughput
+ * is reported. Requests from different processes are serialized by the
+ * process-shared lock in mm.c.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "trace.h"
+
+/* Default benchmark parameters */
+#define DEF_PROCS      4   /* largest number of worker processes */
+#define DEF_REPS      10   /* replays of the trace by each worker */
+#define DEF_TRACE     "traces/amptjp-bal.rep"
+#define MAXLINE     1024   /* max string size */
+
+int verbose = 0;           /* needed by trace.c */
+
+static int replay(trace_t *trace, int reps, int check, int tag);
+static double run_workers(char *shmname, trace_t *trace, int procs,
+			  int reps, int check);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    char c;
+    char *tracefile = DEF_TRACE;
+    char shmname[MAXLINE];
+    int maxprocs = DEF_PROCS;
+    int reps = DEF_REPS;
+    int check = 0;
+    int procs;
+    double secs, ops;
+    trace_t *trace;
+
+    while ((c = getopt(argc, argv, "f:p:r:chv")) != EOF) {
+	switch (c) {
+	case 'f': /* Tracefile to replay (relative to curr dir) */
+	    tracefile = optarg;
+	    break;
+	case 'p': /* Largest number of worker processes */
+	    maxprocs = atoi(optarg);
+	    break;
+	case 'r': /* Replays of the trace by each worker */
+	    reps = atoi(optarg);
+	    break;
+	case 'c': /* Check payloads for corruption by other processes */
+	    check = 1;
+	    break;
+	case 'v': /* Print the tracefile name */
+	    verbose = 2;
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (maxprocs <= 0 || reps <= 0) {
+	usage();
+	exit(1);
+    }
+
+    trace = read_trace("./", tracefile);
+    sprintf(shmname, "/mpbench.%d", (int)getpid());
+
+    printf("%6s%12s%10s%10s%12s\n", "procs", "ops", "secs", "Kops", "heap");
+    for (procs = 1; procs <= maxprocs; procs *= 2) {
+	secs = run_workers(shmname, trace, procs, reps, check);
+	ops = (double)trace->num_ops * reps * procs;
+	printf("%6d%12.0f%10.6f%10.0f%12u\n",
+	       procs, ops, secs, (ops/1e3)/secs, (unsigned)mem_heapsize());
+	mem_deinit();
+	shm_unlink(shmname);
+    }
+
+    free_trace(trace);
+    exit(0);
+}
+
+/*
+ * run_workers - map a new shared heap, fork procs workers that replay
+ *     the trace on it at the same time, and return the elapsed seconds
+ */
+static double run_workers(char *shmname, trace_t *trace, int procs,
+			  int reps, int check)
+{
+    int i, status, failed = 0;
+    int go[2];
+    char dummy;
+    pid_t pid;
+    struct timeval stv, etv;
+
+    shm_unlink(shmname); /* start from an empty heap */
+    mem_init_shm(shmname, NULL);
+    if (mm_init() < 0) {
+	fprintf(stderr, "mpbench: mm_init failed\n");
+	exit(1);
+    }
+
+    /* Workers wait on the pipe so that they all start together */
+    fflush(stdout);
+    if (pipe(go) < 0) {
+	fprintf(stderr, "mpbench: pipe error: %s\n", strerror(errno));
+	exit(1);
+    }
+    for (i = 0; i < procs; i++) {
+	if ((pid = fork()) < 0) {
+	    fprintf(stderr, "mpbench: fork error: %s\n", strerror(errno));
+	    exit(1);
+	}
+	if (pid == 0) {
+	    close(go[1]);
+	    if (read(go[0], &dummy, 1) < 0)
+		exit(1);
+	    exit(replay(trace, reps, check, i + 1));
+	}
+    }
+    close(go[0]);
+
+    gettimeofday(&stv, NULL);
+    close(go[1]);
+    while (wait(&status) > 0)
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	    failed++;
+    gettimeofday(&etv, NULL);
+
+    if (failed) {
+	fprintf(stderr, "mpbench: %d of %d workers failed\n", failed, procs);
+	exit(1);
+    }
+    return (etv.tv_sec - stv.tv_sec) + 1E-6*(etv.tv_usec - stv.tv_usec);
+}
+
+/*
+ * replay - replay the trace reps times against the shared heap. With
+ *     check set, every payload is stamped with tag and verified before
+ *     it is freed. Returns 0 on success (the worker's exit status).
+ */
+static int replay(trace_t *trace, int reps, int check, int tag)
+{
+    int i, r, index, arena;
+    size_t j, size;
+    char *p;
+
+    for (r = 0; r < reps; r++) {
+	for (i = 0; i < trace->num_ops; i++) {
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    arena = trace->ops[i].arena;
+
+	    switch (trace->ops[i].type) {
+
+	    case ALLOC: /* mm_malloc */
+		if ((p = mm_malloc(size)) == NULL)
+		    return 1;
+		trace->blocks[index] = p;
+		trace->block_sizes[index] = size;
+		break;
+
+	    case REALLOC: /* mm_realloc */
+		if ((p = mm_realloc(trace->blocks[index], size)) == NULL)
+		    return 1;
+		trace->blocks[index] = p;
+		trace->block_sizes[index] = size;
+		break;
+
+	    case FREE: /* mm_free */
+		p = trace->blocks[index];
+		if (check) {
+		    for (j = 0; j < trace->block_sizes[index]; j++)
+			if (p[j] != (char)tag) {
+			    fprintf(stderr, "mpbench: worker %d: block %d "
+				    "was overwritten\n", tag, index);
+			    return 1;
+			}
+		}
+		mm_free(p);
+		break;
+
+	    case ARENA_CREATE: /* mm_arena_create */
+		if ((trace->arenas[arena] = mm_arena_create()) == NULL)
+		    return 1;
+		break;
+
+	    case ARENA_ALLOC: /* mm_arena_alloc */
+		if ((p = mm_arena_alloc(trace->arenas[arena], size)) == NULL)
+		    return 1;
+		trace->blocks[index] = p;
+		trace->block_sizes[index] = size;
+		break;
+
+	    case ARENA_RESET: /* mm_arena_reset */
+		mm_arena_reset(trace->arenas[arena]);
+		break;
+
+	    case ARENA_DESTROY: /* mm_arena_destroy */
+		mm_arena_destroy(trace->arenas[arena]);
+		break;
+	    }
+
+	    /* Stamp the (new) payload with this worker's tag */
+	    if (check && (trace->ops[i].type == ALLOC ||
+			  trace->ops[i].type == REALLOC))
+		memset(trace->blocks[index], tag, size);
+	}
+    }
+    return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mpbench [-chv] [-f <file>] [-p <procs>] "
+	    "[-r <reps>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-c          Check that no payload is overwritten.\n");
+    fprintf(stderr, "\t-f <file>   Replay <file> (default %s).\n", DEF_TRACE);
+    fprintf(stderr, "\t-h          Print this message.\n");
+    fprintf(stderr, "\t-p <procs>  Up to <procs> workers (default %d).\n",
+	    DEF_PROCS);
+    fprintf(stderr, "\t-r <reps>   Replays per worker (default %d).\n",
+	    DEF_REPS);
+    fprintf(stderr, "\t-v          Print additional info.\n");
+}
@@ -0,0 +1,454 @@
+/*
+ * pcbench.c - Producer/consumer benchmark: blocks allocated by one
+ *             thread and freed by another
+ *
+ * Producer threads allocate messages with sizes drawn from a model and
+ * pass them, round robin, to the consumer threads through one
+ * single-producer single-consumer ring per pair; the consumers free
+ * them. The same run is made with the mm heap (made thread safe with
+ * mm_set_threaded) and with libc malloc, and for each the benchmark
+ * reports:
+ *   - throughput: requests (mallocs and frees) per second, from the
+ *     first thread starting to the last one finishing
+ *   - latency: percentiles of single mallocs (by the producers) and
+ *     frees (by the consumers)
+ *   - heap growth: the peak heap size against the peak bytes in flight,
+ *     both sampled every millisecond while the threads run (blowup)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <float.h>
+#include <sched.h>
+#include <time.h>
+#include <malloc.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "latency.h"
+#include "model.h"
+
+/* Default benchmark parameters */
+#define DEF_PRODUCERS  2
+#define DEF_CONSUMERS  2
+#define DEF_MESSAGES   200000     /* messages sent by each producer */
+#define DEF_DEPTH      256        /* slots of each ring (a power of 2) */
+#define DEF_SIZE       "power:16,4096,1.2"
+#define SAMPLE_NS      1000000    /* heap sampling period */
+
+#define CACHELINE __attribute__((aligned(64)))
+
+int verbose = 0;           /* print the parameters */
+
+/* The start of every message; the rest of the block is its payload */
+typedef struct {
+    uint32_t size;                    /* of the whole message */
+    uint32_t producer;                /* who sent it */
+} msg_t;
+
+/*
+ * A ring of messages from one producer to one consumer. Each index is
+ * written by one side only, and they are in cache lines of their own.
+ */
+typedef struct {
+    msg_t **slots;
+    unsigned mask;                    /* slots - 1 */
+    CACHELINE unsigned head;          /* next slot to take (consumer) */
+    CACHELINE unsigned tail;          /* next slot to fill (producer) */
+} ring_t;
+
+/* A producer or consumer thread */
+typedef struct bench bench_t;
+typedef struct {
+    CACHELINE int id;
+    bench_t *bench;
+    uint64_t rng;                     /* state of the size model */
+    uint64_t bytes;                   /* bytes sent (or freed) so far */
+    lat_hist_t *lat;                  /* malloc (or free) latencies */
+    double begin, end;                /* when it started and finished */
+} worker_t;
+
+/* Parameters and state of a run */
+struct bench {
+    int producers, consumers;
+    long messages;                    /* per producer */
+    int use_libc;
+    model_t size;
+    ring_t *rings;                    /* [producer * consumers + consumer] */
+    worker_t *workers;                /* producers, then consumers */
+    pthread_barrier_t start;
+    int producers_done;               /* updated atomically */
+    int consumers_done;
+};
+
+/* Results of a run */
+typedef struct {
+    double secs;
+    lat_summary_t malloc_lat, free_lat;
+    double peak_live, peak_heap;      /* bytes */
+} result_t;
+
+static void run(bench_t *b, result_t *r);
+static void *producer(void *ptr);
+static void *consumer(void *ptr);
+static double now(void);
+static double heap_size(bench_t *b);
+static void print_result(char *name, result_t *r);
+static void *xmalloc(size_t size);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    char c;
+    char *size_spec = DEF_SIZE;
+    int depth = DEF_DEPTH;
+    int i;
+    uint64_t seed = 1;
+    bench_t b;
+    result_t r;
+
+    memset(&b, 0, sizeof(b));
+    b.producers = DEF_PRODUCERS;
+    b.consumers = DEF_CONSUMERS;
+    b.messages = DEF_MESSAGES;
+    while ((c = getopt(argc, argv, "p:c:n:d:S:s:hv")) != EOF) {
+	switch (c) {
+	case 'p': /* Number of producer threads */
+	    b.producers = atoi(optarg);
+	    break;
+	case 'c': /* Number of consumer threads */
+	    b.consumers = atoi(optarg);
+	    break;
+	case 'n': /* Messages sent by each producer */
+	    b.messages = atol(optarg);
+	    break;
+	case 'd': /* Slots of each ring */
+	    depth = atoi(optarg);
+	    break;
+	case 'S': /* Model of the message sizes */
+	    size_spec = optarg;
+	    break;
+	case 's': /* Random seed */
+	    seed = strtoull(optarg, NULL, 0);
+	    break;
+	case 'v': /* Print the parameters */
+	    verbose = 1;
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (b.producers <= 0 || b.consumers <= 0 || b.messages <= 0 ||
+	depth <= 0 || (depth & (depth - 1)) != 0) {
+	usage();
+	exit(1);
+    }
+    if (parse_model(size_spec, &b.size) < 0) {
+	fprintf(stderr, "pcbench: bad model %s\n", size_spec);
+	exit(1);
+    }
+
+    /* The rings and the threads' state */
+    b.rings = xmalloc(b.producers * b.consumers * sizeof(ring_t));
+    memset(b.rings, 0, b.producers * b.consumers * sizeof(ring_t));
+    for (i = 0; i < b.producers * b.consumers; i++) {
+	b.rings[i].slots = xmalloc(depth * sizeof(msg_t *));
+	b.rings[i].mask = depth - 1;
+    }
+    b.workers = xmalloc((b.producers + b.consumers) * sizeof(worker_t));
+    memset(b.workers, 0, (b.producers + b.consumers) * sizeof(worker_t));
+    for (i = 0; i < b.producers + b.consumers; i++) {
+	b.workers[i].id = i < b.producers ? i : i - b.producers;
+	b.workers[i].bench = &b;
+	b.workers[i].rng = seed + i;
+	b.workers[i].lat = xmalloc(sizeof(lat_hist_t));
+    }
+
+    lat_init();
+    mem_init();
+    if (verbose)
+	printf("%d producers, %d consumers, %ld messages each, %d slots "
+	       "a ring, sizes %s\n", b.producers, b.consumers, b.messages,
+	       depth, size_spec);
+    printf("%-6s%10s%24s%24s%10s%10s%8s\n", "", "",
+	   "malloc ns", "free ns", "", "", "");
+    printf("%-6s%10s%8s%8s%8s%8s%8s%8s%10s%10s%8s\n", "alloc", "Kops",
+	   "p50", "p99", "p99.9", "p50", "p99", "p99.9", "live KB",
+	   "heap KB", "blowup");
+    for (b.use_libc = 0; b.use_libc < 2; b.use_libc++) {
+	run(&b, &r);
+	print_result(b.use_libc ? "libc" : "mm", &r);
+    }
+    exit(0);
+}
+
+/*
+ * run - make one run with all the threads, sampling the bytes in flight
+ *     and the heap size until they are done
+ */
+static void run(bench_t *b, result_t *r)
+{
+    int i, n = b->producers + b->consumers;
+    pthread_t *threads = xmalloc(n * sizeof(pthread_t));
+    struct timespec period = {0, SAMPLE_NS};
+    lat_hist_t malloc_lat, free_lat;
+    double live, heap, heap0, begin, end;
+    uint64_t sent, freed;
+    int j;
+
+    memset(r, 0, sizeof(*r));
+    for (i = 0; i < b->producers * b->consumers; i++)
+	b->rings[i].head = b->rings[i].tail = 0;
+    for (i = 0; i < n; i++) {
+	b->workers[i].bytes = 0;
+	lat_clear(b->workers[i].lat);
+    }
+    b->producers_done = b->consumers_done = 0;
+    if (!b->use_libc) {
+	mem_reset_brk();
+	if (mm_init() < 0) {
+	    fprintf(stderr, "pcbench: mm_init failed\n");
+	    exit(1);
+	}
+	mm_set_threaded(1);
+    }
+    heap0 = heap_size(b);
+
+    pthread_barrier_init(&b->start, NULL, n);
+    for (i = 0; i < n; i++)
+	if ((errno = pthread_create(&threads[i], NULL,
+				    i < b->producers ? producer : consumer,
+				    &b->workers[i])) != 0) {
+	    fprintf(stderr, "pcbench: pthread_create: %s\n", strerror(errno));
+	    exit(1);
+	}
+
+    /* Sample while the threads run (and once more at the end) */
+    do {
+	nanosleep(&period, NULL);
+	sent = freed = 0;
+	for (i = 0; i < n; i++) {
+	    if (i < b->producers)
+		sent += __atomic_load_n(&b->workers[i].bytes, __ATOMIC_RELAXED);
+	    else
+		freed += __atomic_load_n(&b->workers[i].bytes, __ATOMIC_RELAXED);
+	}
+	live = sent > freed ? sent - freed : 0;
+	heap = heap_size(b) - heap0;
+	r->peak_live = live > r->peak_live ? live : r->peak_live;
+	r->peak_heap = heap > r->peak_heap ? heap : r->peak_heap;
+    } while (__atomic_load_n(&b->consumers_done, __ATOMIC_ACQUIRE) <
+	     b->consumers);
+
+    for (i = 0; i < n; i++)
+	pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&b->start);
+    if (!b->use_libc)
+	mm_set_threaded(0);
+
+    /* Merge the histograms and take the time of the whole run */
+    lat_clear(&malloc_lat);
+    lat_clear(&free_lat);
+    begin = DBL_MAX;
+    end = 0;
+    for (i = 0; i < n; i++) {
+	lat_hist_t *to = i < b->producers ? &malloc_lat : &free_lat;
+
+	for (j = 0; j < LAT_BUCKETS; j++)
+	    to->counts[j] += b->workers[i].lat->counts[j];
+	to->count += b->workers[i].lat->count;
+	if (b->workers[i].lat->max > to->max)
+	    to->max = b->workers[i].lat->max;
+	begin = b->workers[i].begin < begin ? b->workers[i].begin : begin;
+	end = b->workers[i].end > end ? b->workers[i].end : end;
+    }
+    lat_summarize(&malloc_lat, &r->malloc_lat);
+    lat_summarize(&free_lat, &r->free_lat);
+    r->secs = end - begin;
+    free(threads);
+}
+
+/*
+ * producer - allocate the messages, fill in their header and pass them
+ *     to the consumers in turn, waiting while a ring is full
+ */
+static void *producer(void *ptr)
+{
+    worker_t *w = (worker_t *)ptr;
+    bench_t *b = w->bench;
+    ring_t *ring;
+    msg_t *msg;
+    uint64_t size, t0;
+    long i;
+
+    pthread_barrier_wait(&b->start);
+    w->begin = now();
+    for (i = 0; i < b->messages; i++) {
+	size = model_sample(&b->size, &w->rng);
+	if (size < sizeof(msg_t))
+	    size = sizeof(msg_t);
+	t0 = lat_now();
+	msg = b->use_libc ? malloc(size) : mm_malloc(size);
+	lat_record(w->lat, lat_now() - t0);
+	if (msg == NULL) {
+	    fprintf(stderr, "pcbench: out of memory after %ld messages\n", i);
+	    exit(1);
+	}
+	msg->size = size;
+	msg->producer = w->id;
+
+	ring = &b->rings[w->id * b->consumers + i % b->consumers];
+	while (ring->tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >
+	       ring->mask)
+	    sched_yield();
+	ring->slots[ring->tail & ring->mask] = msg;
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&w->bytes, w->bytes + size, __ATOMIC_RELAXED);
+    }
+    w->end = now();
+    __atomic_add_fetch(&b->producers_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/*
+ * consumer - take the messages of every producer and free them, until
+ *     all the producers are done and the rings are empty
+ */
+static void *consumer(void *ptr)
+{
+    worker_t *w = (worker_t *)ptr;
+    bench_t *b = w->bench;
+    ring_t *ring;
+    msg_t *msg;
+    uint64_t t0;
+    int p, taken, done;
+
+    pthread_barrier_wait(&b->start);
+    w->begin = now();
+    do {
+	done = __atomic_load_n(&b->producers_done, __ATOMIC_ACQUIRE) ==
+	    b->producers;
+	taken = 0;
+	for (p = 0; p < b->producers; p++) {
+	    ring = &b->rings[p * b->consumers + w->id];
+	    while (ring->head != __atomic_load_n(&ring->tail,
+						 __ATOMIC_ACQUIRE)) {
+		msg = ring->slots[ring->head & ring->mask];
+		__atomic_store_n(&ring->head, ring->head + 1,
+				 __ATOMIC_RELEASE);
+		if (msg->producer != (uint32_t)p) {
+		    fprintf(stderr, "pcbench: message from producer %d was "
+			    "overwritten\n", p);
+		    exit(1);
+		}
+		__atomic_store_n(&w->bytes, w->bytes + msg->size,
+				 __ATOMIC_RELAXED);
+		t0 = lat_now();
+		if (b->use_libc)
+		    free(msg);
+		else
+		    mm_free(msg);
+		lat_record(w->lat, lat_now() - t0);
+		taken++;
+	    }
+	}
+	if (taken == 0 && !done)
+	    sched_yield();
+    } while (taken > 0 || !done);
+    w->end = now();
+    __atomic_add_fetch(&b->consumers_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/*
+ * now - the monotonic clock, in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/*
+ * heap_size - the bytes the allocator has taken from the system: the
+ *     simulated heap for mm, all the arenas and mappings for libc
+ */
+static double heap_size(bench_t *b)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 mi;
+#else
+    struct mallinfo mi;
+#endif
+
+    if (!b->use_libc)
+	return mem_heapsize();
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    mi = mallinfo2();
+#else
+    mi = mallinfo();
+#endif
+    return (double)mi.arena + mi.hblkhd;
+}
+
+/*
+ * print_result - one line of the results table
+ */
+static void print_result(char *name, result_t *r)
+{
+    double ops = 2.0 * r->malloc_lat.count;
+
+    printf("%-6s%10.0f%8.0f%8.0f%8.0f%8.0f%8.0f%8.0f%10.0f%10.0f%8.2f\n",
+	   name, ops / 1e3 / r->secs,
+	   r->malloc_lat.p50, r->malloc_lat.p99, r->malloc_lat.p999,
+	   r->free_lat.p50, r->free_lat.p99, r->free_lat.p999,
+	   r->peak_live / 1024, r->peak_heap / 1024,
+	   r->peak_live > 0 ? r->peak_heap / r->peak_live : 0);
+}
+
+/*
+ * xmalloc - malloc or die, at the start of a cache line
+ */
+static void *xmalloc(size_t size)
+{
+    void *p;
+
+    if (posix_memalign(&p, 64, size) != 0) {
+	fprintf(stderr, "pcbench: out of memory\n");
+	exit(1);
+    }
+    return p;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: pcbench [-hv] [-p <producers>] [-c <consumers>] "
+	    "[-n <messages>]\n"
+	    "               [-d <depth>] [-S <model>] [-s <seed>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-c <n>      <n> consumer threads (default %d).\n",
+	    DEF_CONSUMERS);
+    fprintf(stderr, "\t-d <depth>  Messages a ring holds, a power of 2 "
+	    "(default %d).\n", DEF_DEPTH);
+    fprintf(stderr, "\t-h          Print this message.\n");
+    fprintf(stderr, "\t-n <n>      Messages sent by each producer "
+	    "(default %d).\n", DEF_MESSAGES);
+    fprintf(stderr, "\t-p <n>      <n> producer threads (default %d).\n",
+	    DEF_PRODUCERS);
+    fprintf(stderr, "\t-s <seed>   Random seed (default 1).\n");
+    fprintf(stderr, "\t-S <model>  Message sizes, as in tracegen "
+	    "(default %s).\n", DEF_SIZE);
+    fprintf(stderr, "\t-v          Print the parameters.\n");
+}
@@ -0,0 +1,159 @@
+/*
+ * perfctr.c - Hardware performance counters of the driver process,
+ *             through perf_event_open(2)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+/* A generic cache event: cache, read accesses, misses */
+#define CACHE_MISSES(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+			     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/* The events, by PERF_* index */
+static struct {
+    uint32_t type;
+    uint64_t config;
+    char *name;
+} events[PERF_NEVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instrs"},
+    {PERF_TYPE_HW_CACHE, CACHE_MISSES(PERF_COUNT_HW_CACHE_L1D), "L1d-miss"},
+    {PERF_TYPE_HW_CACHE, CACHE_MISSES(PERF_COUNT_HW_CACHE_LL), "LLC-miss"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "br-miss"},
+    {PERF_TYPE_HW_CACHE, CACHE_MISSES(PERF_COUNT_HW_CACHE_DTLB), "dTLB-miss"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "faults"},
+};
+
+static int fds[PERF_NEVENTS];      /* descriptor of each event, or -1 */
+static int slot[PERF_NEVENTS];     /* its place in a group reading */
+static int leader = -1;            /* descriptor of the group leader */
+static char error[256];            /* why the first missing event is */
+
+static int open_event(int event, int group);
+
+/*
+ * perf_open - open a counter for each event the system provides, all in
+ *     one group, disabled. Returns the number of events opened.
+ */
+int perf_open(void)
+{
+    int i, n = 0;
+
+    error[0] = '\0';
+    for (i = 0; i < PERF_NEVENTS; i++) {
+	slot[i] = -1;
+	if ((fds[i] = open_event(i, leader)) < 0) {
+	    if (error[0] == '\0')
+		snprintf(error, sizeof(error), "%s: %s", events[i].name,
+			 strerror(errno));
+	    continue;
+	}
+	if (leader < 0)
+	    leader = fds[i];
+	slot[i] = n++;
+    }
+    return n;
+}
+
+/*
+ * perf_name - the column name of an event
+ */
+char *perf_name(int event)
+{
+    return events[event].name;
+}
+
+/*
+ * perf_error - why the first event that could not be opened was not
+ *     (empty if all were)
+ */
+char *perf_error(void)
+{
+    return error;
+}
+
+/*
+ * perf_start, perf_stop - start and stop counting (the counts are kept)
+ */
+void perf_start(void)
+{
+    if (leader >= 0)
+	ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_stop(void)
+{
+    if (leader >= 0)
+	ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/*
+ * perf_read_raw - read all the counters of the group
+ */
+void perf_read_raw(perf_raw_t *raw)
+{
+    memset(raw, 0, sizeof(perf_raw_t));
+    if (leader >= 0 && read(leader, raw, sizeof(perf_raw_t)) < 0)
+	memset(raw, 0, sizeof(perf_raw_t));
+}
+
+/*
+ * perf_counts - the counts between two readings. If the group was only
+ *     scheduled part of the time (the kernel multiplexes counters when
+ *     there are more events than hardware counters), the counts are
+ *     scaled up to the whole time.
+ */
+void perf_counts(perf_raw_t *from, perf_raw_t *to, perf_counts_t *counts)
+{
+    uint64_t enabled = to->enabled - from->enabled;
+    uint64_t running = to->running - from->running;
+    double scale = 1.0;
+    int i;
+
+    if (running > 0 && running < enabled)
+	scale = (double)enabled / running;
+    for (i = 0; i < PERF_NEVENTS; i++)
+	counts->counts[i] = slot[i] < 0 ? PERF_MISSING :
+	    scale * (to->values[slot[i]] - from->values[slot[i]]);
+}
+
+/*
+ * perf_close - close all the counters
+ */
+void perf_close(void)
+{
+    int i;
+
+    for (i = 0; i < PERF_NEVENTS; i++)
+	if (fds[i] >= 0)
+	    close(fds[i]);
+    leader = -1;
+}
+
+/*
+ * open_event - open a counter of one event of this process, in user
+ *     space only, as a member of group (or as the leader if group is -1)
+ */
+static int open_event(int event, int group)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[event].type;
+    attr.config = events[event].config;
+    attr.disabled = group < 0;      /* members follow the leader */
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+	PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
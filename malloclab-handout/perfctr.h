@@ -0,0 +1,42 @@
+/*
+ * perfctr.h - Hardware performance counters of the driver process
+ *
+ * The counters are opened with perf_event_open as one group, so they
+ * count over exactly the same instructions and can be read together
+ * with one system call. Only user-space events are counted. Events the
+ * machine or the kernel does not provide (in a virtual machine, or with
+ * a strict kernel.perf_event_paranoid) are left out and reported as
+ * missing, and the driver goes on without them.
+ */
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+#include <stdint.h>
+
+/* The events, in the order of their columns */
+enum {PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1D_MISSES, PERF_LLC_MISSES,
+      PERF_BRANCH_MISSES, PERF_DTLB_MISSES, PERF_PAGE_FAULTS, PERF_NEVENTS};
+
+/* A reading of all the events (PERF_MISSING for those not counted) */
+#define PERF_MISSING (-1.0)
+typedef struct {
+    double counts[PERF_NEVENTS];
+} perf_counts_t;
+
+/* Raw values of the group, as read from the kernel */
+typedef struct {
+    uint64_t nr;                      /* number of events in the group */
+    uint64_t enabled, running;        /* times, for multiplexing */
+    uint64_t values[PERF_NEVENTS];
+} perf_raw_t;
+
+int perf_open(void);
+char *perf_name(int event);
+char *perf_error(void);
+void perf_start(void);
+void perf_stop(void);
+void perf_read_raw(perf_raw_t *raw);
+void perf_counts(perf_raw_t *from, perf_raw_t *to, perf_counts_t *counts);
+void perf_close(void);
+
+#endif /* __PERFCTR_H_ */
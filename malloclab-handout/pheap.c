@@ -0,0 +1,293 @@
+/*
+ * pheap.c - Check the persistent heap (mem_init_file and mm_attach)
+ *
+ * Builds a list of blocks in a heap kept in a file, frees a third of
+ * them and saves the heap. The file is then mapped again, first at
+ * another address and then at the address it was created at, and the
+ * heap is adopted with mm_attach each time. The root must lead to the
+ * same list with the same contents, the blocks and the free list must
+ * be laid out as they were, and blocks of the sizes that were freed
+ * must be allocated from the free list without growing the heap.
+ *
+ *     unix> pheap -n 5000
+ *
+ * Prints what it checks with -v, and exits with status 1 at the first
+ * failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+#define DEF_NODES   1000   /* blocks in the list */
+#define MINSIZE       16   /* their sizes, before the node header */
+#define MAXSIZE      512
+#define MAXLINE     1024   /* max string size */
+
+/* The start of every block of the list. Links are offsets from the
+   start of the heap, since the heap moves from one mapping to the next */
+typedef struct {
+    size_t next;      /* offset of the next node (0 at the end) */
+    size_t size;      /* size of the block */
+    unsigned seed;    /* the rest of the block is filled from it */
+} node_t;
+
+/* The blocks of the heap, as mm_heap_walk sees them */
+typedef struct {
+    size_t blocks, free;
+    unsigned long long hash;  /* of the offset, size and state of each */
+} layout_t;
+
+static int verbose = 0;
+
+static node_t *new_node(size_t size, unsigned seed, size_t next);
+static void check_heap(char *what, layout_t *expect, size_t heapsize,
+		       int nodes);
+static void get_layout(layout_t *layout);
+static void add_block(void *ptr, size_t size, int allocated, void *arg);
+static size_t to_offset(void *ptr);
+static node_t *to_node(size_t offset);
+static void fail(char *msg);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    char c;
+    char path[MAXLINE];
+    char *file = NULL;
+    int keep = 0, nodes = DEF_NODES;
+    int i, count, num_freed = 0;
+    unsigned rng = 1;
+    size_t head = 0, *link, heapsize, *freed;
+    size_t free_blocks, largest_free, hdrsize = mem_pagesize();
+    node_t *node;
+    layout_t layout;
+    char *base, *hold;
+
+    while ((c = getopt(argc, argv, "f:n:khv")) != EOF) {
+	switch (c) {
+	case 'f': /* Heap file (must not exist) */
+	    file = optarg;
+	    break;
+	case 'n': /* Blocks in the list */
+	    nodes = atoi(optarg);
+	    break;
+	case 'k': /* Keep the heap file */
+	    keep = 1;
+	    break;
+	case 'v': /* Print what is checked */
+	    verbose = 1;
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (nodes <= 0) {
+	usage();
+	exit(1);
+    }
+    if (file == NULL)
+	sprintf(file = path, "/tmp/pheap.%d.img", (int)getpid());
+    if ((freed = (size_t *)malloc(nodes * sizeof(size_t))) == NULL)
+	fail("out of memory");
+
+    /* A new file has no heap to adopt */
+    if (mem_init_file(file, NULL) != 0)
+	fail("the heap file already holds a heap");
+    if (mm_attach() == 0)
+	fail("mm_attach adopted an empty heap");
+    if (mm_init() < 0)
+	fail("mm_init failed");
+
+    /* Build the list, then free every third block */
+    for (i = 0; i < nodes; i++) {
+	rng = rng * 1103515245 + 12345;
+	node = new_node(MINSIZE + (rng >> 8) % (MAXSIZE - MINSIZE + 1),
+			rng, head);
+	head = to_offset(node);
+    }
+    for (link = &head, count = 0; *link != 0; count++) {
+	node = to_node(*link);
+	if (count % 3 == 1) {
+	    *link = node->next;
+	    freed[num_freed++] = node->size;
+	    mm_free(node);
+	}
+	else
+	    link = &node->next;
+    }
+    nodes -= num_freed;
+    mm_set_root(to_node(head));
+    get_layout(&layout);
+    heapsize = mem_heapsize();
+    base = mem_heap_lo();
+    if (verbose)
+	printf("Created %d blocks at %p (%zu free blocks, heap %zu bytes)\n",
+	       nodes, base, layout.free, heapsize);
+    mem_sync();
+    mem_deinit();
+
+    /* Map it again elsewhere: hold the old address while it is mapped */
+    hold = mmap(base - hdrsize, hdrsize + MAX_HEAP, PROT_NONE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (hold == MAP_FAILED)
+	fail("cannot hold the address of the heap");
+    if (mem_init_file(file, NULL) != 1)
+	fail("the heap file lost its heap");
+    if ((char *)mem_heap_lo() == base)
+	fail("the heap was mapped at the same address");
+    check_heap("Moved", &layout, heapsize, nodes);
+
+    /* The freed sizes come back from the free list */
+    mm_free_stats(&free_blocks, &largest_free);
+    head = to_offset(mm_get_root());
+    for (i = 0; i < num_freed; i++)
+	head = to_offset(new_node(freed[i] - sizeof(node_t), i, head));
+    nodes += num_freed;
+    mm_set_root(to_node(head));
+    if (mem_heapsize() != heapsize)
+	fail("reusing the freed sizes grew the heap");
+    get_layout(&layout);
+    if (verbose)
+	printf("Reused %d free blocks (%zu free blocks before, %zu after)\n",
+	       num_freed, free_blocks, layout.free);
+    mem_sync();
+    mem_deinit();
+    munmap(hold, hdrsize + MAX_HEAP);
+
+    /* And back at the address it was created at */
+    if (mem_init_file(file, base) != 1)
+	fail("the heap file lost its heap");
+    check_heap("Mapped back", &layout, heapsize, nodes);
+    mem_deinit();
+
+    if (!keep)
+	unlink(file);
+    free(freed);
+    printf("Persistent heap ok\n");
+    exit(0);
+}
+
+/*
+ * new_node - allocate a node with size bytes of data after its header,
+ *     filled from seed, that links to the node at offset next
+ */
+static node_t *new_node(size_t size, unsigned seed, size_t next)
+{
+    node_t *node;
+    size_t k;
+
+    if ((node = mm_malloc(sizeof(node_t) + size)) == NULL)
+	fail("mm_malloc failed");
+    node->next = next;
+    node->size = sizeof(node_t) + size;
+    node->seed = seed;
+    for (k = 0; k < size; k++)
+	((char *)(node + 1))[k] = (char)(seed + k);
+    return node;
+}
+
+/*
+ * check_heap - adopt the heap just mapped, and check that its root
+ *     leads to the list of nodes blocks, intact, and that the heap is
+ *     laid out as expected
+ */
+static void check_heap(char *what, layout_t *expect, size_t heapsize,
+		       int nodes)
+{
+    layout_t layout;
+    node_t *node;
+    size_t k;
+    int count = 0;
+
+    if (mm_attach() < 0)
+	fail("mm_attach rejected the heap");
+    if (mem_heapsize() != heapsize)
+	fail("the heap size changed");
+    for (node = mm_get_root(); node != NULL; node = to_node(node->next)) {
+	if ((char *)node < (char *)mem_heap_lo() ||
+	    (char *)node > (char *)mem_heap_hi() || ++count > nodes)
+	    fail("the list is broken");
+	for (k = 0; k < node->size - sizeof(node_t); k++)
+	    if (((char *)(node + 1))[k] != (char)(node->seed + k))
+		fail("the data of a block changed");
+    }
+    if (count != nodes)
+	fail("blocks are missing from the list");
+    get_layout(&layout);
+    if (layout.blocks != expect->blocks || layout.free != expect->free ||
+	layout.hash != expect->hash)
+	fail("the blocks are not laid out as before");
+    if (verbose)
+	printf("%s to %p: %d blocks intact, same layout\n", what,
+	       mem_heap_lo(), count);
+}
+
+/*
+ * get_layout - summarize the blocks of the heap
+ */
+static void get_layout(layout_t *layout)
+{
+    memset(layout, 0, sizeof(*layout));
+    mm_heap_walk(add_block, layout);
+}
+
+/*
+ * add_block - mm_heap_walk callback of get_layout
+ */
+static void add_block(void *ptr, size_t size, int allocated, void *arg)
+{
+    layout_t *layout = (layout_t *)arg;
+
+    layout->blocks++;
+    layout->free += !allocated;
+    layout->hash = (layout->hash * 1000003) ^ to_offset(ptr);
+    layout->hash = (layout->hash * 1000003) ^ (size * 2 + !!allocated);
+}
+
+/*
+ * to_offset, to_node - convert between a block and its offset in the heap
+ */
+static size_t to_offset(void *ptr)
+{
+    return ptr == NULL ? 0 : (size_t)((char *)ptr - (char *)mem_heap_lo());
+}
+
+static node_t *to_node(size_t offset)
+{
+    return offset == 0 ? NULL : (node_t *)((char *)mem_heap_lo() + offset);
+}
+
+/*
+ * fail - report a failed check and exit
+ */
+static void fail(char *msg)
+{
+    printf("ERROR: %s\n", msg);
+    exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: pheap [-hkv] [-f <file>] [-n <blocks>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-f <file>    Heap file (default /tmp/pheap.<pid>.img, "
+	    "must not exist).\n");
+    fprintf(stderr, "\t-h           Print this message.\n");
+    fprintf(stderr, "\t-k           Keep the heap file.\n");
+    fprintf(stderr, "\t-n <blocks>  Blocks in the list (default %d).\n",
+	    DEF_NODES);
+    fprintf(stderr, "\t-v           Print what is checked.\n");
+}
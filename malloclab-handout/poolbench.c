@@ -0,0 +1,178 @@
+/*
+ * poolbench.c - Microbenchmark of the mm object pools
+ *
+ * For a set of object sizes, times the same allocation pattern once
+ * through mm_pool_get/mm_pool_put and once through plain
+ * mm_malloc/mm_free, and reports the throughput and the heap size
+ * each one needed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "fsecs.h"
+#include "config.h"
+
+/* Default benchmark parameters */
+#define DEF_OBJECTS  2000  /* live objects per round */
+#define DEF_ROUNDS     50  /* rounds of get-all/put-all */
+#define FREE_STRIDE  7919  /* objects are freed in a strided order */
+
+/* Parameters passed to the timed functions */
+typedef struct {
+    size_t size;     /* object size */
+    int objects;     /* live objects per round */
+    int rounds;      /* number of rounds */
+    void **slots;    /* the live objects */
+} bench_t;
+
+int verbose = 0;     /* needed by fsecs.c */
+
+/* Object sizes that are benchmarked */
+static size_t sizes[] = {8, 16, 24, 32, 48, 64, 128, 256, 0};
+
+static void bench_pool(void *ptr);
+static void bench_mm(void *ptr);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    int i;
+    char c;
+    bench_t bench;
+    double pool_secs, mm_secs, ops;
+    size_t pool_heap, mm_heap;
+
+    bench.objects = DEF_OBJECTS;
+    bench.rounds = DEF_ROUNDS;
+    while ((c = getopt(argc, argv, "n:r:hv")) != EOF) {
+	switch (c) {
+	case 'n': /* Live objects per round */
+	    bench.objects = atoi(optarg);
+	    break;
+	case 'r': /* Number of rounds */
+	    bench.rounds = atoi(optarg);
+	    break;
+	case 'v': /* Print timing package */
+	    verbose = 1;
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (bench.objects <= 0 || bench.rounds <= 0 ||
+	bench.objects % FREE_STRIDE == 0) {
+	usage();
+	exit(1);
+    }
+    if ((bench.slots = malloc(bench.objects * sizeof(void *))) == NULL) {
+	fprintf(stderr, "poolbench: malloc error\n");
+	exit(1);
+    }
+
+    mem_init();
+    init_fsecs();
+
+    /* Each round does one get and one put per object */
+    ops = 2.0 * bench.objects * bench.rounds;
+
+    printf("%6s%12s%12s%9s%12s%12s\n",
+	   "size", "mm Kops", "pool Kops", "speedup", "mm heap", "pool heap");
+    for (i = 0; sizes[i] != 0; i++) {
+	bench.size = sizes[i];
+
+	mm_secs = fsecs(bench_mm, &bench);
+	mm_heap = mem_heapsize();
+	pool_secs = fsecs(bench_pool, &bench);
+	pool_heap = mem_heapsize();
+
+	printf("%6u%12.0f%12.0f%8.2fx%12u%12u\n",
+	       (unsigned)bench.size,
+	       (ops/1e3)/mm_secs,
+	       (ops/1e3)/pool_secs,
+	       mm_secs/pool_secs,
+	       (unsigned)mm_heap,
+	       (unsigned)pool_heap);
+    }
+
+    mem_deinit();
+    free(bench.slots);
+    exit(0);
+}
+
+/*
+ * bench_pool - fill and empty a pool bench->rounds times
+ */
+static void bench_pool(void *ptr)
+{
+    bench_t *bench = (bench_t *)ptr;
+    mm_pool_t *pool;
+    int i, r;
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+	fprintf(stderr, "poolbench: mm_init failed\n");
+	exit(1);
+    }
+    if ((pool = mm_pool_create(bench->size, ALIGNMENT)) == NULL) {
+	fprintf(stderr, "poolbench: mm_pool_create failed\n");
+	exit(1);
+    }
+
+    for (r = 0; r < bench->rounds; r++) {
+	for (i = 0; i < bench->objects; i++)
+	    if ((bench->slots[i] = mm_pool_get(pool)) == NULL) {
+		fprintf(stderr, "poolbench: mm_pool_get failed\n");
+		exit(1);
+	    }
+	for (i = 0; i < bench->objects; i++)
+	    mm_pool_put(pool,
+			bench->slots[((long)i * FREE_STRIDE) % bench->objects]);
+    }
+}
+
+/*
+ * bench_mm - same pattern as bench_pool, with mm_malloc and mm_free
+ */
+static void bench_mm(void *ptr)
+{
+    bench_t *bench = (bench_t *)ptr;
+    int i, r;
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+	fprintf(stderr, "poolbench: mm_init failed\n");
+	exit(1);
+    }
+
+    for (r = 0; r < bench->rounds; r++) {
+	for (i = 0; i < bench->objects; i++)
+	    if ((bench->slots[i] = mm_malloc(bench->size)) == NULL) {
+		fprintf(stderr, "poolbench: mm_malloc failed\n");
+		exit(1);
+	    }
+	for (i = 0; i < bench->objects; i++)
+	    mm_free(bench->slots[((long)i * FREE_STRIDE) % bench->objects]);
+    }
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: poolbench [-hv] [-n <objects>] [-r <rounds>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h            Print this message.\n");
+    fprintf(stderr, "\t-n <objects>  Live objects per round (default %d).\n",
+	    DEF_OBJECTS);
+    fprintf(stderr, "\t-r <rounds>   Number of rounds (default %d).\n",
+	    DEF_ROUNDS);
+    fprintf(stderr, "\t-v            Print the timing method.\n");
+}
@@ -0,0 +1,60 @@
+/*
+ * rep2bin.c - Convert a .rep tracefile to the binary trace format
+ *
+ * The binary file holds the same requests as fixed-size traceop_t
+ * records (see trace.h). mdriver and the other drivers recognize it by
+ * its magic number and replay it straight from a read-only mapping, so
+ * large traces load without being parsed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+int verbose = 0;     /* needed by trace.c */
+
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    char c;
+    trace_t *trace;
+
+    while ((c = getopt(argc, argv, "hv")) != EOF) {
+	switch (c) {
+	case 'v': /* Print the tracefile name */
+	    verbose = 2;
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (argc - optind != 2) {
+	usage();
+	exit(1);
+    }
+
+    trace = read_trace("", argv[optind]);
+    write_bin_trace(trace, argv[optind + 1]);
+    if (verbose)
+	printf("%s: %d requests, %d ids, %d arenas\n", argv[optind + 1],
+	       trace->num_ops, trace->num_ids, trace->num_arenas);
+    free_trace(trace);
+    exit(0);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: rep2bin [-hv] <in.rep> <out.bin>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h  Print this message.\n");
+    fprintf(stderr, "\t-v  Print additional info.\n");
+}
@@ -0,0 +1,382 @@
+/*
+ * stream.c - Streaming replay of tracefiles that do not fit in memory
+ *
+ * A trace stream owns two chunk buffers. A reader thread fills one
+ * while the replay works through the other, so at most 2*STREAM_CHUNK
+ * requests are in memory whatever the length of the trace. Rewinding
+ * stops the reader, seeks back to the first request and starts it again,
+ * which lets the driver make several passes over the same trace.
+ * Compressed tracefiles are mapped and decoded a chunk at a time, so
+ * only the pages being decoded need to be in memory.
+ *
+ * The livemap replaces the blocks[] and block_sizes[] arrays of trace_t:
+ * its size follows the number of blocks live at the same time, not the
+ * number of ids in the trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stream.h"
+
+#define LIVEMAP_MINSIZE 1024  /* initial number of slots */
+
+extern int verbose; /* -v option of the driver */
+
+static void *stream_reader(void *arg);
+static int read_chunk(trace_stream_t *stream, traceop_t *ops);
+static void start_reader(trace_stream_t *stream);
+static void stop_reader(trace_stream_t *stream);
+static void livemap_grow(livemap_t *map);
+static size_t livemap_hash(livemap_t *map, uint32_t key);
+static void stream_error(char *msg);
+
+/*
+ * open_trace_stream - open a tracefile for streaming and start reading
+ *     ahead. Only the header is read here.
+ */
+trace_stream_t *open_trace_stream(char *tracedir, char *filename)
+{
+    trace_stream_t *stream;
+    trace_bin_hdr_t hdr;
+    char msg[2 * sizeof(stream->path)];
+    struct stat st;
+    int i;
+
+    if (verbose > 1)
+	printf("Streaming tracefile: %s\n", filename);
+
+    if ((stream = (trace_stream_t *)calloc(1, sizeof(trace_stream_t))) == NULL)
+	stream_error("calloc failed in open_trace_stream");
+    snprintf(stream->path, sizeof(stream->path), "%s%s", tracedir, filename);
+    if ((stream->file = fopen(stream->path, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in open_trace_stream", stream->path);
+	stream_error(msg);
+    }
+
+    /* Binary tracefiles are recognized by their magic number */
+    if (fread(&hdr, sizeof(hdr), 1, stream->file) == 1 &&
+	hdr.magic == TRACE_BIN_MAGIC) {
+	if (hdr.recsize != sizeof(traceop_t)) {
+	    printf("Bad binary tracefile %s (written with a different "
+		   "record layout)\n", stream->path);
+	    exit(1);
+	}
+	stream->binary = 1;
+	stream->sugg_heapsize = hdr.sugg_heapsize;
+	stream->num_ids = hdr.num_ids;
+	stream->num_ops = hdr.num_ops;
+	stream->weight = hdr.weight;
+    }
+    else if (hdr.magic == TRACE_Z_MAGIC) {
+	if (fstat(fileno(stream->file), &st) < 0 || 
+	    (stream->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, 
+				fileno(stream->file), 0)) == MAP_FAILED)
+	    stream_error("Could not map the tracefile in open_trace_stream");
+	stream->map_size = st.st_size;
+	madvise(stream->map, stream->map_size, MADV_SEQUENTIAL);
+	stream->compressed = 1;
+	stream->sugg_heapsize = hdr.sugg_heapsize;
+	stream->num_ids = hdr.num_ids;
+	stream->num_ops = hdr.num_ops;
+	stream->weight = hdr.weight;
+    }
+    else {
+	rewind(stream->file);
+	read_rep_header(stream->file, &stream->sugg_heapsize,
+			&stream->num_ids, &stream->num_ops, &stream->weight);
+    }
+    stream->start = ftell(stream->file);
+
+    for (i = 0; i < 2; i++)
+	if ((stream->buf[i].ops =
+	     (traceop_t *)malloc(STREAM_CHUNK * sizeof(traceop_t))) == NULL)
+	    stream_error("malloc failed in open_trace_stream");
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->cond, NULL);
+    start_reader(stream);
+    return stream;
+}
+
+/*
+ * next_trace_chunk - release the chunk returned by the previous call and
+ *     wait for the next one. Sets *ops to its requests and returns their
+ *     number, or 0 at the end of the trace.
+ */
+int next_trace_chunk(trace_stream_t *stream, traceop_t **ops)
+{
+    stream_buf_t *buf = &stream->buf[stream->next];
+    int count;
+
+    pthread_mutex_lock(&stream->lock);
+    if (stream->held >= 0) {
+	stream->buf[stream->held].full = 0;
+	stream->held = -1;
+	pthread_cond_broadcast(&stream->cond);
+    }
+    while (!buf->full)
+	pthread_cond_wait(&stream->cond, &stream->lock);
+    count = buf->count;
+    pthread_mutex_unlock(&stream->lock);
+
+    /* The end marker stays in place, so further calls keep returning 0 */
+    if (count > 0) {
+	stream->held = stream->next;
+	stream->next = 1 - stream->next;
+    }
+    *ops = buf->ops;
+    return count;
+}
+
+/*
+ * rewind_trace_stream - start the stream over from its first request
+ */
+void rewind_trace_stream(trace_stream_t *stream)
+{
+    stop_reader(stream);
+    if (fseek(stream->file, stream->start, SEEK_SET) < 0)
+	stream_error("fseek failed in rewind_trace_stream");
+    start_reader(stream);
+}
+
+/*
+ * close_trace_stream - stop reading and free the stream
+ */
+void close_trace_stream(trace_stream_t *stream)
+{
+    stop_reader(stream);
+    if (stream->map != NULL)
+	munmap(stream->map, stream->map_size);
+    fclose(stream->file);
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->cond);
+    free(stream->buf[0].ops);
+    free(stream->buf[1].ops);
+    free(stream);
+}
+
+/*
+ * start_reader - empty both buffers and start the read-ahead thread
+ *     from the first request
+ */
+static void start_reader(trace_stream_t *stream)
+{
+    if (stream->compressed)
+	init_trace_z(&stream->z, (trace_bin_hdr_t *)stream->map + 1,
+		     stream->map_size - sizeof(trace_bin_hdr_t));
+    stream->buf[0].full = stream->buf[1].full = 0;
+    stream->next = 0;
+    stream->held = -1;
+    stream->stop = 0;
+    if (pthread_create(&stream->reader, NULL, stream_reader, stream) != 0)
+	stream_error("pthread_create failed in start_reader");
+}
+
+/*
+ * stop_reader - make the read-ahead thread exit and wait for it
+ */
+static void stop_reader(trace_stream_t *stream)
+{
+    pthread_mutex_lock(&stream->lock);
+    stream->stop = 1;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->reader, NULL);
+}
+
+/*
+ * stream_reader - body of the read-ahead thread: fill the two buffers in
+ *     turn, each as soon as the replay has released it, until the end of
+ *     the trace (marked by an empty chunk) or until asked to stop
+ */
+static void *stream_reader(void *arg)
+{
+    trace_stream_t *stream = (trace_stream_t *)arg;
+    stream_buf_t *buf;
+    int b = 0;
+    int count;
+
+    do {
+	buf = &stream->buf[b];
+	pthread_mutex_lock(&stream->lock);
+	while (buf->full && !stream->stop)
+	    pthread_cond_wait(&stream->cond, &stream->lock);
+	if (stream->stop) {
+	    pthread_mutex_unlock(&stream->lock);
+	    break;
+	}
+	pthread_mutex_unlock(&stream->lock);
+
+	/* The replay never touches a buffer that is not full */
+	count = read_chunk(stream, buf->ops);
+
+	pthread_mutex_lock(&stream->lock);
+	buf->count = count;
+	buf->full = 1;
+	pthread_cond_broadcast(&stream->cond);
+	pthread_mutex_unlock(&stream->lock);
+	b = 1 - b;
+    } while (count > 0);
+    return NULL;
+}
+
+/*
+ * read_chunk - read up to STREAM_CHUNK requests into ops and return how
+ *     many were read
+ */
+static int read_chunk(trace_stream_t *stream, traceop_t *ops)
+{
+    int count = 0;
+
+    if (stream->binary)
+	return fread(ops, sizeof(traceop_t), STREAM_CHUNK, stream->file);
+    if (stream->compressed)
+	return decode_trace_z(&stream->z, ops, STREAM_CHUNK);
+    while (count < STREAM_CHUNK &&
+	   read_rep_op(stream->file, stream->path, &ops[count]))
+	count++;
+    return count;
+}
+
+/*
+ * livemap_create - create an empty map
+ */
+livemap_t *livemap_create(void)
+{
+    livemap_t *map;
+
+    if ((map = (livemap_t *)malloc(sizeof(livemap_t))) == NULL ||
+	(map->slots = (live_t *)calloc(LIVEMAP_MINSIZE, sizeof(live_t))) == NULL)
+	stream_error("malloc failed in livemap_create");
+    map->capacity = LIVEMAP_MINSIZE;
+    map->count = 0;
+    return map;
+}
+
+/*
+ * livemap_get - return the live block with the given id, or NULL
+ */
+live_t *livemap_get(livemap_t *map, uint32_t id)
+{
+    size_t i = livemap_hash(map, id + 1);
+
+    while (map->slots[i].key != 0) {
+	if (map->slots[i].key == id + 1)
+	    return &map->slots[i];
+	i = (i + 1) & (map->capacity - 1);
+    }
+    return NULL;
+}
+
+/*
+ * livemap_put - return the live block with the given id, adding it if
+ *     it is not in the map. The entry is only valid until the next put.
+ */
+live_t *livemap_put(livemap_t *map, uint32_t id)
+{
+    size_t i;
+
+    /* Keep the load factor at most 1/2 */
+    if (2 * (map->count + 1) > map->capacity)
+	livemap_grow(map);
+
+    i = livemap_hash(map, id + 1);
+    while (map->slots[i].key != 0) {
+	if (map->slots[i].key == id + 1)
+	    return &map->slots[i];
+	i = (i + 1) & (map->capacity - 1);
+    }
+    map->slots[i].key = id + 1;
+    map->slots[i].link = -1;
+    map->count++;
+    return &map->slots[i];
+}
+
+/*
+ * livemap_remove - remove the block with the given id (if present).
+ *     Later entries of the same probe run are shifted back, so that no
+ *     tombstones are needed.
+ */
+void livemap_remove(livemap_t *map, uint32_t id)
+{
+    live_t *entry = livemap_get(map, id);
+    size_t mask = map->capacity - 1;
+    size_t i, j, home;
+
+    if (entry == NULL)
+	return;
+    i = entry - map->slots;
+    for (j = (i + 1) & mask; map->slots[j].key != 0; j = (j + 1) & mask) {
+	/* Move slot j into the hole at i unless its home lies in (i, j] */
+	home = livemap_hash(map, map->slots[j].key);
+	if (((j - home) & mask) >= ((j - i) & mask)) {
+	    map->slots[i] = map->slots[j];
+	    i = j;
+	}
+    }
+    map->slots[i].key = 0;
+    map->count--;
+}
+
+/*
+ * livemap_clear - remove every block, keeping the slots allocated
+ */
+void livemap_clear(livemap_t *map)
+{
+    memset(map->slots, 0, map->capacity * sizeof(live_t));
+    map->count = 0;
+}
+
+/*
+ * livemap_destroy - free the map
+ */
+void livemap_destroy(livemap_t *map)
+{
+    free(map->slots);
+    free(map);
+}
+
+/*
+ * livemap_grow - double the number of slots and rehash
+ */
+static void livemap_grow(livemap_t *map)
+{
+    live_t *old = map->slots;
+    size_t oldcapacity = map->capacity;
+    size_t i, j;
+
+    map->capacity *= 2;
+    if ((map->slots = (live_t *)calloc(map->capacity, sizeof(live_t))) == NULL)
+	stream_error("calloc failed in livemap_grow");
+    for (i = 0; i < oldcapacity; i++) {
+	if (old[i].key == 0)
+	    continue;
+	j = livemap_hash(map, old[i].key);
+	while (map->slots[j].key != 0)
+	    j = (j + 1) & (map->capacity - 1);
+	map->slots[j] = old[i];
+    }
+    free(old);
+}
+
+/*
+ * livemap_hash - home slot of a key (Fibonacci hashing: the top bits of
+ *     the key times 2^64 / phi, so that every bit of the key counts)
+ */
+static size_t livemap_hash(livemap_t *map, uint32_t key)
+{
+    return (size_t)((key * 0x9e3779b97f4a7c15ULL) >>
+		    (64 - __builtin_ctzll(map->capacity)));
+}
+
+/*
+ * stream_error - Report a Unix-style error while streaming a trace
+ */
+static void stream_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
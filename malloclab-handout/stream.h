@@ -0,0 +1,75 @@
+/*
+ * stream.h - Streaming replay of tracefiles that do not fit in memory.
+ *            Requests are read in bounded chunks by a helper thread
+ *            while the previous chunk is replayed, and the live blocks
+ *            are kept in a hash map keyed by id instead of arrays sized
+ *            by the number of ids.
+ */
+#ifndef __STREAM_H_
+#define __STREAM_H_
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+#define STREAM_CHUNK 65536   /* requests per chunk */
+
+/* One of the two chunk buffers of a stream */
+typedef struct {
+    traceop_t *ops;          /* requests of the chunk */
+    int count;               /* number of requests (0: end of the trace) */
+    int full;                /* filled by the reader, not yet released */
+} stream_buf_t;
+
+/* A tracefile (.rep, binary or compressed) read chunk by chunk */
+typedef struct {
+    char path[1024];         /* path of the tracefile */
+    FILE *file;              /* the open tracefile */
+    int binary;              /* set for a binary tracefile */
+    int compressed;          /* set for a compressed tracefile... */
+    void *map;               /* ... which is mapped here */
+    size_t map_size;
+    trace_z_t z;             /* and decoded by this decoder */
+    long start;              /* file offset of the first request */
+    int sugg_heapsize;       /* header fields, as in trace_t */
+    int num_ids;
+    int num_ops;
+    int weight;
+    stream_buf_t buf[2];     /* filled and replayed in turn */
+    int next;                /* buffer the replay takes next */
+    int held;                /* buffer the replay holds (-1 if none) */
+    int stop;                /* asks the reader thread to stop */
+    pthread_t reader;        /* the read-ahead thread */
+    pthread_mutex_t lock;    /* protects buf[].full/count and stop */
+    pthread_cond_t cond;     /* signaled when either of them changes */
+} trace_stream_t;
+
+trace_stream_t *open_trace_stream(char *tracedir, char *filename);
+int next_trace_chunk(trace_stream_t *stream, traceop_t **ops);
+void rewind_trace_stream(trace_stream_t *stream);
+void close_trace_stream(trace_stream_t *stream);
+
+/* A live block of a streamed trace */
+typedef struct {
+    uint32_t key;            /* id + 1 (0: free slot) */
+    int32_t link;            /* previous live block of the same arena */
+    char *ptr;               /* payload address */
+    size_t size;             /* payload size */
+} live_t;
+
+/* Open-addressing (linear probing) hash map from ids to live blocks */
+typedef struct {
+    live_t *slots;           /* capacity slots */
+    size_t capacity;         /* a power of two */
+    size_t count;            /* slots in use */
+} livemap_t;
+
+livemap_t *livemap_create(void);
+live_t *livemap_get(livemap_t *map, uint32_t id);
+live_t *livemap_put(livemap_t *map, uint32_t id);
+void livemap_remove(livemap_t *map, uint32_t id);
+void livemap_clear(livemap_t *map);
+void livemap_destroy(livemap_t *map);
+
+#endif /* __STREAM_H_ */
@@ -0,0 +1,732 @@
+/*
+ * trace.c - Read tracefiles into memory
+ *
+ * A tracefile starts with four header lines (suggested heap size,
+ * number of ids, number of requests, weight) followed by one request
+ * per line. See README for the request types. Binary tracefiles (see
+ * trace.h) hold the same requests as fixed-size records, and compressed
+ * tracefiles hold them as runs of variable-length records.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024 /* max string size */
+
+extern int verbose; /* -v option of the driver */
+
+static void parse_rep_trace(trace_t *trace, FILE *tracefile, char *path);
+static void map_bin_trace(trace_t *trace, char *path);
+static void decode_z_trace(trace_t *trace, char *path);
+static unsigned char *put_varint(unsigned char *out, uint64_t v);
+static void alloc_tables(trace_t *trace);
+static void check_ops(trace_t *trace, char *path);
+static void trace_error(char *msg);
+
+/*
+ * read_trace - read a trace file and store it in memory. Binary
+ *     tracefiles (see rep2bin) are mapped and their requests are used
+ *     in place; compressed tracefiles (see tracez) are decoded and .rep
+ *     files are parsed.
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    char path[MAXLINE];
+    char msg[MAXLINE];
+    uint32_t magic = 0;
+
+    if (verbose > 1)
+	printf("Reading tracefile: %s\n", filename);
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+	trace_error("malloc 1 failed in read_trance");
+    trace->map = NULL;
+    trace->map_size = 0;
+	
+    /* Binary tracefiles are recognized by their magic number */
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    if ((tracefile = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in read_trace", path);
+	trace_error(msg);
+    }
+    if (fread(&magic, sizeof(magic), 1, tracefile) == 1 && 
+	magic == TRACE_BIN_MAGIC) {
+	fclose(tracefile);
+	map_bin_trace(trace, path);
+    }
+    else if (magic == TRACE_Z_MAGIC) {
+	fclose(tracefile);
+	decode_z_trace(trace, path);
+    }
+    else {
+	rewind(tracefile);
+	parse_rep_trace(trace, tracefile, path);
+	fclose(tracefile);
+    }
+    alloc_tables(trace);
+    return trace;
+}
+
+/*
+ * scale_trace - a trace made of copies of trace, interleaved request by
+ *     request, each with its own block and arena ids (id * copies + copy),
+ *     so that the live blocks are copies times as many. Returns NULL if
+ *     the arena ids would not fit in a request.
+ */
+trace_t *scale_trace(trace_t *trace, int copies)
+{
+    trace_t *scaled;
+    traceop_t *op;
+    int i, c;
+
+    if ((size_t)trace->num_arenas * copies > UINT16_MAX + 1)
+	return NULL;
+    if ((scaled = (trace_t *)malloc(sizeof(trace_t))) == NULL)
+	trace_error("malloc 1 failed in scale_trace");
+    *scaled = *trace;
+    scaled->map = NULL;
+    scaled->map_size = 0;
+    scaled->num_ids = trace->num_ids * copies;
+    scaled->num_ops = trace->num_ops * copies;
+    scaled->num_arenas = trace->num_arenas * copies;
+    if ((scaled->ops = (traceop_t *)malloc(scaled->num_ops * 
+					   sizeof(traceop_t))) == NULL)
+	trace_error("malloc 2 failed in scale_trace");
+    for (i = 0, op = scaled->ops; i < trace->num_ops; i++)
+	for (c = 0; c < copies; c++, op++) {
+	    *op = trace->ops[i];
+	    if (op->type != WAIT) {
+		op->index = op->index * copies + c;
+		op->arena = op->arena * copies + c;
+	    }
+	}
+    alloc_tables(scaled);
+    return scaled;
+}
+
+/*
+ * alloc_tables - allocate the tables a trace is replayed with
+ */
+static void alloc_tables(trace_t *trace)
+{
+    int i;
+
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks = 
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	trace_error("malloc 3 failed in read_trace");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes = 
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	trace_error("malloc 4 failed in read_trace");
+
+    /* 
+     * Blocks bump-allocated from the same arena are chained through
+     * arena_links so that a reset can find all of them.
+     */
+    if ((trace->arenas = (mm_arena_t **)
+	 malloc((trace->num_arenas + 1) * sizeof(mm_arena_t *))) == NULL)
+	trace_error("malloc 5 failed in read_trace");
+    if ((trace->arena_heads = 
+	 (int *)malloc((trace->num_arenas + 1) * sizeof(int))) == NULL)
+	trace_error("malloc 6 failed in read_trace");
+    if ((trace->arena_links = 
+	 (int *)malloc(trace->num_ids * sizeof(int))) == NULL)
+	trace_error("malloc 7 failed in read_trace");
+    for (i = 0; i < trace->num_arenas; i++)
+	trace->arena_heads[i] = -1;
+}
+
+/*
+ * parse_rep_trace - read the header and requests of the .rep file 
+ *     open on tracefile (named path) into trace
+ */
+static void parse_rep_trace(trace_t *trace, FILE *tracefile, char *path)
+{
+    traceop_t op;
+    unsigned max_index = 0;
+    int op_index;
+    unsigned char *created;
+
+    read_rep_header(tracefile, &trace->sugg_heapsize, &trace->num_ids,
+		    &trace->num_ops, &trace->weight);
+    
+    /* 
+     * We'll store each request line in the trace in this array (zeroed,
+     * so that unused fields are written out as 0 by write_bin_trace)
+     */
+    if ((trace->ops = 
+	 (traceop_t *)calloc(trace->num_ops, sizeof(traceop_t))) == NULL)
+	trace_error("malloc 2 failed in read_trace");
+
+    /* Arenas created and not destroyed yet, one bit each */
+    if ((created = (unsigned char *)calloc((UINT16_MAX + 1) / 8, 1)) == NULL)
+	trace_error("malloc 3 failed in read_trace");
+
+    /* read every request line in the trace file */
+    op_index = 0;
+    trace->num_arenas = 0;
+    while (read_rep_op(tracefile, path, &op)) {
+	assert(op_index < trace->num_ops);
+	trace->ops[op_index] = op;
+	if (op.type == ALLOC || op.type == REALLOC || op.type == ARENA_ALLOC)
+	    max_index = (op.index > max_index) ? op.index : max_index;
+	if (op.type == ARENA_CREATE) {
+	    if (created[op.arena / 8] & (1 << (op.arena % 8))) {
+		printf("Arena %u created again before it is destroyed in "
+		       "tracefile %s\n", op.arena, path);
+		exit(1);
+	    }
+	    created[op.arena / 8] |= 1 << (op.arena % 8);
+	    if (op.arena >= trace->num_arenas)
+		trace->num_arenas = op.arena + 1;
+	}
+	else if (op.type > ARENA_CREATE && op.type <= ARENA_DESTROY) {
+	    if (!(created[op.arena / 8] & (1 << (op.arena % 8)))) {
+		printf("Arena %u used before it is created (or after it is "
+		       "destroyed) in tracefile %s\n", op.arena, path);
+		exit(1);
+	    }
+	    if (op.type == ARENA_DESTROY)
+		created[op.arena / 8] &= ~(1 << (op.arena % 8));
+	}
+	op_index++;
+    }
+    free(created);
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+}
+
+/*
+ * read_rep_header - read the four header lines of a .rep file
+ */
+void read_rep_header(FILE *tracefile, int *sugg_heapsize, int *num_ids,
+		     int *num_ops, int *weight)
+{
+    fscanf(tracefile, "%d", sugg_heapsize); /* not used */
+    fscanf(tracefile, "%d", num_ids);     
+    fscanf(tracefile, "%d", num_ops);     
+    fscanf(tracefile, "%d", weight);        /* not used */
+}
+
+/*
+ * read_rep_op - read the next request line of the .rep file open on 
+ *     tracefile (named path) into op. Returns 0 at the end of the file.
+ */
+int read_rep_op(FILE *tracefile, char *path, traceop_t *op)
+{
+    char type[MAXLINE];
+    unsigned index, arena, thread = 0;
+    size_t size;
+
+    if (fscanf(tracefile, "%s", type) == EOF)
+	return 0;
+
+    /* A request of a thread other than 0 starts with @<thread> */
+    if (type[0] == '@') {
+	thread = atoi(type + 1);
+	if (thread >= TRACE_THREADS || fscanf(tracefile, "%s", type) == EOF) {
+	    printf("Bad thread %s in tracefile %s\n", type, path);
+	    exit(1);
+	}
+    }
+    memset(op, 0, sizeof(*op));
+    op->thread = thread;
+    switch(type[0]) {
+    case 'a':
+	fscanf(tracefile, "%u %zu", &index, &size);
+	op->type = ALLOC;
+	op->index = index;
+	op->size = size;
+	break;
+    case 'r':
+	fscanf(tracefile, "%u %zu", &index, &size);
+	op->type = REALLOC;
+	op->index = index;
+	op->size = size;
+	break;
+    case 'f':
+	fscanf(tracefile, "%ud", &index);
+	op->type = FREE;
+	op->index = index;
+	break;
+    case 'c':
+	fscanf(tracefile, "%u", &arena);
+	op->type = ARENA_CREATE;
+	op->arena = arena;
+	break;
+    case 'b':
+	fscanf(tracefile, "%u %u %zu", &arena, &index, &size);
+	op->type = ARENA_ALLOC;
+	op->arena = arena;
+	op->index = index;
+	op->size = size;
+	break;
+    case 'x':
+	fscanf(tracefile, "%u", &arena);
+	op->type = ARENA_RESET;
+	op->arena = arena;
+	break;
+    case 'd':
+	fscanf(tracefile, "%u", &arena);
+	op->type = ARENA_DESTROY;
+	op->arena = arena;
+	break;
+    case 'w':
+	fscanf(tracefile, "%u %u", &arena, &index);
+	if (arena >= TRACE_THREADS) {
+	    printf("Bad thread %u in tracefile %s\n", arena, path);
+	    exit(1);
+	}
+	op->type = WAIT;
+	op->arena = arena;
+	op->index = index;
+	break;
+    default:
+	printf("Bogus type character (%c) in tracefile %s\n", 
+	       type[0], path);
+	exit(1);
+    }
+    if (op->type >= ARENA_CREATE && op->type <= ARENA_DESTROY &&
+	arena > UINT16_MAX) {
+	printf("Arena id %u too large in tracefile %s\n", arena, path);
+	exit(1);
+    }
+    return 1;
+}
+
+/*
+ * map_bin_trace - map the binary tracefile path and point trace at its
+ *     header fields and requests. Nothing is parsed or copied.
+ */
+static void map_bin_trace(trace_t *trace, char *path)
+{
+    int fd;
+    struct stat st;
+    trace_bin_hdr_t *hdr;
+    char msg[MAXLINE];
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+	sprintf(msg, "Could not open %s in read_trace", path);
+	trace_error(msg);
+    }
+    trace->map_size = st.st_size;
+    trace->map = mmap(NULL, trace->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (trace->map == MAP_FAILED) {
+	sprintf(msg, "Could not map %s in read_trace", path);
+	trace_error(msg);
+    }
+    close(fd);
+
+    hdr = (trace_bin_hdr_t *)trace->map;
+    if (trace->map_size < sizeof(trace_bin_hdr_t) ||
+	hdr->recsize != sizeof(traceop_t) ||
+	trace->map_size != sizeof(trace_bin_hdr_t) + 
+	(size_t)hdr->num_ops * sizeof(traceop_t)) {
+	printf("Bad binary tracefile %s (truncated, or written with a "
+	       "different record layout)\n", path);
+	exit(1);
+    }
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->weight = hdr->weight;
+    trace->num_arenas = hdr->num_arenas;
+    trace->ops = (traceop_t *)(hdr + 1);
+
+    /* The requests are read once, front to back */
+    madvise(trace->map, trace->map_size, MADV_SEQUENTIAL);
+    check_ops(trace, path);
+}
+
+/*
+ * check_ops - check that the requests of a binary or compressed trace
+ *     stay within its tables: known types, block
+ *     ids below num_ids, arena ids below num_arenas, and each arena
+ *     created before it is used and not used after it is destroyed
+ */
+static void check_ops(trace_t *trace, char *path)
+{
+    traceop_t *op;
+    char *live, *why = NULL;
+    int i;
+
+    if (trace->num_ids < 0 || trace->num_ops < 0) {
+	printf("Bad tracefile %s (negative counts in the header)\n", path);
+	exit(1);
+    }
+    if ((live = (char *)calloc(trace->num_arenas + 1, 1)) == NULL)
+	trace_error("malloc 3 failed in read_trace");
+    for (i = 0; i < trace->num_ops && why == NULL; i++) {
+	op = &trace->ops[i];
+	if (op->type > WAIT)
+	    why = "unknown request type";
+	else if ((op->type == ALLOC || op->type == REALLOC || 
+		  op->type == FREE || op->type == ARENA_ALLOC) && 
+		 op->index >= (unsigned)trace->num_ids)
+	    why = "block id out of range";
+	else if (op->type == WAIT)
+	    why = op->arena >= TRACE_THREADS ? "bad thread in wait" : NULL;
+	else if (op->type < ARENA_CREATE)
+	    continue;
+	else if (op->arena >= trace->num_arenas)
+	    why = "arena id out of range";
+	else if (op->type == ARENA_CREATE) {
+	    if (live[op->arena])
+		why = "arena created again before it is destroyed";
+	    live[op->arena] = 1;
+	}
+	else if (!live[op->arena])
+	    why = "arena used before it is created or after it is destroyed";
+	else if (op->type == ARENA_DESTROY)
+	    live[op->arena] = 0;
+    }
+    free(live);
+    if (why != NULL) {
+	printf("Bad tracefile %s (request %d: %s)\n", path, i - 1, why);
+	exit(1);
+    }
+}
+
+/*
+ * decode_z_trace - decode the compressed tracefile path into trace
+ */
+static void decode_z_trace(trace_t *trace, char *path)
+{
+    int fd, i;
+    struct stat st;
+    trace_bin_hdr_t *hdr;
+    trace_z_t z;
+    char msg[MAXLINE];
+    void *map;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+	sprintf(msg, "Could not open %s in read_trace", path);
+	trace_error(msg);
+    }
+    if ((size_t)st.st_size < sizeof(trace_bin_hdr_t)) {
+	printf("Bad compressed tracefile %s (truncated)\n", path);
+	exit(1);
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+	sprintf(msg, "Could not map %s in read_trace", path);
+	trace_error(msg);
+    }
+    close(fd);
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    hdr = (trace_bin_hdr_t *)map;
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->weight = hdr->weight;
+    trace->num_arenas = hdr->num_arenas;
+    if ((trace->ops = 
+	 (traceop_t *)calloc(trace->num_ops, sizeof(traceop_t))) == NULL)
+	trace_error("malloc 2 failed in read_trace");
+
+    init_trace_z(&z, hdr + 1, st.st_size - sizeof(trace_bin_hdr_t));
+    if (decode_trace_z(&z, trace->ops, trace->num_ops) != trace->num_ops) {
+	printf("Bad compressed tracefile %s (truncated)\n", path);
+	exit(1);
+    }
+    munmap(map, st.st_size);
+
+    /* Do not trust the header with the arena ids used */
+    for (i = 0; i < trace->num_ops; i++)
+	if (trace->ops[i].type == ARENA_CREATE && 
+	    trace->ops[i].arena >= trace->num_arenas)
+	    trace->num_arenas = trace->ops[i].arena + 1;
+    check_ops(trace, path);
+}
+
+/*
+ * init_trace_z - start decoding the len bytes of compressed requests at
+ *     data, or start encoding if data is NULL
+ */
+void init_trace_z(trace_z_t *z, const void *data, size_t len)
+{
+    memset(z, 0, sizeof(*z));
+    z->next = (const unsigned char *)data;
+    z->end = z->next + len;
+}
+
+/*
+ * GET_VARINT - decode the varint at p (not beyond end) into v, or jump
+ *     to label if the encoded requests end first. Most varints are one
+ *     byte long, so that case is tested first.
+ */
+#define GET_VARINT(p, end, v, label) do {				\
+	int shift_;							\
+	if ((p) == (end)) goto label;					\
+	(v) = *(p)++;							\
+	if ((v) & 0x80) {						\
+	    (v) &= 0x7f;						\
+	    for (shift_ = 7; ; shift_ += 7) {				\
+		if ((p) == (end) || shift_ > 63) goto label;		\
+		(v) |= (uint64_t)(*(p) & 0x7f) << shift_;		\
+		if (!(*(p)++ & 0x80)) break;				\
+	    }								\
+	}								\
+    } while (0)
+
+/*
+ * decode_trace_z - decode up to n requests into ops and return how many
+ *     were decoded (fewer than n only at the end of the requests)
+ */
+int decode_trace_z(trace_z_t *z, traceop_t *ops, int n)
+{
+    const unsigned char *p = z->next;
+    const unsigned char *end = z->end;
+    traceop_t *op = ops;
+    traceop_t *stop;
+    uint64_t v;
+    uint32_t id;
+    int has_arena, has_id, has_size, is_alloc;
+
+    while (op < ops + n) {
+	/* Start the next run */
+	while (z->run == 0) {
+	    GET_VARINT(p, end, v, done);
+	    z->run = v >> 3;
+	    z->type = v & 7;
+	    if (z->run == 0) {      /* the thread of the next runs */
+		GET_VARINT(p, end, v, done);
+		z->thread = v;
+		continue;
+	    }
+	    if (z->type > WAIT || z->thread >= TRACE_THREADS) {
+		printf("Bogus request type %d in compressed tracefile\n", 
+		       z->type);
+		exit(1);
+	    }
+	}
+	stop = (z->run < (uint64_t)(ops + n - op)) ? op + z->run : ops + n;
+	z->run -= stop - op;
+
+	/* The fields of this type of request, in the order of the encoder */
+	has_arena = (z->type >= ARENA_CREATE);
+	has_id = (z->type <= REALLOC || z->type == ARENA_ALLOC);
+	has_size = (z->type == ALLOC || z->type == REALLOC || 
+		    z->type == ARENA_ALLOC);
+	is_alloc = (z->type == ALLOC || z->type == ARENA_ALLOC);
+
+	for (; op < stop; op++) {
+	    memset(op, 0, sizeof(*op));
+	    op->type = z->type;
+	    op->thread = z->thread;
+	    if (has_arena) {
+		GET_VARINT(p, end, v, done);
+		op->arena = v;
+	    }
+	    if (has_id) {
+		GET_VARINT(p, end, v, done);
+		id = (v & 1) ? z->last_alloc : z->last_id;
+		v >>= 1;
+		id += (uint32_t)((v >> 1) ^ -(v & 1));  /* zigzag */
+		op->index = id;
+		z->last_id = id;
+		if (is_alloc)
+		    z->last_alloc = id;
+	    }
+	    if (has_size) {
+		GET_VARINT(p, end, v, done);
+		if (v & 1)
+		    op->size = z->sizes[(v >> 1) & (TRACE_Z_DICT - 1)];
+		else {
+		    op->size = v >> 1;
+		    z->sizes[TRACE_Z_SLOT(op->size)] = op->size;
+		}
+	    }
+	    if (z->type == WAIT) {
+		GET_VARINT(p, end, v, done);
+		op->index = v;
+	    }
+	}
+    }
+ done:
+    z->next = p;
+    return op - ops;
+}
+
+/*
+ * encode_trace_z - encode the n requests at ops into out, which must
+ *     hold TRACE_Z_BOUND(n) bytes, and return the number of bytes used.
+ *     Consecutive calls continue the same stream of runs.
+ */
+size_t encode_trace_z(trace_z_t *z, traceop_t *ops, int n, unsigned char *out)
+{
+    unsigned char *p = out;
+    traceop_t *op;
+    uint64_t d0, d1, size;
+    unsigned slot;
+    int i, j;
+
+    for (i = 0; i < n; i = j) {
+	/* A run is every following request of the same type and thread */
+	for (j = i + 1; j < n && ops[j].type == ops[i].type && 
+		 ops[j].thread == ops[i].thread; j++)
+	    ;
+	if (ops[i].thread != z->thread) {
+	    p = put_varint(p, 0);
+	    p = put_varint(p, ops[i].thread);
+	    z->thread = ops[i].thread;
+	}
+	p = put_varint(p, ((uint64_t)(j - i) << 3) | ops[i].type);
+
+	for (op = &ops[i]; op < &ops[j]; op++) {
+	    if (op->type >= ARENA_CREATE)
+		p = put_varint(p, op->arena);
+	    if (op->type == ALLOC || op->type == FREE || 
+		op->type == REALLOC || op->type == ARENA_ALLOC) {
+		/* Zigzag differences with both references; keep the smaller */
+		d0 = (uint32_t)(op->index - z->last_id);
+		d0 = (d0 & 0x80000000) ? ((~d0 & 0xffffffff) << 1) | 1 : d0 << 1;
+		d1 = (uint32_t)(op->index - z->last_alloc);
+		d1 = (d1 & 0x80000000) ? ((~d1 & 0xffffffff) << 1) | 1 : d1 << 1;
+		p = put_varint(p, (d1 < d0) ? (d1 << 1) | 1 : d0 << 1);
+		z->last_id = op->index;
+		if (op->type != FREE && op->type != REALLOC)
+		    z->last_alloc = op->index;
+	    }
+	    if (op->type == ALLOC || op->type == REALLOC || 
+		op->type == ARENA_ALLOC) {
+		size = op->size;
+		slot = TRACE_Z_SLOT(size);
+		if (z->sizes[slot] == size)
+		    p = put_varint(p, ((uint64_t)slot << 1) | 1);
+		else {
+		    p = put_varint(p, size << 1);
+		    z->sizes[slot] = size;
+		}
+	    }
+	    if (op->type == WAIT)
+		p = put_varint(p, op->index);
+	}
+    }
+    return p - out;
+}
+
+/*
+ * put_varint - encode v at out and return the byte after it
+ */
+static unsigned char *put_varint(unsigned char *out, uint64_t v)
+{
+    while (v >= 0x80) {
+	*out++ = (v & 0x7f) | 0x80;
+	v >>= 7;
+    }
+    *out++ = v;
+    return out;
+}
+
+/*
+ * write_rep_op - write op as a .rep request line
+ */
+void write_rep_op(FILE *tracefile, traceop_t *op)
+{
+    if (op->thread != 0)
+	fprintf(tracefile, "@%u ", op->thread);
+    switch (op->type) {
+    case ALLOC:
+	fprintf(tracefile, "a %u %llu\n", op->index, 
+		(unsigned long long)op->size);
+	break;
+    case REALLOC:
+	fprintf(tracefile, "r %u %llu\n", op->index, 
+		(unsigned long long)op->size);
+	break;
+    case FREE:
+	fprintf(tracefile, "f %u\n", op->index);
+	break;
+    case ARENA_CREATE:
+	fprintf(tracefile, "c %u\n", op->arena);
+	break;
+    case ARENA_ALLOC:
+	fprintf(tracefile, "b %u %u %llu\n", op->arena, op->index, 
+		(unsigned long long)op->size);
+	break;
+    case ARENA_RESET:
+	fprintf(tracefile, "x %u\n", op->arena);
+	break;
+    case ARENA_DESTROY:
+	fprintf(tracefile, "d %u\n", op->arena);
+	break;
+    case WAIT:
+	fprintf(tracefile, "w %u %u\n", op->arena, op->index);
+	break;
+    }
+}
+
+/*
+ * write_bin_trace - write trace as a binary tracefile to path
+ */
+void write_bin_trace(trace_t *trace, char *path)
+{
+    FILE *out;
+    trace_bin_hdr_t hdr;
+    char msg[MAXLINE];
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = TRACE_BIN_MAGIC;
+    hdr.recsize = sizeof(traceop_t);
+    hdr.sugg_heapsize = trace->sugg_heapsize;
+    hdr.num_ids = trace->num_ids;
+    hdr.num_ops = trace->num_ops;
+    hdr.weight = trace->weight;
+    hdr.num_arenas = trace->num_arenas;
+
+    if ((out = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not create %s in write_bin_trace", path);
+	trace_error(msg);
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, out) != 1 ||
+	fwrite(trace->ops, sizeof(traceop_t), trace->num_ops, out) != 
+	(size_t)trace->num_ops ||
+	fclose(out) != 0) {
+	sprintf(msg, "Could not write %s in write_bin_trace", path);
+	trace_error(msg);
+    }
+}
+
+/*
+ * free_trace - Free the trace record and the six arrays it points
+ *              to, all of which were allocated (or, for the requests
+ *              of a binary trace, mapped) in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+    if (trace->map != NULL)   /* unmap or free the requests... */
+	munmap(trace->map, trace->map_size);
+    else
+	free(trace->ops);
+    free(trace->blocks);      /* ... and the five other arrays... */
+    free(trace->block_sizes);
+    free(trace->arenas);
+    free(trace->arena_heads);
+    free(trace->arena_links);
+    free(trace);              /* and the trace record itself... */
+}
+
+/*
+ * trace_error - Report a Unix-style error while reading a trace
+ */
+static void trace_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
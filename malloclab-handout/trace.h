@@ -0,0 +1,117 @@
+/*
+ * trace.h - In-memory form of the tracefiles replayed by mdriver and
+ *           the other drivers, and the routines that read them.
+ */
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "mm.h"
+
+/* 
+ * Types of trace operations. WAIT is not an allocator request: it holds
+ * its thread back, in a concurrent replay (mdriver -C), until thread
+ * arena has done index requests. Sequential replays skip it.
+ */
+enum {ALLOC, FREE, REALLOC,
+      ARENA_CREATE, ARENA_ALLOC, 
+      ARENA_RESET, ARENA_DESTROY, WAIT};
+
+#define TRACE_THREADS 256             /* thread ids are 0 to 255 */
+
+/* 
+ * Characterizes a single trace operation (allocator request). The
+ * layout is fixed (16 bytes, same in 32- and 64-bit builds) because
+ * binary tracefiles are made of these records and are replayed in place.
+ */
+typedef struct {
+    uint64_t size;                    /* byte size of alloc/realloc request */
+    uint32_t index;                   /* index for free() to use later */
+    uint16_t arena;                   /* arena id for the arena requests */
+    uint8_t type;                     /* type of request */
+    uint8_t thread;                   /* thread that made it (0 if one) */
+} traceop_t;
+
+/* 
+ * A binary tracefile (see rep2bin) is this header followed by num_ops
+ * traceop_t records, in the byte order of the machine that wrote it.
+ * Files written before requests had a thread have 0 there.
+ */
+#define TRACE_BIN_MAGIC 0x31727462    /* "btr1" */
+typedef struct {
+    uint32_t magic;                   /* TRACE_BIN_MAGIC */
+    uint32_t recsize;                 /* sizeof(traceop_t) */
+    int32_t sugg_heapsize;            /* as in the .rep header */
+    int32_t num_ids;
+    int32_t num_ops;
+    int32_t weight;
+    int32_t num_arenas;               /* number of arena ids */
+    int32_t pad;                      /* always 0 */
+} trace_bin_hdr_t;
+
+/*
+ * A compressed tracefile (see tracez) has the same header, with magic
+ * TRACE_Z_MAGIC and recsize 0, followed by runs of requests of one type.
+ * Each run is a varint (length << 3 | type), then for each request:
+ *   id     zigzag varint of the difference with a recent id, shifted
+ *          left by one; the low bit selects the reference (0: the last
+ *          id of any request, 1: the last id allocated)
+ *   size   varint (slot << 1 | 1) if the size is in the dictionary, or
+ *          (size << 1) otherwise, which also stores it at slot
+ *          TRACE_Z_SLOT(size)
+ *   arena  varint
+ *   count  varint (WAIT only)
+ * Fields a request type does not have are left out. Varints are LEB128
+ * (7 bits per byte, low bits first). A run of length 0 is followed by a
+ * varint thread id that applies to the requests after it (the thread is
+ * 0 until the first one), so traces of one thread have none.
+ */
+#define TRACE_Z_MAGIC 0x317a7274      /* "trz1" */
+#define TRACE_Z_DICT 256              /* slots of the size dictionary */
+#define TRACE_Z_SLOT(size) ((unsigned)(((uint64_t)(size) * \
+			   0x9e3779b97f4a7c15ULL) >> 56))
+#define TRACE_Z_BOUND(n) ((size_t)(n) * 40) /* max bytes for n requests */
+
+/* Encoder or decoder state of a compressed tracefile */
+typedef struct {
+    const unsigned char *next;        /* next byte to decode */
+    const unsigned char *end;         /* end of the encoded requests */
+    uint64_t run;                     /* requests left in the current run */
+    int type;                         /* type of the current run */
+    uint32_t last_id;                 /* last id of any request */
+    uint32_t last_alloc;              /* last id allocated */
+    int thread;                       /* thread of the current run */
+    uint64_t sizes[TRACE_Z_DICT];     /* the size dictionary */
+} trace_z_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    int num_arenas;      /* number of arena ids */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc/realloc... */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    mm_arena_t **arenas; /* array of arenas returned by mm_arena_create */
+    int *arena_heads;    /* last block allocated in each arena (-1 if none) */
+    int *arena_links;    /* previous block allocated in the same arena */
+    void *map;           /* mapping of a binary tracefile (ops point into it) */
+    size_t map_size;     /* size of that mapping */
+} trace_t;
+
+trace_t *read_trace(char *tracedir, char *filename);
+void free_trace(trace_t *trace);
+trace_t *scale_trace(trace_t *trace, int copies);
+void write_bin_trace(trace_t *trace, char *path);
+void read_rep_header(FILE *tracefile, int *sugg_heapsize, int *num_ids,
+		     int *num_ops, int *weight);
+int read_rep_op(FILE *tracefile, char *path, traceop_t *op);
+void write_rep_op(FILE *tracefile, traceop_t *op);
+void init_trace_z(trace_z_t *z, const void *data, size_t len);
+int decode_trace_z(trace_z_t *z, traceop_t *ops, int n);
+size_t encode_trace_z(trace_z_t *z, traceop_t *ops, int n, unsigned char *out);
+
+#endif /* __TRACE_H_ */
@@ -0,0 +1,513 @@
+/*
+ * tracegen.c - Generate synthetic tracefiles from workload models
+ *
+ * Time advances by one tick per allocation. Each new block draws a size
+ * and a lifetime (in ticks) from the models of the current phase, and
+ * is freed when its lifetime runs out. A fraction of the blocks grow by
+ * a fixed factor a few times during their life (realloc chains). When
+ * an allocation would take the live bytes past the peak, the blocks
+ * closest to their end are freed early to make room.
+ *
+ * The trace is split into phases of equal length; phase i uses the
+ * i-th -S and -L models (cycling if fewer are given). Blocks that are
+ * still live at the end are freed in order, so traces are balanced.
+ *
+ * The generator only uses its own random number generator, so the same
+ * options and seed always give the same trace. The trace is generated
+ * twice, once to count the requests for the header and once to write
+ * it, so only the live blocks are ever held in memory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "model.h"
+
+#define MAXMODELS   16    /* max number of -S or -L models */
+#define CHUNK    65536    /* requests written at once (binary formats) */
+
+/* Default generator parameters */
+#define DEF_OPS     100000
+#define DEF_PEAK    (1 << 20)
+#define DEF_SIZE    "power:16,4096,1.2"
+#define DEF_LIFE    "exp:1000"
+#define DEF_GROWTH  2.0
+#define DEF_STEPS   4
+
+int verbose = 0;     /* needed by trace.c */
+
+/* A live block */
+typedef struct {
+    uint32_t id;                      /* trace id */
+    uint32_t gen;                     /* bumped when the slot is reused */
+    uint64_t size;                    /* current size */
+    int steps;                        /* reallocs still to come */
+} block_t;
+
+/* 
+ * A pending free or realloc of the block in slot. A realloc is dropped
+ * if the block was freed early (gen changed); every live block has
+ * exactly one pending free.
+ */
+typedef struct {
+    uint64_t time;
+    uint32_t slot;
+    uint32_t gen;
+} event_t;
+
+/* Min-heap of events ordered by time */
+typedef struct {
+    event_t *events;
+    size_t count, capacity;
+} heap_t;
+
+/* Generator parameters and state */
+typedef struct {
+    uint64_t seed, rng;               /* seed and random number state */
+    long num_ops;                     /* requests to generate (about) */
+    uint64_t peak;                    /* max live bytes */
+    model_t sizes[MAXMODELS], lives[MAXMODELS];
+    int num_sizes, num_lives;
+    int phases;                       /* number of phases */
+    double chain_frac;                /* fraction of blocks that grow */
+    double growth;                    /* growth factor of each realloc */
+    int steps;                        /* reallocs of a growing block */
+
+    block_t *blocks;                  /* live blocks, by slot */
+    uint32_t *free_slots;             /* unused slots */
+    size_t num_slots, num_free, slot_capacity;
+    heap_t deaths, reallocs;          /* pending frees and reallocs */
+    uint64_t live_bytes, max_live;
+    long emitted, pending;            /* requests written and to come */
+    uint32_t next_id;
+
+    int format;                       /* 'r'ep, 'b'inary or 'z' */
+    FILE *out;
+    traceop_t *buf;                   /* requests not written yet */
+    int buffered;
+    trace_z_t z;
+    unsigned char *zbuf;
+} gen_t;
+
+static void generate(gen_t *g);
+static void emit(gen_t *g, int type, uint32_t id, uint64_t size);
+static void flush_ops(gen_t *g);
+static void free_block(gen_t *g, uint32_t slot);
+static void realloc_block(gen_t *g, uint32_t slot);
+static uint32_t new_slot(gen_t *g);
+static void heap_push(heap_t *h, uint64_t time, uint32_t slot, uint32_t gen);
+static event_t heap_pop(heap_t *h);
+static void get_model(char *spec, model_t *m);
+static void *xmalloc(size_t size);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    char c;
+    gen_t g;
+    trace_bin_hdr_t hdr;
+
+    memset(&g, 0, sizeof(g));
+    g.seed = 1;
+    g.num_ops = DEF_OPS;
+    g.peak = DEF_PEAK;
+    g.growth = DEF_GROWTH;
+    g.steps = DEF_STEPS;
+    g.format = 'r';
+
+    while ((c = getopt(argc, argv, "s:n:p:S:L:r:g:c:bzhv")) != EOF) {
+	switch (c) {
+	case 's': /* Random seed */
+	    g.seed = strtoull(optarg, NULL, 0);
+	    break;
+	case 'n': /* Number of requests */
+	    g.num_ops = atol(optarg);
+	    break;
+	case 'p': /* Peak live bytes */
+	    g.peak = strtoull(optarg, NULL, 0);
+	    break;
+	case 'S': /* Size model of the next phase */
+	    if (g.num_sizes == MAXMODELS) {
+		usage();
+		exit(1);
+	    }
+	    get_model(optarg, &g.sizes[g.num_sizes++]);
+	    break;
+	case 'L': /* Lifetime model of the next phase */
+	    if (g.num_lives == MAXMODELS) {
+		usage();
+		exit(1);
+	    }
+	    get_model(optarg, &g.lives[g.num_lives++]);
+	    break;
+	case 'r': /* Fraction of blocks that are realloc chains */
+	    g.chain_frac = atof(optarg);
+	    break;
+	case 'g': /* Growth factor of each realloc of a chain */
+	    g.growth = atof(optarg);
+	    break;
+	case 'c': /* Reallocs per chain */
+	    g.steps = atoi(optarg);
+	    break;
+	case 'b': /* Write a binary tracefile */
+	    g.format = 'b';
+	    break;
+	case 'z': /* Write a compressed tracefile */
+	    g.format = 'z';
+	    break;
+	case 'v': /* Print a summary */
+	    verbose = 1;
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (argc - optind != 1 || g.num_ops <= 0 || g.peak == 0 ||
+	g.growth < 1.0 || g.steps < 0) {
+	usage();
+	exit(1);
+    }
+    if (g.num_sizes == 0)
+	get_model(DEF_SIZE, &g.sizes[g.num_sizes++]);
+    if (g.num_lives == 0)
+	get_model(DEF_LIFE, &g.lives[g.num_lives++]);
+    g.phases = (g.num_sizes > g.num_lives) ? g.num_sizes : g.num_lives;
+
+    /* First pass: count the requests and ids */
+    generate(&g);
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.sugg_heapsize = (g.max_live > INT32_MAX) ? INT32_MAX : g.max_live;
+    hdr.num_ids = g.next_id;
+    hdr.num_ops = g.emitted;
+    hdr.weight = 1;
+
+    /* Second pass: write them */
+    if ((g.out = fopen(argv[optind], "w")) == NULL) {
+	fprintf(stderr, "tracegen: cannot create %s\n", argv[optind]);
+	exit(1);
+    }
+    if (g.format == 'r')
+	fprintf(g.out, "%d\n%d\n%d\n%d\n", hdr.sugg_heapsize, hdr.num_ids,
+		hdr.num_ops, hdr.weight);
+    else {
+	hdr.magic = (g.format == 'b') ? TRACE_BIN_MAGIC : TRACE_Z_MAGIC;
+	hdr.recsize = (g.format == 'b') ? sizeof(traceop_t) : 0;
+	fwrite(&hdr, sizeof(hdr), 1, g.out);
+	g.buf = (traceop_t *)xmalloc(CHUNK * sizeof(traceop_t));
+	g.zbuf = (unsigned char *)xmalloc(TRACE_Z_BOUND(CHUNK));
+	init_trace_z(&g.z, NULL, 0);
+    }
+    generate(&g);
+    flush_ops(&g);
+    if (ferror(g.out) || fclose(g.out) != 0) {
+	fprintf(stderr, "tracegen: cannot write %s\n", argv[optind]);
+	exit(1);
+    }
+
+    if (verbose)
+	printf("%s: %ld requests, %u ids, peak %llu live bytes\n",
+	       argv[optind], g.emitted, g.next_id,
+	       (unsigned long long)g.max_live);
+    exit(0);
+}
+
+/*
+ * generate - run the model from the seed, writing the requests if an
+ *     output file is open
+ */
+static void generate(gen_t *g)
+{
+    uint64_t tick, size, life;
+    uint32_t slot;
+    block_t *b;
+    event_t e;
+    int phase, k;
+
+    /* Start over */
+    g->rng = g->seed;
+    g->num_slots = g->num_free = 0;
+    g->deaths.count = g->reallocs.count = 0;
+    g->live_bytes = g->max_live = 0;
+    g->emitted = g->pending = 0;
+    g->next_id = 0;
+
+    for (tick = 0; ; tick++) {
+	/* Requests due by now, the reallocs before the frees */
+	while ((g->reallocs.count > 0 &&
+		g->reallocs.events[0].time <= tick) ||
+	       (g->deaths.count > 0 && g->deaths.events[0].time <= tick)) {
+	    if (g->reallocs.count > 0 &&
+		g->reallocs.events[0].time <= tick) {
+		e = heap_pop(&g->reallocs);
+		if (g->blocks[e.slot].gen == e.gen)
+		    realloc_block(g, e.slot);
+	    }
+	    else
+		free_block(g, heap_pop(&g->deaths).slot);
+	}
+
+	/* Stop allocating once the requests to come make up the trace */
+	if (g->emitted + g->pending >= g->num_ops) {
+	    if (g->deaths.count == 0)
+		break;
+	    if (g->reallocs.count > 0 &&
+		g->reallocs.events[0].time < g->deaths.events[0].time)
+		tick = g->reallocs.events[0].time - 1;
+	    else
+		tick = g->deaths.events[0].time - 1;
+	    continue;
+	}
+
+	/* Allocate a block with the models of the current phase */
+	phase = (int)((double)g->emitted * g->phases / g->num_ops);
+	size = model_sample(&g->sizes[phase % g->num_sizes], &g->rng);
+	life = model_sample(&g->lives[phase % g->num_lives], &g->rng);
+	if (size == 0)
+	    size = 1;
+	if (size > g->peak)
+	    size = g->peak;
+	if (life == 0)
+	    life = 1;
+	while (g->live_bytes + size > g->peak)
+	    free_block(g, heap_pop(&g->deaths).slot);
+
+	slot = new_slot(g);
+	b = &g->blocks[slot];
+	b->id = g->next_id++;
+	b->size = size;
+	b->steps = (model_uniform(&g->rng) < g->chain_frac) ? g->steps : 0;
+	g->live_bytes += size;
+	if (g->live_bytes > g->max_live)
+	    g->max_live = g->live_bytes;
+	emit(g, ALLOC, b->id, size);
+
+	/* The reallocs of a chain are spread evenly over its life */
+	heap_push(&g->deaths, tick + life, slot, b->gen);
+	for (k = 1; k <= b->steps; k++)
+	    heap_push(&g->reallocs, tick + life * k / (b->steps + 1),
+		      slot, b->gen);
+	g->pending += 1 + b->steps;
+    }
+}
+
+/*
+ * free_block - free the block in slot (and forget its reallocs)
+ */
+static void free_block(gen_t *g, uint32_t slot)
+{
+    block_t *b = &g->blocks[slot];
+
+    emit(g, FREE, b->id, 0);
+    g->live_bytes -= b->size;
+    g->pending -= 1 + b->steps;
+    b->gen++;
+    g->free_slots[g->num_free++] = slot;
+}
+
+/*
+ * realloc_block - grow the block in slot by the growth factor, making
+ *     room as for an allocation. Blocks that would take more than half
+ *     of the peak stop growing.
+ */
+static void realloc_block(gen_t *g, uint32_t slot)
+{
+    block_t *b = &g->blocks[slot];
+    uint64_t size = (uint64_t)(b->size * g->growth);
+
+    b->steps--;
+    g->pending--;
+    if (size > g->peak / 2)
+	return;
+
+    /* Make room, but do not free the block itself */
+    while (g->live_bytes + size - b->size > g->peak &&
+	   g->deaths.events[0].slot != slot)
+	free_block(g, heap_pop(&g->deaths).slot);
+    if (g->live_bytes + size - b->size > g->peak)
+	return;
+
+    emit(g, REALLOC, b->id, size);
+    g->live_bytes += size - b->size;
+    if (g->live_bytes > g->max_live)
+	g->max_live = g->live_bytes;
+    b->size = size;
+}
+
+/*
+ * new_slot - return an unused slot of the live block table
+ */
+static uint32_t new_slot(gen_t *g)
+{
+    if (g->num_free > 0)
+	return g->free_slots[--g->num_free];
+    if (g->num_slots == g->slot_capacity) {
+	g->slot_capacity = g->slot_capacity ? 2 * g->slot_capacity : 1024;
+	g->blocks = (block_t *)realloc(g->blocks,
+				       g->slot_capacity * sizeof(block_t));
+	g->free_slots = (uint32_t *)realloc(g->free_slots,
+					    g->slot_capacity * sizeof(uint32_t));
+	if (g->blocks == NULL || g->free_slots == NULL) {
+	    fprintf(stderr, "tracegen: out of memory\n");
+	    exit(1);
+	}
+    }
+    g->blocks[g->num_slots].gen = 0;
+    return g->num_slots++;
+}
+
+/*
+ * emit - count a request, and write it in the second pass
+ */
+static void emit(gen_t *g, int type, uint32_t id, uint64_t size)
+{
+    traceop_t op;
+
+    g->emitted++;
+    if (g->out == NULL)
+	return;
+    memset(&op, 0, sizeof(op));
+    op.type = type;
+    op.index = id;
+    op.size = size;
+    if (g->format == 'r')
+	write_rep_op(g->out, &op);
+    else {
+	g->buf[g->buffered++] = op;
+	if (g->buffered == CHUNK)
+	    flush_ops(g);
+    }
+}
+
+/*
+ * flush_ops - write the buffered requests (binary formats)
+ */
+static void flush_ops(gen_t *g)
+{
+    size_t len;
+
+    if (g->format == 'b')
+	fwrite(g->buf, sizeof(traceop_t), g->buffered, g->out);
+    else if (g->format == 'z') {
+	len = encode_trace_z(&g->z, g->buf, g->buffered, g->zbuf);
+	fwrite(g->zbuf, 1, len, g->out);
+    }
+    g->buffered = 0;
+}
+
+/*
+ * heap_push - add an event to a heap
+ */
+static void heap_push(heap_t *h, uint64_t time, uint32_t slot, uint32_t gen)
+{
+    size_t i, parent;
+    event_t e;
+
+    if (h->count == h->capacity) {
+	h->capacity = h->capacity ? 2 * h->capacity : 1024;
+	h->events = (event_t *)realloc(h->events,
+				       h->capacity * sizeof(event_t));
+	if (h->events == NULL) {
+	    fprintf(stderr, "tracegen: out of memory\n");
+	    exit(1);
+	}
+    }
+    e.time = time;
+    e.slot = slot;
+    e.gen = gen;
+    for (i = h->count++; i > 0; i = parent) {
+	parent = (i - 1) / 2;
+	if (h->events[parent].time <= time)
+	    break;
+	h->events[i] = h->events[parent];
+    }
+    h->events[i] = e;
+}
+
+/*
+ * heap_pop - remove and return the earliest event of a heap
+ */
+static event_t heap_pop(heap_t *h)
+{
+    event_t top = h->events[0];
+    event_t last = h->events[--h->count];
+    size_t i, child;
+
+    for (i = 0; (child = 2 * i + 1) < h->count; i = child) {
+	if (child + 1 < h->count &&
+	    h->events[child + 1].time < h->events[child].time)
+	    child++;
+	if (last.time <= h->events[child].time)
+	    break;
+	h->events[i] = h->events[child];
+    }
+    h->events[i] = last;
+    return top;
+}
+
+/*
+ * get_model - parse a model or die
+ */
+static void get_model(char *spec, model_t *m)
+{
+    if (parse_model(spec, m) < 0) {
+	fprintf(stderr, "tracegen: bad model %s\n", spec);
+	exit(1);
+    }
+}
+
+/*
+ * xmalloc - malloc or die
+ */
+static void *xmalloc(size_t size)
+{
+    void *p;
+
+    if ((p = malloc(size)) == NULL) {
+	fprintf(stderr, "tracegen: out of memory\n");
+	exit(1);
+    }
+    return p;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tracegen [-bzhv] [-s <seed>] [-n <ops>] "
+	    "[-p <peak>] [-S <model>]... [-L <model>]...\n"
+	    "                [-r <frac>] [-g <growth>] [-c <steps>] <out>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b          Write a binary tracefile.\n");
+    fprintf(stderr, "\t-c <steps>  Reallocs per realloc chain (default %d).\n",
+	    DEF_STEPS);
+    fprintf(stderr, "\t-g <growth> Growth factor of each realloc "
+	    "(default %.1f).\n", DEF_GROWTH);
+    fprintf(stderr, "\t-h          Print this message.\n");
+    fprintf(stderr, "\t-L <model>  Lifetimes in allocations, one per phase "
+	    "(default %s).\n", DEF_LIFE);
+    fprintf(stderr, "\t-n <ops>    About <ops> requests (default %d).\n",
+	    DEF_OPS);
+    fprintf(stderr, "\t-p <peak>   At most <peak> live bytes (default %d).\n",
+	    DEF_PEAK);
+    fprintf(stderr, "\t-r <frac>   Fraction of blocks that are realloc "
+	    "chains (default 0).\n");
+    fprintf(stderr, "\t-s <seed>   Random seed (default 1).\n");
+    fprintf(stderr, "\t-S <model>  Sizes, one per phase (default %s).\n",
+	    DEF_SIZE);
+    fprintf(stderr, "\t-v          Print a summary.\n");
+    fprintf(stderr, "\t-z          Write a compressed tracefile.\n");
+    fprintf(stderr, "Models\n");
+    fprintf(stderr, "\tfixed:<v>,<v>,...       one of the values\n");
+    fprintf(stderr, "\tuniform:<lo>,<hi>       uniform\n");
+    fprintf(stderr, "\texp:<mean>              exponential\n");
+    fprintf(stderr, "\tpower:<lo>,<hi>,<alpha> power law\n");
+    fprintf(stderr, "\tbimodal:<a>,<b>,<p>     <a>, or <b> with probability "
+	    "<p> (+-25%%)\n");
+}
@@ -0,0 +1,501 @@
+/*
+ * tracestat.c - Characterize the workload of tracefiles, as JSON
+ *
+ *     unix> tracestat traces/amptjp-bal.rep traces/cccp-bal.rep
+ *
+ * For each trace (.rep, binary or compressed) it reports the number of
+ * requests of each type, the distribution of the requested sizes (with
+ * the most frequent exact sizes, the candidates for size classes), the
+ * lifetimes of the blocks in requests, the peak and mean live bytes,
+ * the ideal heap (the peak of the live bytes rounded up to ALIGNMENT,
+ * a lower bound for any allocator), the realloc chains and how much
+ * each realloc grows a block, and how often a malloc asks for exactly
+ * the size of a block freed earlier and not reused yet.
+ *
+ * A block lives from the request that allocates it to the one that
+ * frees it (or resets its arena); reallocs extend it. Blocks still live
+ * at the end are counted apart and do not have a lifetime.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "trace.h"
+#include "config.h"
+
+#define TOPSIZES   16     /* most frequent sizes listed */
+#define MAXCHAIN   8      /* longer realloc chains are counted together */
+#define SIZEMAP_MIN 1024  /* initial capacity of a size map */
+
+/* Rounds up to a multiple of ALIGNMENT */
+#define ALIGN_UP(size) (((size) + (ALIGNMENT - 1)) & ~(uint64_t)(ALIGNMENT - 1))
+
+int verbose = 0;     /* needed by trace.c */
+
+/* Names of the request types, as the JSON keys */
+static char *type_names[] = {
+    "malloc", "free", "realloc", "arena_create", "arena_alloc",
+    "arena_reset", "arena_destroy", "wait"
+};
+
+/* Counts by size: open addressing, keys are size + 1 (0: empty slot) */
+typedef struct {
+    uint64_t *keys;
+    uint64_t *counts;
+    size_t capacity, count;
+} sizemap_t;
+
+/* A block id, while it is live */
+typedef struct {
+    uint64_t size;                    /* current size */
+    int born;                         /* request that allocated it */
+    int reallocs;                     /* reallocs so far */
+    int live;
+} block_t;
+
+/* What is gathered in one pass over a trace */
+typedef struct {
+    long types[WAIT + 1];             /* requests by type */
+    int threads;                      /* highest thread id + 1 */
+    uint64_t *sizes;                  /* every size asked for */
+    long num_sizes;
+    uint64_t *lives;                  /* lifetimes of the freed blocks */
+    long num_lives;
+    long never_freed;                 /* blocks live at the end */
+    uint64_t live, peak, peak_at;     /* live bytes, their peak and when */
+    uint64_t aligned, ideal;          /* the same, rounded up to ALIGNMENT */
+    double live_sum;                  /* for the mean live bytes */
+    long chains[MAXCHAIN + 1];        /* realloc chains by length */
+    long chain_sum, chain_max;        /* their total and longest length */
+    long growth[6];                   /* reallocs by growth (see below) */
+    double log_growth;                /* sum of log(new / old) */
+    long grown;                       /* reallocs in log_growth */
+    long mallocs, reused;             /* same-size reuse */
+    sizemap_t by_size, freed;         /* requests and freed blocks by size */
+} tstat_t;
+
+/* The buckets of realloc growth factors */
+static char *growth_names[] = {
+    "shrink", "same", "under_1.5", "under_2", "under_4", "4_or_more"
+};
+
+static void analyze(trace_t *trace, tstat_t *st);
+static void release(tstat_t *st, block_t *b, int now, int freed);
+static void add_size(tstat_t *st, uint64_t size);
+static void print_trace(FILE *fp, char *name, trace_t *trace, tstat_t *st);
+static void print_dist(FILE *fp, char *name, uint64_t *values, long n,
+		       int bytes);
+static void print_top(FILE *fp, sizemap_t *map);
+static uint64_t *sizemap_get(sizemap_t *map, uint64_t size);
+static void sizemap_free(sizemap_t *map);
+static int compare_u64(const void *a, const void *b);
+static void *xmalloc(size_t size);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    char c;
+    char *outfile = NULL;
+    FILE *fp = stdout;
+    trace_t *trace;
+    tstat_t st;
+    int i;
+
+    while ((c = getopt(argc, argv, "o:h")) != EOF) {
+	switch (c) {
+	case 'o': /* Write the JSON to a file */
+	    outfile = optarg;
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (argc - optind < 1) {
+	usage();
+	exit(1);
+    }
+    if (outfile != NULL && (fp = fopen(outfile, "w")) == NULL) {
+	fprintf(stderr, "tracestat: cannot create %s\n", outfile);
+	exit(1);
+    }
+
+    fprintf(fp, "{\n  \"alignment\": %d,\n  \"traces\": [\n", ALIGNMENT);
+    for (i = optind; i < argc; i++) {
+	trace = read_trace("", argv[i]);
+	analyze(trace, &st);
+	print_trace(fp, argv[i], trace, &st);
+	fprintf(fp, "%s\n", i + 1 < argc ? "," : "");
+	free(st.sizes);
+	free(st.lives);
+	sizemap_free(&st.by_size);
+	sizemap_free(&st.freed);
+	free_trace(trace);
+    }
+    fprintf(fp, "  ]\n}\n");
+    if (ferror(fp) || (outfile != NULL && fclose(fp) != 0)) {
+	fprintf(stderr, "tracestat: cannot write %s\n",
+		outfile != NULL ? outfile : "the output");
+	exit(1);
+    }
+    exit(0);
+}
+
+/*
+ * analyze - replay the requests of a trace on paper, keeping track of
+ *     the live blocks, and gather the statistics in st
+ */
+static void analyze(trace_t *trace, tstat_t *st)
+{
+    block_t *blocks, *b;
+    traceop_t *op;
+    uint64_t old, *count;
+    double factor;
+    int i, j;
+
+    memset(st, 0, sizeof(*st));
+    st->sizes = (uint64_t *)xmalloc((trace->num_ops + 1) * sizeof(uint64_t));
+    st->lives = (uint64_t *)xmalloc((trace->num_ops + 1) * sizeof(uint64_t));
+    blocks = (block_t *)calloc(trace->num_ids + 1, sizeof(block_t));
+    if (blocks == NULL) {
+	fprintf(stderr, "tracestat: out of memory\n");
+	exit(1);
+    }
+    for (i = 0; i < trace->num_arenas; i++)
+	trace->arena_heads[i] = -1;
+
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	b = &blocks[op->index];
+	st->types[op->type]++;
+	if (op->thread >= st->threads)
+	    st->threads = op->thread + 1;
+
+	switch (op->type) {
+
+	case ALLOC:
+	    /* Could it have had a block of the same size freed earlier? */
+	    st->mallocs++;
+	    count = sizemap_get(&st->freed, op->size);
+	    if (*count > 0) {
+		(*count)--;
+		st->reused++;
+	    }
+	    /* fall through */
+
+	case ARENA_ALLOC:
+	    add_size(st, op->size);
+	    b->size = op->size;
+	    b->born = i;
+	    b->reallocs = 0;
+	    b->live = 1;
+	    st->live += op->size;
+	    st->aligned += ALIGN_UP(op->size);
+	    if (op->type == ARENA_ALLOC) {
+		trace->arena_links[op->index] = trace->arena_heads[op->arena];
+		trace->arena_heads[op->arena] = op->index;
+	    }
+	    break;
+
+	case REALLOC:
+	    add_size(st, op->size);
+	    old = b->size;
+	    if (old == 0)
+		st->growth[op->size == 0 ? 1 : 5]++;
+	    else {
+		factor = (double)op->size / old;
+		st->growth[factor < 1 ? 0 : factor == 1 ? 1 : factor < 1.5 ? 2 :
+			   factor < 2 ? 3 : factor < 4 ? 4 : 5]++;
+		if (op->size > 0) {
+		    st->log_growth += log(factor);
+		    st->grown++;
+		}
+	    }
+	    b->size = op->size;
+	    b->reallocs++;
+	    st->live += op->size - old;
+	    st->aligned += ALIGN_UP(op->size) - ALIGN_UP(old);
+	    break;
+
+	case FREE:
+	    *sizemap_get(&st->freed, b->size) += 1;
+	    release(st, b, i, 1);
+	    break;
+
+	case ARENA_RESET:
+	case ARENA_DESTROY:
+	    for (j = trace->arena_heads[op->arena]; j >= 0;
+		 j = trace->arena_links[j])
+		release(st, &blocks[j], i, 1);
+	    trace->arena_heads[op->arena] = -1;
+	    break;
+	}
+
+	if (st->live > st->peak) {
+	    st->peak = st->live;
+	    st->peak_at = i;
+	}
+	if (st->aligned > st->ideal)
+	    st->ideal = st->aligned;
+	st->live_sum += st->live;
+    }
+
+    /* The blocks the trace never frees */
+    for (i = 0; i < trace->num_ids; i++)
+	if (blocks[i].live)
+	    release(st, &blocks[i], trace->num_ops, 0);
+    free(blocks);
+}
+
+/*
+ * release - a block goes away at request now: count its lifetime (if
+ *     it was freed) and its realloc chain
+ */
+static void release(tstat_t *st, block_t *b, int now, int freed)
+{
+    if (!b->live)
+	return;
+    if (freed)
+	st->lives[st->num_lives++] = now - b->born;
+    else
+	st->never_freed++;
+    if (b->reallocs > 0) {
+	st->chains[b->reallocs < MAXCHAIN ? b->reallocs : MAXCHAIN]++;
+	st->chain_sum += b->reallocs;
+	if (b->reallocs > st->chain_max)
+	    st->chain_max = b->reallocs;
+    }
+    st->live -= b->size;
+    st->aligned -= ALIGN_UP(b->size);
+    b->live = 0;
+    b->size = 0;
+}
+
+/*
+ * add_size - count a requested size
+ */
+static void add_size(tstat_t *st, uint64_t size)
+{
+    st->sizes[st->num_sizes++] = size;
+    *sizemap_get(&st->by_size, size) += 1;
+}
+
+/*
+ * print_trace - write the statistics of one trace as a JSON object
+ */
+static void print_trace(FILE *fp, char *name, trace_t *trace, tstat_t *st)
+{
+    long chains = 0;
+    int type, i;
+
+    fprintf(fp, "    {\"file\": \"%s\", \"requests\": %d, \"ids\": %d, "
+	    "\"arenas\": %d, \"threads\": %d,\n", name, trace->num_ops,
+	    trace->num_ids, trace->num_arenas, st->threads);
+    fprintf(fp, "     \"types\": {");
+    for (type = 0; type <= WAIT; type++)
+	fprintf(fp, "%s\"%s\": %ld", type ? ", " : "", type_names[type],
+		st->types[type]);
+    fprintf(fp, "},\n");
+
+    print_dist(fp, "sizes", st->sizes, st->num_sizes, 1);
+    fprintf(fp, ",\n     \"top_sizes\": ");
+    print_top(fp, &st->by_size);
+    fprintf(fp, ",\n");
+    print_dist(fp, "lifetimes", st->lives, st->num_lives, 0);
+    fprintf(fp, ",\n     \"never_freed\": %ld,\n", st->never_freed);
+
+    fprintf(fp, "     \"live_bytes\": {\"peak\": %llu, \"peak_at\": %llu, "
+	    "\"mean\": %.0f},\n", (unsigned long long)st->peak,
+	    (unsigned long long)st->peak_at,
+	    trace->num_ops > 0 ? st->live_sum / trace->num_ops : 0.0);
+    fprintf(fp, "     \"ideal_heap\": %llu, \"max_util\": %.4f,\n",
+	    (unsigned long long)st->ideal,
+	    st->ideal > 0 ? (double)st->peak / st->ideal : 0.0);
+
+    for (i = 1; i <= MAXCHAIN; i++)
+	chains += st->chains[i];
+    fprintf(fp, "     \"realloc_chains\": {\"count\": %ld, \"mean_length\": "
+	    "%.2f, \"max_length\": %ld,\n       \"lengths\": {", chains,
+	    chains > 0 ? (double)st->chain_sum / chains : 0.0, st->chain_max);
+    for (i = 1; i <= MAXCHAIN; i++)
+	fprintf(fp, "%s\"%d%s\": %ld", i > 1 ? ", " : "", i,
+		i == MAXCHAIN ? "+" : "", st->chains[i]);
+    fprintf(fp, "},\n       \"growth\": {\"mean_factor\": %.4f",
+	    st->grown > 0 ? exp(st->log_growth / st->grown) : 0.0);
+    for (i = 0; i < 6; i++)
+	fprintf(fp, ", \"%s\": %ld", growth_names[i], st->growth[i]);
+    fprintf(fp, "}},\n");
+
+    fprintf(fp, "     \"same_size_reuse\": %.4f}",
+	    st->mallocs > 0 ? (double)st->reused / st->mallocs : 0.0);
+}
+
+/*
+ * print_dist - write the distribution of n values as a JSON member:
+ *     count, mean, percentiles, and a histogram with a bucket per power
+ *     of two ([from, to), with the bytes in it if bytes is set). Sorts
+ *     the values.
+ */
+static void print_dist(FILE *fp, char *name, uint64_t *values, long n,
+		       int bytes)
+{
+    double sum = 0;
+    uint64_t from, to, total;
+    long i, j;
+
+    fprintf(fp, "     \"%s\": {\"count\": %ld", name, n);
+    if (n == 0) {
+	fprintf(fp, "}");
+	return;
+    }
+    qsort(values, n, sizeof(uint64_t), compare_u64);
+    for (i = 0; i < n; i++)
+	sum += values[i];
+    fprintf(fp, ", \"min\": %llu, \"mean\": %.1f, \"p50\": %llu, "
+	    "\"p90\": %llu, \"p99\": %llu, \"max\": %llu,\n"
+	    "       \"histogram\": [",
+	    (unsigned long long)values[0], sum / n,
+	    (unsigned long long)values[n / 2],
+	    (unsigned long long)values[(long)(n * 0.9)],
+	    (unsigned long long)values[(long)(n * 0.99)],
+	    (unsigned long long)values[n - 1]);
+
+    /* The values are sorted, so each bucket is a run of them */
+    for (i = 0; i < n; i = j) {
+	for (from = 1; from <= values[i] / 2; from *= 2)
+	    ;
+	if (values[i] == 0)
+	    from = 0;
+	to = from ? 2 * from : 1;
+	for (j = i, total = 0; j < n && (values[j] < to || to == 0); j++)
+	    total += values[j];
+	fprintf(fp, "%s{\"from\": %llu, \"to\": %llu, \"count\": %ld",
+		i ? ", " : "", (unsigned long long)from,
+		(unsigned long long)to, j - i);
+	if (bytes)
+	    fprintf(fp, ", \"bytes\": %llu", (unsigned long long)total);
+	fprintf(fp, "}");
+    }
+    fprintf(fp, "]}");
+}
+
+/*
+ * print_top - write the TOPSIZES most frequent sizes, with their counts
+ */
+static void print_top(FILE *fp, sizemap_t *map)
+{
+    size_t i, k, best;
+    uint64_t *taken;
+    int n;
+
+    taken = (uint64_t *)calloc(map->capacity + 1, sizeof(uint64_t));
+    if (taken == NULL) {
+	fprintf(stderr, "tracestat: out of memory\n");
+	exit(1);
+    }
+    fprintf(fp, "[");
+    for (n = 0; n < TOPSIZES && (size_t)n < map->count; n++) {
+	best = map->capacity;
+	for (i = 0; i < map->capacity; i++)
+	    if (map->keys[i] != 0 && !taken[i] &&
+		(best == map->capacity || map->counts[i] > map->counts[best] ||
+		 (map->counts[i] == map->counts[best] &&
+		  map->keys[i] < map->keys[best])))
+		best = i;
+	k = best;
+	taken[k] = 1;
+	fprintf(fp, "%s{\"size\": %llu, \"count\": %llu}", n ? ", " : "",
+		(unsigned long long)(map->keys[k] - 1),
+		(unsigned long long)map->counts[k]);
+    }
+    fprintf(fp, "]");
+    free(taken);
+}
+
+/*
+ * sizemap_get - the count of a size, added (as 0) if it is not there yet
+ */
+static uint64_t *sizemap_get(sizemap_t *map, uint64_t size)
+{
+    sizemap_t old;
+    size_t i, mask;
+
+    /* Grow to keep the table at most half full */
+    if (2 * (map->count + 1) > map->capacity) {
+	old = *map;
+	map->capacity = old.capacity ? 2 * old.capacity : SIZEMAP_MIN;
+	map->keys = (uint64_t *)calloc(map->capacity, sizeof(uint64_t));
+	map->counts = (uint64_t *)calloc(map->capacity, sizeof(uint64_t));
+	if (map->keys == NULL || map->counts == NULL) {
+	    fprintf(stderr, "tracestat: out of memory\n");
+	    exit(1);
+	}
+	map->count = 0;
+	for (i = 0; i < old.capacity; i++)
+	    if (old.keys[i] != 0)
+		*sizemap_get(map, old.keys[i] - 1) = old.counts[i];
+	sizemap_free(&old);
+    }
+
+    mask = map->capacity - 1;
+    for (i = (size * 0x9e3779b97f4a7c15ULL) >> 20 & mask;
+	 map->keys[i] != 0 && map->keys[i] != size + 1; i = (i + 1) & mask)
+	;
+    if (map->keys[i] == 0) {
+	map->keys[i] = size + 1;
+	map->count++;
+    }
+    return &map->counts[i];
+}
+
+/*
+ * sizemap_free - free the tables of a size map
+ */
+static void sizemap_free(sizemap_t *map)
+{
+    free(map->keys);
+    free(map->counts);
+    map->keys = map->counts = NULL;
+    map->capacity = map->count = 0;
+}
+
+/*
+ * compare_u64 - qsort order of 64-bit values
+ */
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * xmalloc - malloc or die
+ */
+static void *xmalloc(size_t size)
+{
+    void *p;
+
+    if ((p = malloc(size)) == NULL) {
+	fprintf(stderr, "tracestat: out of memory\n");
+	exit(1);
+    }
+    return p;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tracestat [-h] [-o <out.json>] <trace>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-o <file>  Write the JSON to <file> instead of "
+	    "stdout.\n");
+}
@@ -0,0 +1,141 @@
+/*
+ * tracez.c - Compress tracefiles, or decompress them back to .rep
+ *
+ * The compressed format (see trace.h) codes the requests as runs of one
+ * type, with ids as small differences from recent ids and repeated
+ * sizes as dictionary slots, typically in 2 to 4 bytes per request.
+ * mdriver and the other drivers read compressed tracefiles directly.
+ *
+ * The input (.rep, binary or compressed) is streamed (see stream.c), so
+ * tracefiles much larger than memory can be converted.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "stream.h"
+
+int verbose = 0;     /* needed by trace.c */
+
+static void compress_trace(trace_stream_t *in, FILE *out);
+static void decompress_trace(trace_stream_t *in, FILE *out);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    char c;
+    int decompress = 0;
+    trace_stream_t *in;
+    FILE *out;
+
+    while ((c = getopt(argc, argv, "dhv")) != EOF) {
+	switch (c) {
+	case 'd': /* Write a .rep tracefile */
+	    decompress = 1;
+	    break;
+	case 'v': /* Print the sizes */
+	    verbose = 1;
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (argc - optind != 2) {
+	usage();
+	exit(1);
+    }
+
+    in = open_trace_stream("", argv[optind]);
+    if ((out = fopen(argv[optind + 1], "w")) == NULL) {
+	fprintf(stderr, "tracez: cannot create %s\n", argv[optind + 1]);
+	exit(1);
+    }
+    if (decompress)
+	decompress_trace(in, out);
+    else
+	compress_trace(in, out);
+    if (ferror(out) || fclose(out) != 0) {
+	fprintf(stderr, "tracez: cannot write %s\n", argv[optind + 1]);
+	exit(1);
+    }
+    close_trace_stream(in);
+    exit(0);
+}
+
+/*
+ * compress_trace - write the requests of in to out in compressed form.
+ *     The header is written last, once the requests and arenas have
+ *     been counted.
+ */
+static void compress_trace(trace_stream_t *in, FILE *out)
+{
+    trace_bin_hdr_t hdr;
+    trace_z_t z;
+    traceop_t *ops;
+    unsigned char *buf;
+    size_t len, total = 0;
+    int i, n;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = TRACE_Z_MAGIC;
+    hdr.sugg_heapsize = in->sugg_heapsize;
+    hdr.num_ids = in->num_ids;
+    hdr.weight = in->weight;
+    if ((buf = (unsigned char *)malloc(TRACE_Z_BOUND(STREAM_CHUNK))) == NULL) {
+	fprintf(stderr, "tracez: out of memory\n");
+	exit(1);
+    }
+
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    init_trace_z(&z, NULL, 0);
+    while ((n = next_trace_chunk(in, &ops)) > 0) {
+	for (i = 0; i < n; i++)
+	    if (ops[i].type == ARENA_CREATE && ops[i].arena >= hdr.num_arenas)
+		hdr.num_arenas = ops[i].arena + 1;
+	len = encode_trace_z(&z, ops, n, buf);
+	fwrite(buf, 1, len, out);
+	hdr.num_ops += n;
+	total += len;
+    }
+    rewind(out);
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    free(buf);
+
+    if (verbose)
+	printf("%d requests in %lu bytes (%.2f bytes per request)\n",
+	       hdr.num_ops, (unsigned long)(total + sizeof(hdr)),
+	       hdr.num_ops ? (double)total / hdr.num_ops : 0.0);
+}
+
+/*
+ * decompress_trace - write the requests of in to out as a .rep file
+ */
+static void decompress_trace(trace_stream_t *in, FILE *out)
+{
+    traceop_t *ops;
+    int i, n;
+
+    fprintf(out, "%d\n%d\n%d\n%d\n", in->sugg_heapsize, in->num_ids,
+	    in->num_ops, in->weight);
+    while ((n = next_trace_chunk(in, &ops)) > 0)
+	for (i = 0; i < n; i++)
+	    write_rep_op(out, &ops[i]);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tracez [-dhv] <in> <out>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-d  Decompress: write <out> as a .rep tracefile.\n");
+    fprintf(stderr, "\t-h  Print this message.\n");
+    fprintf(stderr, "\t-v  Print additional info.\n");
+}